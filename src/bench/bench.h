@@ -15,6 +15,9 @@
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/stringize.hpp>
 
+// number of names the claim trie benchmarks work on, see -claimtrienames
+static const int64_t DEFAULT_BENCH_CLAIMTRIE_NAMES = 10000;
+
 // Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
 // framework (see https://github.com/google/benchmark)
 // Why not use the Google Benchmark framework? Because adding Yet Another Dependency
@@ -4,7 +4,9 @@
 
 #include <bench/bench.h>
 
+#include <crypto/ripemd160.h>
 #include <crypto/sha256.h>
+#include <crypto/sha512.h>
 #include <key.h>
 #include <random.h>
 #include <util.h>
@@ -32,6 +34,7 @@ static void SetupBenchArgs()
     gArgs.AddArg("-plot-plotlyurl=<uri>", strprintf("URL to use for plotly.js (default: %s)", DEFAULT_PLOT_PLOTLYURL), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-plot-width=<x>", strprintf("Plot width in pixel (default: %u)", DEFAULT_PLOT_WIDTH), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-plot-height=<x>", strprintf("Plot height in pixel (default: %u)", DEFAULT_PLOT_HEIGHT), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimtrienames=<n>", strprintf("Number of names in the tries of the claim trie benchmarks (default: %u)", DEFAULT_BENCH_CLAIMTRIE_NAMES), false, OptionsCategory::OPTIONS);
 
     // Hidden
     gArgs.AddArg("-h", "", false, OptionsCategory::HIDDEN);
@@ -65,6 +68,8 @@ int main(int argc, char** argv)
     const fs::path bench_datadir{SetDataDir()};
 
     SHA256AutoDetect();
+    SHA512AutoDetect();
+    RIPEMD160AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -0,0 +1,277 @@
+// Copyright (c) 2019 The LBRY developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <chainparams.h>
+#include <claimtrie.h>
+#include <nameclaim.h>
+#include <prefixtrie.h>
+#include <random.h>
+#include <util.h>
+
+#include <cassert>
+#include <cctype>
+#include <string>
+#include <vector>
+
+// regtest heights on either side of nAllClaimsInMerkleForkHeight (350) and past nNormalizedNameForkHeight (250)
+static const int PRE_HASH_FORK_HEIGHT = 300;
+static const int POST_HASH_FORK_HEIGHT = 400;
+
+// random names of 3 to 12 characters, so that many of them share a prefix
+static std::vector<std::string> ClaimTrieNames()
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789-";
+    auto count = std::max<int64_t>(gArgs.GetArg("-claimtrienames", DEFAULT_BENCH_CLAIMTRIE_NAMES), 1);
+    FastRandomContext rng(true);
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (int64_t i = 0; i < count; ++i) {
+        std::string name(3 + rng.randrange(10), '\0');
+        for (auto& c : name)
+            c = chars[rng.randrange(sizeof(chars) - 1)];
+        names.push_back(std::move(name));
+    }
+    return names;
+}
+
+static COutPoint ClaimTrieOutPoint(uint32_t i)
+{
+    return COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+}
+
+class CClaimTrieCacheBench : public CClaimTrieCache
+{
+public:
+    CClaimTrieCacheBench(CClaimTrie* base, int nHeight) : CClaimTrieCache(base)
+    {
+        nNextHeight = nHeight;
+    }
+
+    // claims every name (and supports every fourth claim) in a block of its own
+    void addNames(const std::vector<std::string>& names)
+    {
+        for (uint32_t i = 0; i < names.size(); ++i) {
+            auto outPoint = ClaimTrieOutPoint(i);
+            auto claimId = ClaimIdHash(outPoint.hash, outPoint.n);
+            addClaim(names[i], outPoint, claimId, 100 + i % 7, nNextHeight);
+            if (i % 4 == 0)
+                addSupport(names[i], COutPoint(outPoint.hash, 1), 10, claimId, nNextHeight);
+        }
+        insertUndoType insertUndo, insertSupportUndo;
+        claimQueueRowType expireUndo;
+        supportQueueRowType expireSupportUndo;
+        std::vector<std::pair<std::string, int>> takeoverHeightUndo;
+        bool incremented = incrementBlock(insertUndo, expireUndo, insertSupportUndo, expireSupportUndo, takeoverHeightUndo);
+        assert(incremented);
+    }
+
+    // makes the next getMerkleHash hash every cached node again
+    void clearHashes()
+    {
+        for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it)
+            it->hash.SetNull();
+    }
+};
+
+static void PrefixTrieInsert(benchmark::State& state)
+{
+    auto names = ClaimTrieNames();
+    while (state.KeepRunning()) {
+        CPrefixTrie<std::string, CClaimTrieData> trie;
+        for (auto& name : names)
+            trie.insert(name, CClaimTrieData{});
+    }
+}
+
+static void PrefixTrieFind(benchmark::State& state)
+{
+    auto names = ClaimTrieNames();
+    CPrefixTrie<std::string, CClaimTrieData> trie;
+    for (auto& name : names)
+        trie.insert(name, CClaimTrieData{});
+    std::size_t i = 0;
+    while (state.KeepRunning()) {
+        auto it = trie.find(names[i++ % names.size()]);
+        assert(it);
+    }
+}
+
+static void PrefixTrieErase(benchmark::State& state)
+{
+    auto names = ClaimTrieNames();
+    CPrefixTrie<std::string, CClaimTrieData> trie;
+    while (state.KeepRunning()) {
+        for (auto& name : names)
+            trie.insert(name, CClaimTrieData{});
+        for (auto& name : names)
+            trie.erase(name);
+        assert(trie.empty());
+    }
+}
+
+static void PrefixTrieIterate(benchmark::State& state)
+{
+    auto names = ClaimTrieNames();
+    CPrefixTrie<std::string, CClaimTrieData> trie;
+    for (auto& name : names)
+        trie.insert(name, CClaimTrieData{});
+    while (state.KeepRunning()) {
+        uint64_t sum = 0;
+        for (auto it = trie.cbegin(); it != trie.cend(); ++it)
+            sum += it.key().size();
+        assert(sum);
+    }
+}
+
+static void ClaimTrieCacheAddClaim(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    auto names = ClaimTrieNames();
+    CClaimTrie trie(true, false, 1);
+    while (state.KeepRunning()) {
+        CClaimTrieCache cache(&trie);
+        for (uint32_t i = 0; i < names.size(); ++i) {
+            auto outPoint = ClaimTrieOutPoint(i);
+            cache.addClaim(names[i], outPoint, ClaimIdHash(outPoint.hash, outPoint.n), 100, 0);
+        }
+    }
+}
+
+// one block of claims on top of a trie holding every name: connected, hashed and disconnected again
+static void ClaimTrieCacheIncrementDecrementBlock(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    auto names = ClaimTrieNames();
+    CClaimTrie trie(true, false, 1);
+    {
+        CClaimTrieCacheBench cache(&trie, POST_HASH_FORK_HEIGHT);
+        cache.addNames(names);
+        cache.getMerkleHash();
+        bool flushed = cache.flush();
+        assert(flushed);
+    }
+    const uint32_t nBlockClaims = std::min<std::size_t>(names.size(), 100);
+    FastRandomContext rng(true);
+    while (state.KeepRunning()) {
+        CClaimTrieCache cache(&trie);
+        const int nHeight = POST_HASH_FORK_HEIGHT + 1;
+        std::vector<std::pair<std::string, COutPoint>> claims;
+        for (uint32_t i = 0; i < nBlockClaims; ++i) {
+            auto& name = names[rng.randrange(names.size())];
+            COutPoint outPoint(rng.rand256(), 0);
+            cache.addClaim(name, outPoint, ClaimIdHash(outPoint.hash, outPoint.n), 50 + i, nHeight);
+            claims.emplace_back(name, outPoint);
+        }
+        insertUndoType insertUndo, insertSupportUndo;
+        claimQueueRowType expireUndo;
+        supportQueueRowType expireSupportUndo;
+        std::vector<std::pair<std::string, int>> takeoverHeightUndo;
+        bool ok = cache.incrementBlock(insertUndo, expireUndo, insertSupportUndo, expireSupportUndo, takeoverHeightUndo);
+        cache.getMerkleHash();
+        ok = ok && cache.decrementBlock(insertUndo, expireUndo, insertSupportUndo, expireSupportUndo);
+        for (auto& claim : claims)
+            ok = ok && cache.undoAddClaim(claim.first, claim.second, nHeight);
+        ok = ok && cache.finalizeDecrement(takeoverHeightUndo);
+        assert(ok);
+    }
+}
+
+static void ClaimTrieMerkleHash(benchmark::State& state, int nHeight)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    auto names = ClaimTrieNames();
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheBench cache(&trie, nHeight);
+    cache.addNames(names);
+    while (state.KeepRunning()) {
+        cache.clearHashes();
+        cache.getMerkleHash();
+    }
+}
+
+static void ClaimTrieMerkleHashPreFork(benchmark::State& state)
+{
+    ClaimTrieMerkleHash(state, PRE_HASH_FORK_HEIGHT);
+}
+
+static void ClaimTrieMerkleHashPostFork(benchmark::State& state)
+{
+    ClaimTrieMerkleHash(state, POST_HASH_FORK_HEIGHT);
+}
+
+static void ClaimTrieProofForName(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    auto names = ClaimTrieNames();
+    CClaimTrie trie(true, false, 1);
+    {
+        CClaimTrieCacheBench cache(&trie, POST_HASH_FORK_HEIGHT);
+        cache.addNames(names);
+        cache.getMerkleHash();
+        bool flushed = cache.flush();
+        assert(flushed);
+    }
+    CClaimTrieCache cache(&trie);
+    std::size_t i = 0;
+    while (state.KeepRunning()) {
+        CClaimTrieProof proof;
+        bool found = cache.getProofForName(names[i++ % names.size()], proof);
+        assert(found && proof.hasValue);
+    }
+}
+
+static void ClaimTrieNormalizeName(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    auto names = ClaimTrieNames();
+    // a share of the names as they arrive from wallets: mixed case and outside of ASCII
+    for (std::size_t i = 0; i < names.size(); i += 8)
+        names[i] = "Ä" + names[i];
+    for (std::size_t i = 4; i < names.size(); i += 8)
+        names[i][0] = std::toupper(names[i][0]);
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheBench cache(&trie, POST_HASH_FORK_HEIGHT);
+    std::size_t i = 0;
+    while (state.KeepRunning()) {
+        auto normalized = cache.normalizeClaimName(names[i++ % names.size()], true);
+        assert(!normalized.empty());
+    }
+}
+
+static void ClaimTrieDecodeClaimScript(benchmark::State& state)
+{
+    const std::vector<unsigned char> name(10, 'a');
+    const std::vector<unsigned char> value(200, 'v');
+    const uint160 claimId;
+    const std::vector<unsigned char> vchClaimId(claimId.begin(), claimId.end());
+    const CScript p2pkh = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0) << OP_EQUALVERIFY << OP_CHECKSIG;
+    const std::vector<CScript> scripts{
+        (CScript() << OP_CLAIM_NAME << name << value << OP_2DROP << OP_DROP) + p2pkh,
+        (CScript() << OP_UPDATE_CLAIM << name << vchClaimId << value << OP_2DROP << OP_2DROP) + p2pkh,
+        (CScript() << OP_SUPPORT_CLAIM << name << vchClaimId << OP_2DROP << OP_DROP) + p2pkh,
+        p2pkh,
+    };
+    while (state.KeepRunning()) {
+        for (auto& script : scripts) {
+            int op;
+            std::vector<std::vector<unsigned char>> vvchParams;
+            DecodeClaimScript(script, op, vvchParams);
+        }
+    }
+}
+
+BENCHMARK(PrefixTrieInsert, 400);
+BENCHMARK(PrefixTrieFind, 5000000);
+BENCHMARK(PrefixTrieErase, 150);
+BENCHMARK(PrefixTrieIterate, 2000);
+BENCHMARK(ClaimTrieCacheAddClaim, 40);
+BENCHMARK(ClaimTrieCacheIncrementDecrementBlock, 1000);
+BENCHMARK(ClaimTrieMerkleHashPreFork, 40);
+BENCHMARK(ClaimTrieMerkleHashPostFork, 60);
+BENCHMARK(ClaimTrieProofForName, 25000);
+BENCHMARK(ClaimTrieNormalizeName, 700000);
+BENCHMARK(ClaimTrieDecodeClaimScript, 1500000);
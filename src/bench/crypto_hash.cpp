@@ -60,6 +60,41 @@ static void SHA256D64_1024(benchmark::State& state)
     }
 }
 
+static void SHA512_32_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA512_32(in.data(), in.data(), 1024);
+    }
+}
+
+static void RIPEMD160_32_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32 * 1024, 0);
+    while (state.KeepRunning()) {
+        RIPEMD160_32(in.data(), in.data(), 1024);
+    }
+}
+
+static void PoWHash_112b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(112, 0);
+    while (state.KeepRunning()) {
+        auto hash = PoWHash(in.data(), in.size());
+        memcpy(in.data(), hash.begin(), hash.size());
+    }
+}
+
+static void PoWHashes_112b_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(112 * 1024, 0);
+    std::vector<uint256> hashes(1024);
+    while (state.KeepRunning()) {
+        PoWHashes(hashes.data(), in.data(), 112, hashes.size());
+        memcpy(in.data(), hashes[0].begin(), hashes[0].size());
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -103,5 +138,9 @@ BENCHMARK(SHA512, 330);
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(SHA512_32_1024, 1000);
+BENCHMARK(RIPEMD160_32_1024, 2000);
+BENCHMARK(PoWHash_112b, 500 * 1000);
+BENCHMARK(PoWHashes_112b_1024, 500);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
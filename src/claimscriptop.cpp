@@ -204,7 +204,11 @@ void UpdateCache(const CTransaction& tx, CClaimTrieCache& trieCache, const CCoin
         spendClaim.callback = [&spentClaims](const std::string& name, const uint160& claimId) {
             spentClaims.emplace_back(name, claimId);
         };
-        if (ProcessClaim(spendClaim, trieCache, scriptPubKey) && callbacks.claimUndoHeights)
+        if (!ProcessClaim(spendClaim, trieCache, scriptPubKey))
+            continue;
+        if (!coin.out.IsNull())
+            trieCache.addSpentOutput(txin.prevout, coin.out);
+        if (callbacks.claimUndoHeights)
             callbacks.claimUndoHeights(j, nValidAtHeight);
     }
 
@@ -7,6 +7,7 @@
 
 #include "amount.h"
 #include "claimtrie.h"
+#include "coins.h"
 #include "hash.h"
 #include "primitives/transaction.h"
 #include "script/script.h"
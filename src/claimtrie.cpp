@@ -1,13 +1,22 @@
 
+#include <checkqueue.h>
 #include <claimtrie.h>
 #include <coins.h>
+#include <crypto/common.h>
+#include <fs.h>
 #include <hash.h>
 #include <logging.h>
+#include <memusage.h>
 #include <util.h>
 
 #include <algorithm>
 #include <memory>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace bip = boost::interprocess;
+
 extern const uint256 one = uint256S("0000000000000000000000000000000000000000000000000000000000000001");
 
 std::vector<unsigned char> heightToVch(int n)
@@ -20,6 +29,13 @@ std::vector<unsigned char> heightToVch(int n)
     return vchHeight;
 }
 
+uint160 claimIdHexKey(const uint160& claimId)
+{
+    uint160 key;
+    std::reverse_copy(claimId.begin(), claimId.end(), key.begin());
+    return key;
+}
+
 uint256 getValueHash(const COutPoint& outPoint, int nHeightOfLastTakeover)
 {
     CHash256 hasher;
@@ -79,9 +95,20 @@ bool eraseOutPoint(std::vector<T>& cont, const C& point, T* value = nullptr)
     return true;
 }
 
-bool CClaimTrieData::insertClaim(const CClaimValue& claim)
+// claims are ordered from the highest bid down
+static bool higherBid(const CClaimValue& lhs, const CClaimValue& rhs)
+{
+    return rhs < lhs;
+}
+
+bool CClaimTrieData::insertClaim(const CClaimValue& claim, const supportEntryType& supports)
 {
-    claims.push_back(claim);
+    auto value = claim;
+    value.nEffectiveAmount = value.nAmount;
+    for (auto& support : supports)
+        if (support.supportedClaimId == value.claimId)
+            value.nEffectiveAmount += support.nAmount;
+    claims.insert(std::upper_bound(claims.begin(), claims.end(), value, higherBid), std::move(value));
     return true;
 }
 
@@ -112,48 +139,1248 @@ bool CClaimTrieData::haveClaim(const COutPoint& outPoint) const
     return findOutPoint(claims, outPoint) != claims.end();
 }
 
+void CClaimTrieData::addSupportAmount(const uint160& claimId, CAmount nAmount)
+{
+    // only the claims of claimId are out of place, the others stay in order around them
+    claimEntryType moved;
+    for (auto it = claims.begin(); it != claims.end();) {
+        if (it->claimId != claimId) {
+            ++it;
+            continue;
+        }
+        moved.push_back(std::move(*it));
+        it = claims.erase(it);
+    }
+    for (auto& claim : moved) {
+        claim.nEffectiveAmount += nAmount;
+        claims.insert(std::upper_bound(claims.begin(), claims.end(), claim, higherBid), std::move(claim));
+    }
+}
+
 void CClaimTrieData::reorderClaims(const supportEntryType& supports)
 {
+    std::map<uint160, CAmount> supportAmounts;
+    for (const auto& support : supports)
+        supportAmounts[support.supportedClaimId] += support.nAmount;
     for (auto& claim : claims) {
-        claim.nEffectiveAmount = claim.nAmount;
-        for (const auto& support : supports)
-            if (support.supportedClaimId == claim.claimId)
-                claim.nEffectiveAmount += support.nAmount;
+        auto it = supportAmounts.find(claim.claimId);
+        claim.nEffectiveAmount = claim.nAmount + (it != supportAmounts.end() ? it->second : 0);
     }
 
-    std::sort(claims.rbegin(), claims.rend());
+    std::sort(claims.begin(), claims.end(), higherBid);
 }
 
-CClaimTrie::CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor, std::size_t cacheMB)
+CClaimTrie::CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor, std::size_t cacheMB, std::size_t nodeCacheBytes)
 {
     nProportionalDelayFactor = proportionalDelayFactor;
+    nNodeCacheBytes = nodeCacheBytes;
     db.reset(new CDBWrapper(GetDataDir() / "claimtrie", cacheMB * 1024ULL * 1024ULL, fMemory, fWipe, false));
+    imagePath = GetDataDir() / "claimtrie.img";
+    if (fWipe)
+        fs::remove(imagePath);
+
+    // a new database records the history from its first block on
+    const auto historyStartKey = std::make_pair(TRIE_HISTORY_START, std::string());
+    const auto totalsKey = std::make_pair(TRIE_TOTALS, std::string());
+    if (db->IsEmpty()) {
+        db->Write(historyStartKey, 0);
+        db->Write(totalsKey, totals);
+    }
+    int start;
+    if (db->Read(historyStartKey, start))
+        nHistoryStart = start;
+    db->Read(totalsKey, totals);
+    publishReadView();
+}
+
+// a row that is serialized already
+struct CSerializedRow
+{
+    const std::string& row;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write(row.data(), row.size());
+    }
+};
+
+// a row as it is serialized, whatever it holds
+struct CRawRow
+{
+    std::string row;
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        row.resize(s.size());
+        if (!row.empty())
+            s.read(&row[0], row.size());
+    }
+};
+
+// an estimate of what a pending row takes besides its key and value: the map node, the
+// shared_ptr control block and the string headers
+static const std::size_t PENDING_ROW_OVERHEAD = 160;
+
+static std::size_t pendingRowUsage(const pendingRowsType::value_type& row)
+{
+    return row.first.size() + PENDING_ROW_OVERHEAD + (row.second ? row.second->size() : 0);
+}
+
+const std::shared_ptr<const std::string>* CPendingLayer::find(const std::string& key) const
+{
+    for (auto layer = this; layer; layer = layer->below.get()) {
+        auto it = layer->rows.find(key);
+        if (it != layer->rows.end())
+            return &it->second;
+    }
+    return nullptr;
+}
+
+bool CClaimTrie::WritePending(const uint256& hashBlock, bool fSync)
+{
+    LOCK(cs_pending);
+    if (pending->empty() && hashBlock.IsNull())
+        return !fSync || db->Sync();
+
+    // the oldest layer first, a row written again by a newer one replaces it in the batch
+    std::vector<const CPendingLayer*> layers;
+    for (const CPendingLayer* layer = pending.get(); layer; layer = layer->below.get())
+        layers.push_back(layer);
+    CDBBatch batch(*db);
+    std::size_t nRows = 0;
+    for (auto layer = layers.rbegin(); layer != layers.rend(); ++layer) {
+        for (auto& row : (*layer)->rows) {
+            if (row.second)
+                batch.Write(CSerializedRow{row.first}, CSerializedRow{*row.second});
+            else
+                batch.Erase(CSerializedRow{row.first});
+        }
+        nRows += (*layer)->rows.size();
+    }
+    const auto bestBlockKey = std::make_pair(TRIE_BEST_BLOCK, std::string());
+    if (hashBlock.IsNull())
+        batch.Erase(bestBlockKey);
+    else
+        batch.Write(bestBlockKey, hashBlock);
+
+    LogPrint(BCLog::CLAIMS, "Writing %zu claim trie rows (%zu bytes) for block %s\n", nRows, batch.SizeEstimate(), hashBlock.ToString());
+    if (!db->WriteBatch(batch, fSync))
+        return false;
+    // the read views that share the rows still see db as it was when they were made
+    pending = std::make_shared<CPendingLayer>();
+    nPendingUsage = 0;
+    return true;
+}
+
+std::size_t CClaimTrie::PendingMemoryUsage() const
+{
+    return nPendingUsage;
+}
+
+bool CClaimTrie::GetBestBlock(uint256& hashBlock) const
+{
+    return rows().Read(std::make_pair(TRIE_BEST_BLOCK, std::string()), hashBlock);
+}
+
+void CClaimTrie::applyPending(pendingRowsType&& rows, int nNewNextHeight)
+{
+    LOCK(cs_pending);
+    nNextHeight = nNewNextHeight;
+    readView.reset();
+    {
+        LOCK(cs_queueWindows);
+        for (auto& row : rows) {
+            // the key of a height keyed queue row is its type and a CQueueHeight
+            auto window = row.first.size() == 5 ? queueWindows.find(row.first[0]) : queueWindows.end();
+            if (window == queueWindows.end())
+                continue;
+            int nHeight = int(ReadBE32((const unsigned char*)row.first.data() + 1));
+            if (nHeight >= window->second.nBegin && nHeight < window->second.nEnd)
+                window->second.rows[nHeight] = row.second;
+        }
+    }
+    if (!pending.unique()) {
+        auto layer = std::make_shared<CPendingLayer>();
+        layer->below = std::move(pending);
+        pending = std::move(layer);
+    }
+    for (auto& row : rows) {
+        auto it = pending->rows.find(row.first);
+        if (it == pending->rows.end()) {
+            it = pending->rows.emplace(row.first, nullptr).first;
+            pending->nUsage += row.first.size() + PENDING_ROW_OVERHEAD;
+        } else if (it->second) {
+            pending->nUsage -= it->second->size();
+        }
+        if (row.second)
+            pending->nUsage += row.second->size();
+        it->second = std::move(row.second);
+    }
+
+    // A layer takes in the one below it once it has half as many rows: that keeps the layers
+    // a read goes through to a few, and each row is copied only a few times on its way down.
+    while (pending->below && pending->below->rows.size() <= 2 * pending->rows.size()) {
+        auto below = pending->below;
+        for (auto& row : below->rows)
+            if (pending->rows.insert(row).second)
+                pending->nUsage += pendingRowUsage(row);
+        pending->below = below->below;
+    }
+    nPendingUsage = 0;
+    for (const CPendingLayer* layer = pending.get(); layer; layer = layer->below.get())
+        nPendingUsage += layer->nUsage;
+}
+
+CPendingRows<CDBWrapper> CClaimTrie::rows() const
+{
+    return {*db, *pending};
+}
+
+bool CClaimTrie::readQueueWindow(uint8_t dbkey, int nHeight, std::string& row) const
+{
+    CRawRow value;
+    if (nHeight < nNextHeight || nHeight >= nNextHeight + QUEUE_WINDOW_HEIGHTS) {
+        if (!rows().Read(std::make_pair(dbkey, CQueueHeight(nHeight)), value))
+            return false;
+        row = std::move(value.row);
+        return true;
+    }
+
+    LOCK(cs_queueWindows);
+    auto& window = queueWindows[dbkey];
+    if (nHeight < window.nBegin || nHeight >= window.nEnd) {
+        window.rows.clear();
+        window.nBegin = window.nEnd = nNextHeight;
+        std::unique_ptr<CPendingRowsIterator> pcursor(rows().NewIterator());
+        for (pcursor->Seek(std::make_pair(dbkey, CQueueHeight(nNextHeight))); pcursor->Valid(); pcursor->Next()) {
+            std::pair<uint8_t, CQueueHeight> key;
+            if (!pcursor->GetKey(key) || key.first != dbkey || key.second.nHeight >= nNextHeight + QUEUE_WINDOW_HEIGHTS)
+                break;
+            if (!pcursor->GetValue(value))
+                return error("%s(): error reading the queue row at %d", __func__, key.second.nHeight);
+            window.rows[key.second.nHeight] = std::make_shared<const std::string>(std::move(value.row));
+        }
+        window.nEnd = nNextHeight + QUEUE_WINDOW_HEIGHTS;
+    }
+    auto it = window.rows.find(nHeight);
+    if (it == window.rows.end() || !it->second)
+        return false;
+    row = *it->second;
+    return true;
+}
+
+void CClaimTrie::clearQueueWindows()
+{
+    LOCK(cs_queueWindows);
+    queueWindows.clear();
+}
+
+CPendingRowsIterator::CPendingRowsIterator(CDBIterator* piter, const CPendingLayer& pending) : piter(piter)
+{
+    for (auto layer = &pending; layer; layer = layer->below.get())
+        layers.emplace_back(&layer->rows, layer->rows.end());
+}
+
+bool CPendingRowsIterator::Valid() const
+{
+    return fPending || piter->Valid();
+}
+
+void CPendingRowsIterator::SeekToFirst()
+{
+    piter->SeekToFirst();
+    for (auto& layer : layers)
+        layer.second = layer.first->begin();
+    settle();
+}
+
+void CPendingRowsIterator::Next()
+{
+    if (fPending)
+        ++layers[nLayer].second;
+    else
+        piter->Next();
+    settle();
+}
+
+void CPendingRowsIterator::settle()
+{
+    for (;;) {
+        // the lowest key of the layers, from the newest one that has it
+        fPending = false;
+        for (std::size_t i = 0; i < layers.size(); ++i) {
+            auto& layer = layers[i];
+            if (layer.second != layer.first->end() && (!fPending || layer.second->first < layers[nLayer].second->first)) {
+                nLayer = i;
+                fPending = true;
+            }
+        }
+        if (!fPending)
+            return;
+        auto& pit = layers[nLayer].second;
+        for (std::size_t i = nLayer + 1; i < layers.size(); ++i) {
+            auto& layer = layers[i];
+            if (layer.second != layer.first->end() && layer.second->first == pit->first)
+                ++layer.second; // replaced or erased by the newer row
+        }
+        int cmp = piter->Valid() ? piter->CompareKey(pit->first) : 1;
+        if (cmp < 0) {
+            fPending = false;
+            return;
+        }
+        if (cmp == 0)
+            piter->Next(); // replaced or erased by the pending row
+        if (pit->second)
+            return;
+        ++pit;
+    }
+}
+
+bool CClaimTrie::WriteCleanShutdown()
+{
+    if (!db || !fVerified)
+        return false;
+    {
+        LOCK(cs_pending);
+        if (!pending->empty())
+            return false;
+    }
+    auto it = find(std::string());
+    auto marker = std::make_pair(it ? it->hash : one, nNextHeight - 1);
+    // the marker is still worth writing without the image, it spares the re-hash
+    WriteImage(marker.first, marker.second);
+    return db->Write(std::make_pair(TRIE_CLEAN_SHUTDOWN, std::string()), marker, true);
+}
+
+// claimtrie.img is a header followed by the node records (first edge, edge count,
+// flags, hash), the edge records (label offset, label length) and the labels.
+// Integers are little endian; the checksum covers everything after the header.
+static const char TRIE_IMAGE_MAGIC[8] = {'l', 'b', 'r', 'y', 't', 'r', 'i', 'e'};
+static const uint32_t TRIE_IMAGE_VERSION = 1;
+static const std::size_t TRIE_IMAGE_HEADER_SIZE = 92;
+static const std::size_t TRIE_IMAGE_NODE_SIZE = 44;
+static const std::size_t TRIE_IMAGE_EDGE_SIZE = 8;
+static const uint32_t TRIE_IMAGE_NODE_HAS_CLAIMS = 1;
+
+bool CClaimTrie::WriteImage(const uint256& hash, int height) const
+{
+    std::vector<FlatNode> nodes;
+    std::vector<FlatEdge> edges;
+    std::string labels;
+    std::vector<std::shared_ptr<CClaimTrieData>> data;
+    flatten(nodes, edges, labels, data);
+
+    std::vector<unsigned char> image(TRIE_IMAGE_HEADER_SIZE + nodes.size() * TRIE_IMAGE_NODE_SIZE + edges.size() * TRIE_IMAGE_EDGE_SIZE + labels.size());
+    auto pos = image.data() + TRIE_IMAGE_HEADER_SIZE;
+    for (std::size_t i = 0; i < nodes.size(); ++i, pos += TRIE_IMAGE_NODE_SIZE) {
+        WriteLE32(pos, nodes[i].edges);
+        WriteLE32(pos + 4, nodes[i].count);
+        WriteLE32(pos + 8, data[i]->empty() ? 0 : TRIE_IMAGE_NODE_HAS_CLAIMS);
+        std::copy(data[i]->hash.begin(), data[i]->hash.end(), pos + 12);
+    }
+    for (std::size_t i = 0; i < edges.size(); ++i, pos += TRIE_IMAGE_EDGE_SIZE) {
+        WriteLE32(pos, edges[i].offset);
+        WriteLE32(pos + 4, edges[i].length);
+    }
+    std::copy(labels.begin(), labels.end(), pos);
+
+    std::copy(TRIE_IMAGE_MAGIC, TRIE_IMAGE_MAGIC + 8, image.begin());
+    WriteLE32(&image[8], TRIE_IMAGE_VERSION);
+    WriteLE32(&image[12], uint32_t(height));
+    std::copy(hash.begin(), hash.end(), &image[16]);
+    WriteLE32(&image[48], nodes.size());
+    WriteLE32(&image[52], edges.size());
+    WriteLE32(&image[56], labels.size());
+    auto checksum = Hash(image.begin() + TRIE_IMAGE_HEADER_SIZE, image.end());
+    std::copy(checksum.begin(), checksum.end(), &image[60]);
+
+    // written aside and renamed, so a crash never leaves a partial image behind
+    auto tmpPath = imagePath;
+    tmpPath += ".new";
+    FILE* file = fsbridge::fopen(tmpPath, "wb");
+    if (!file)
+        return error("%s(): error opening %s", __func__, tmpPath.string());
+    bool fWritten = fwrite(image.data(), 1, image.size(), file) == image.size() && FileCommit(file);
+    fclose(file);
+    if (!fWritten || !RenameOver(tmpPath, imagePath)) {
+        fs::remove(tmpPath);
+        return error("%s(): error writing %s", __func__, imagePath.string());
+    }
+    LogPrintf("Wrote the claim trie image of %u nodes at height %d\n", nodes.size(), height);
+    return true;
+}
+
+bool CClaimTrie::ReadImage(const uint256& hash, int height)
+{
+    if (!fs::exists(imagePath))
+        return false;
+
+    std::vector<FlatNode> nodes;
+    std::vector<FlatEdge> edges;
+    std::string labels;
+    std::vector<std::shared_ptr<CClaimTrieData>> data;
+    std::string strError;
+    try {
+        bip::file_mapping mapping(imagePath.string().c_str(), bip::read_only);
+        bip::mapped_region region(mapping, bip::read_only);
+        auto image = static_cast<const unsigned char*>(region.get_address());
+        auto size = region.get_size();
+
+        uint64_t nodeCount = 0, edgeCount = 0, labelSize = 0;
+        if (size >= TRIE_IMAGE_HEADER_SIZE) {
+            nodeCount = ReadLE32(image + 48);
+            edgeCount = ReadLE32(image + 52);
+            labelSize = ReadLE32(image + 56);
+        }
+        if (size < TRIE_IMAGE_HEADER_SIZE || !std::equal(TRIE_IMAGE_MAGIC, TRIE_IMAGE_MAGIC + 8, image))
+            strError = "not a claim trie image";
+        else if (ReadLE32(image + 8) != TRIE_IMAGE_VERSION)
+            strError = strprintf("unknown version %u", ReadLE32(image + 8));
+        else if (ReadLE32(image + 12) != uint32_t(height) || !std::equal(hash.begin(), hash.end(), image + 16))
+            strError = "written for another tip";
+        else if (size != TRIE_IMAGE_HEADER_SIZE + nodeCount * TRIE_IMAGE_NODE_SIZE + edgeCount * TRIE_IMAGE_EDGE_SIZE + labelSize)
+            strError = "truncated";
+        else if (Hash(image + TRIE_IMAGE_HEADER_SIZE, image + size) != uint256(std::vector<unsigned char>(image + 60, image + 92)))
+            strError = "checksum mismatch";
+
+        if (strError.empty()) {
+            auto pos = image + TRIE_IMAGE_HEADER_SIZE;
+            nodes.reserve(nodeCount);
+            data.reserve(nodeCount);
+            for (uint64_t i = 0; i < nodeCount; ++i, pos += TRIE_IMAGE_NODE_SIZE) {
+                nodes.push_back(FlatNode{ReadLE32(pos), ReadLE32(pos + 4)});
+                // the claims are read on first access (see pageIn)
+                auto node = std::make_shared<CClaimTrieData>();
+                node->fPagedOut = ReadLE32(pos + 8) & TRIE_IMAGE_NODE_HAS_CLAIMS;
+                node->hash = uint256(std::vector<unsigned char>(pos + 12, pos + 44));
+                data.push_back(std::move(node));
+            }
+            edges.reserve(edgeCount);
+            for (uint64_t i = 0; i < edgeCount; ++i, pos += TRIE_IMAGE_EDGE_SIZE)
+                edges.push_back(FlatEdge{ReadLE32(pos), ReadLE32(pos + 4)});
+            labels.assign(pos, pos + labelSize);
+        }
+    } catch (const bip::interprocess_exception& e) {
+        strError = e.what();
+    }
+
+    // like the clean shutdown marker, an image is only good for one start
+    fs::remove(imagePath);
+    if (strError.empty() && !unflatten(nodes, edges, labels, data))
+        strError = "malformed trie";
+    if (!strError.empty())
+        return error("%s(): ignoring %s: %s", __func__, imagePath.string(), strError);
+    return true;
+}
+
+// A snapshot is a header (magic, version, height and block hash), the rows as pairs of
+// serialized strings ended by an empty key, and the double SHA256 of everything before it.
+static const char TRIE_SNAPSHOT_MAGIC[8] = {'l', 'b', 'r', 'y', 's', 'n', 'a', 'p'};
+static const uint32_t TRIE_SNAPSHOT_VERSION = 2;
+// the name history isn't part of it, it starts over at the snapshot (see buildNameHistory)
+static const std::string TRIE_SNAPSHOT_ROWS = {TRIE_NODE, CLAIM_BY_ID, CLAIM_BY_ID_HEX, CLAIM_QUEUE_ROW, CLAIM_QUEUE_NAME_ROW,
+    CLAIM_EXP_QUEUE_ROW, SUPPORT, SUPPORT_QUEUE_ROW, SUPPORT_QUEUE_NAME_ROW, SUPPORT_EXP_QUEUE_ROW, TRIE_TOTALS};
+// version 1 had the queue rows keyed by a little endian height, ReadFromDisk upgrades them
+static const std::string TRIE_SNAPSHOT_ROWS_V1 = {TRIE_NODE, CLAIM_BY_ID, CLAIM_BY_ID_HEX, CLAIM_QUEUE_ROW_LE, CLAIM_QUEUE_NAME_ROW,
+    CLAIM_EXP_QUEUE_ROW_LE, SUPPORT, SUPPORT_QUEUE_ROW_LE, SUPPORT_QUEUE_NAME_ROW, SUPPORT_EXP_QUEUE_ROW_LE, TRIE_TOTALS};
+static const std::size_t TRIE_SNAPSHOT_BATCH_SIZE = 1 << 24;
+
+bool CClaimTrieReadView::writeSnapshot(const fs::path& path, const uint256& hashBlock, uint64_t& nRows) const
+{
+    // like dumpwallet, never overwrites a file
+    if (fs::exists(path))
+        return error("%s(): %s already exists", __func__, path.string());
+
+    // written aside and renamed, so a crash never leaves a partial snapshot behind
+    auto tmpPath = path;
+    tmpPath += ".new";
+    CAutoFile file(fsbridge::fopen(tmpPath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s(): can't open %s", __func__, tmpPath.string());
+
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    auto writeOut = [&]() {
+        hasher.write(ss.data(), ss.size());
+        file.write(ss.data(), ss.size());
+        ss.clear();
+    };
+    nRows = 0;
+    try {
+        ss.write(TRIE_SNAPSHOT_MAGIC, sizeof(TRIE_SNAPSHOT_MAGIC));
+        ss << TRIE_SNAPSHOT_VERSION << nNextHeight - 1 << hashBlock;
+        writeOut();
+
+        std::unique_ptr<CPendingRowsIterator> pcursor(rows().NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            CRawRow key, value;
+            if (!pcursor->GetKey(key) || key.row.empty() || TRIE_SNAPSHOT_ROWS.find(key.row[0]) == std::string::npos)
+                continue;
+            if (!pcursor->GetValue(value))
+                return error("%s(): error reading the claim trie", __func__);
+            ss << key.row << value.row;
+            if (ss.size() > (1 << 20))
+                writeOut();
+            ++nRows;
+        }
+        ss << std::string();
+        writeOut();
+        file << hasher.GetHash();
+    } catch (const std::exception& e) {
+        file.fclose();
+        fs::remove(tmpPath);
+        return error("%s(): error writing %s: %s", __func__, tmpPath.string(), e.what());
+    }
+
+    if (!FileCommit(file.Get()) || (file.fclose(), !RenameOver(tmpPath, path))) {
+        fs::remove(tmpPath);
+        return error("%s(): error writing %s", __func__, path.string());
+    }
+    LogPrintf("Wrote a claim trie snapshot of %u rows at height %d to %s\n", nRows, nNextHeight - 1, path.string());
+    return true;
+}
+
+// erases every row of db, in batches of about TRIE_SNAPSHOT_BATCH_SIZE
+static bool eraseAllRows(CDBWrapper& db)
+{
+    CDBBatch batch(db);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        CRawRow key;
+        if (!pcursor->GetKey(key))
+            return false;
+        batch.Erase(CSerializedRow{key.row});
+        if (batch.SizeEstimate() > TRIE_SNAPSHOT_BATCH_SIZE) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+    return db.WriteBatch(batch, true);
+}
+
+// Reads the header of the snapshot in file; the rest of it is for readSnapshotRows.
+static uint32_t readSnapshotHeader(CHashVerifier<CAutoFile>& verifier, uint256& hashBlock, int& nHeight)
+{
+    char magic[sizeof(TRIE_SNAPSHOT_MAGIC)];
+    uint32_t nVersion;
+    verifier.read(magic, sizeof(magic));
+    if (!std::equal(magic, magic + sizeof(magic), TRIE_SNAPSHOT_MAGIC))
+        throw std::runtime_error("not a claim trie snapshot");
+    verifier >> nVersion >> nHeight >> hashBlock;
+    if (nVersion < 1 || nVersion > TRIE_SNAPSHOT_VERSION)
+        throw std::runtime_error(strprintf("unknown version %u", nVersion));
+    return nVersion;
+}
+
+// Passes the rows of the snapshot at path to write and checks the checksum after the last one;
+// throws at the first thing that's wrong with it.
+static void readSnapshotRows(const fs::path& path, const uint256& hashBlock, int& nHeight, uint64_t& nRows,
+    const std::function<void(const std::string&, const std::string&)>& write)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        throw std::runtime_error("can't open it");
+
+    CHashVerifier<CAutoFile> verifier(&file);
+    uint256 hashSnapshot;
+    const auto& rowTypes = readSnapshotHeader(verifier, hashSnapshot, nHeight) == 1 ? TRIE_SNAPSHOT_ROWS_V1 : TRIE_SNAPSHOT_ROWS;
+    if (hashSnapshot != hashBlock)
+        throw std::runtime_error(strprintf("it is of block %s rather than %s", hashSnapshot.ToString(), hashBlock.ToString()));
+
+    nRows = 0;
+    for (std::string key, value; verifier >> key, !key.empty(); ++nRows) {
+        if (rowTypes.find(key[0]) == std::string::npos)
+            throw std::runtime_error("unexpected row");
+        verifier >> value;
+        write(key, value);
+    }
+    uint256 checksum;
+    file >> checksum;
+    if (checksum != verifier.GetHash())
+        throw std::runtime_error("checksum mismatch");
+}
+
+bool CClaimTrie::ReadSnapshotBlock(const fs::path& path, uint256& hashBlock, int& nHeight)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s(): can't open %s", __func__, path.string());
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        readSnapshotHeader(verifier, hashBlock, nHeight);
+    } catch (const std::exception& e) {
+        return error("%s(): error reading %s: %s", __func__, path.string(), e.what());
+    }
+    return true;
+}
+
+bool CClaimTrie::LoadSnapshot(const fs::path& path, const uint256& hashBlock)
+{
+    LogPrintf("Loading the claim trie snapshot %s...\n", path.string());
+    int nHeight = -1;
+    uint64_t nRows = 0;
+    // the whole file is read once to check it before the trie it replaces is erased
+    try {
+        readSnapshotRows(path, hashBlock, nHeight, nRows, [](const std::string&, const std::string&) {});
+    } catch (const std::exception& e) {
+        return error("%s(): error loading %s: %s", __func__, path.string(), e.what());
+    }
+
+    LOCK(cs_pending);
+    // whatever wasn't written yet is of the trie being replaced
+    pending = std::make_shared<CPendingLayer>();
+    nPendingUsage = 0;
+    if (!eraseAllRows(*db))
+        return error("%s(): error erasing the claim trie", __func__);
+
+    std::string strError;
+    try {
+        CDBBatch batch(*db);
+        readSnapshotRows(path, hashBlock, nHeight, nRows, [this, &batch](const std::string& key, const std::string& value) {
+            batch.Write(CSerializedRow{key}, CSerializedRow{value});
+            if (batch.SizeEstimate() > TRIE_SNAPSHOT_BATCH_SIZE) {
+                if (!db->WriteBatch(batch))
+                    throw std::runtime_error("error writing the claim trie");
+                batch.Clear();
+            }
+        });
+        batch.Write(std::make_pair(TRIE_BEST_BLOCK, std::string()), hashBlock);
+        if (!db->WriteBatch(batch, true))
+            throw std::runtime_error("error writing the claim trie");
+    } catch (const std::exception& e) {
+        strError = e.what();
+    }
+
+    if (!strError.empty()) {
+        // what made it in is no trie at all
+        eraseAllRows(*db);
+        return error("%s(): error loading %s: %s", __func__, path.string(), strError);
+    }
+    nHistoryStart = -1;
+    readView.reset();
+    clearQueueWindows();
+    fs::remove(imagePath);
+    LogPrintf("Loaded %u claim trie rows of height %d\n", nRows, nHeight);
+    return true;
+}
+
+bool CClaimTrie::Wipe()
+{
+    LOCK(cs_pending);
+    pending = std::make_shared<CPendingLayer>();
+    nPendingUsage = 0;
+    if (!eraseAllRows(*db))
+        return error("%s(): error erasing the claim trie", __func__);
+
+    // as a new database, see the constructor
+    clear();
+    nNextHeight = 0;
+    totals = CClaimTrieTotals();
+    CDBBatch batch(*db);
+    batch.Write(std::make_pair(TRIE_HISTORY_START, std::string()), 0);
+    batch.Write(std::make_pair(TRIE_TOTALS, std::string()), totals);
+    if (!db->WriteBatch(batch, true))
+        return error("%s(): error writing the claim trie", __func__);
+    nHistoryStart = 0;
+    fVerified = false;
+    readView.reset();
+    clearQueueWindows();
+    fs::remove(imagePath);
+    return true;
+}
+
+bool CClaimTrie::BuildClaimIdHexIndex()
+{
+    // the null id is never a claim's, its row marks a complete index
+    const auto doneKey = std::make_pair(CLAIM_BY_ID_HEX, uint160());
+    if (db->Exists(doneKey))
+        return true;
+
+    LogPrintf("Building the claim id prefix index...\n");
+    CDBBatch batch(*db);
+    std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+    for (pcursor->Seek(std::make_pair(CLAIM_BY_ID, uint160())); pcursor->Valid(); pcursor->Next()) {
+        std::pair<uint8_t, uint160> key;
+        if (!pcursor->GetKey(key) || key.first != CLAIM_BY_ID)
+            break;
+        CClaimIndexElement element;
+        if (!pcursor->GetValue(element))
+            return error("%s(): error reading the claim id index", __func__);
+        batch.Write(std::make_pair(CLAIM_BY_ID_HEX, claimIdHexKey(key.second)), element.name);
+        if (batch.SizeEstimate() > (1 << 24)) {
+            if (!db->WriteBatch(batch))
+                return error("%s(): error writing the claim id prefix index", __func__);
+            batch.Clear();
+        }
+    }
+    batch.Write(doneKey, std::string());
+    return db->WriteBatch(batch, true);
+}
+
+bool CClaimTrie::UpgradeQueueRows()
+{
+    // the old and the new row are in the same batch, an upgrade cut short carries on where it stopped
+    bool fFound = false;
+    CDBBatch batch(*db);
+    for (auto dbkey : {std::make_pair(CLAIM_QUEUE_ROW_LE, CLAIM_QUEUE_ROW), std::make_pair(CLAIM_EXP_QUEUE_ROW_LE, CLAIM_EXP_QUEUE_ROW),
+             std::make_pair(SUPPORT_QUEUE_ROW_LE, SUPPORT_QUEUE_ROW), std::make_pair(SUPPORT_EXP_QUEUE_ROW_LE, SUPPORT_EXP_QUEUE_ROW)}) {
+        std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+        for (pcursor->Seek(std::make_pair(dbkey.first, 0)); pcursor->Valid(); pcursor->Next()) {
+            std::pair<uint8_t, int> key;
+            if (!pcursor->GetKey(key) || key.first != dbkey.first)
+                break;
+            if (!fFound) {
+                LogPrintf("Upgrading the claim trie queue rows...\n");
+                fFound = true;
+            }
+            CRawRow value;
+            if (!pcursor->GetValue(value))
+                return error("%s(): error reading the queue rows", __func__);
+            batch.Write(std::make_pair(dbkey.second, CQueueHeight(key.second)), CSerializedRow{value.row});
+            batch.Erase(key);
+            if (batch.SizeEstimate() > (1 << 24)) {
+                if (!db->WriteBatch(batch))
+                    return error("%s(): error writing the queue rows", __func__);
+                batch.Clear();
+            }
+        }
+    }
+    clearQueueWindows();
+    return !fFound || db->WriteBatch(batch, true);
+}
+
+// the hash of a TRIE_NODE row and whether claims follow it, without reading them
+struct CTrieNodeHash
+{
+    uint256 hash;
+    bool fEmpty = true;
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> hash;
+        fEmpty = s.empty();
+    }
+};
+
+typedef std::pair<uint8_t, std::pair<std::string, CHistoryHeight>> historyKeyType;
+
+static historyKeyType historyKey(const std::string& name, int nHeight)
+{
+    return std::make_pair(TRIE_NAME_HISTORY, std::make_pair(name, CHistoryHeight(nHeight)));
+}
+
+// how a vector differs from the one before: the elements between those kept at either end were replaced
+template <typename T>
+struct CVectorDelta
+{
+    uint32_t nFront = 0;
+    uint32_t nBack = 0;
+    std::vector<T> middle;
+
+    CVectorDelta() = default;
+    CVectorDelta(const std::vector<T>& from, const std::vector<T>& to)
+    {
+        const uint32_t nSize = std::min(from.size(), to.size());
+        while (nFront < nSize && from[nFront] == to[nFront])
+            ++nFront;
+        while (nFront + nBack < nSize && from[from.size() - 1 - nBack] == to[to.size() - 1 - nBack])
+            ++nBack;
+        middle.assign(to.begin() + nFront, to.end() - nBack);
+    }
+
+    bool apply(std::vector<T>& v) const
+    {
+        if (uint64_t(nFront) + nBack > v.size())
+            return false;
+        v.erase(v.begin() + nFront, v.end() - nBack);
+        v.insert(v.begin() + nFront, middle.begin(), middle.end());
+        return true;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(VARINT(nFront));
+        READWRITE(VARINT(nBack));
+        READWRITE(middle);
+    }
+};
+
+// a name history row has the whole state at least every HISTORY_FULL_ROW_INTERVAL rows of the name
+static const uint8_t HISTORY_FULL_ROW_INTERVAL = 16;
+
+/**
+ * A TRIE_NAME_HISTORY row: the state of the name, or how it differs from that of the row before
+ * it. Only nDeltas (the rows back to the last whole state) tells them apart.
+ */
+struct CNameHistoryRow
+{
+    uint8_t nDeltas = 0;
+    CClaimNameState state; // of a full row
+    int nHeightOfLastTakeover = 0;
+    CVectorDelta<CClaimValue> claims;
+    CVectorDelta<CSupportValue> supports;
+    CVectorDelta<CClaimValue> queuedClaims;
+    CVectorDelta<CSupportValue> queuedSupports;
+
+    CNameHistoryRow() = default;
+    explicit CNameHistoryRow(CClaimNameState state) : state(std::move(state))
+    {
+    }
+
+    CNameHistoryRow(const CClaimNameState& from, const CClaimNameState& to, uint8_t nDeltas)
+        : nDeltas(nDeltas), nHeightOfLastTakeover(to.nHeightOfLastTakeover), claims(from.claims, to.claims),
+          supports(from.supports, to.supports), queuedClaims(from.queuedClaims, to.queuedClaims),
+          queuedSupports(from.queuedSupports, to.queuedSupports)
+    {
+    }
+
+    // the state of a delta row out of that of the row before it
+    bool apply(CClaimNameState& previous) const
+    {
+        previous.nHeightOfLastTakeover = nHeightOfLastTakeover;
+        return claims.apply(previous.claims) && supports.apply(previous.supports)
+            && queuedClaims.apply(previous.queuedClaims) && queuedSupports.apply(previous.queuedSupports);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << nDeltas;
+        if (nDeltas == 0)
+            s << state;
+        else
+            s << nHeightOfLastTakeover << claims << supports << queuedClaims << queuedSupports;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> nDeltas;
+        if (nDeltas == 0)
+            s >> state;
+        else
+            s >> nHeightOfLastTakeover >> claims >> supports >> queuedClaims >> queuedSupports;
+    }
+};
+
+// Reads the state of the name history row of name that pcursor is at, going on to the older
+// rows of the name down to the last full one when it's a delta. nDeltas is that of the row.
+static bool readHistoryRow(CPendingRowsIterator& cursor, const std::string& name, CClaimNameState& state, uint8_t& nDeltas)
+{
+    std::vector<CNameHistoryRow> deltas;
+    for (;; cursor.Next()) {
+        historyKeyType key;
+        CNameHistoryRow row;
+        if (!cursor.Valid() || !cursor.GetKey(key) || key.first != TRIE_NAME_HISTORY || key.second.first != name || !cursor.GetValue(row))
+            return false;
+        if (deltas.empty())
+            nDeltas = row.nDeltas;
+        if (row.nDeltas == 0) {
+            state = std::move(row.state);
+            break;
+        }
+        deltas.push_back(std::move(row));
+    }
+    for (auto it = deltas.rbegin(); it != deltas.rend(); ++it)
+        if (!it->apply(state))
+            return false;
+    return true;
+}
+
+// pnDeltas, when given, is set to those of the row in effect, 0 when there is none
+template <typename DB>
+static bool readNameStateAt(const CPendingRows<DB>& rows, int nHistoryStart, const std::string& name, int nHeight, CClaimNameState& state, uint8_t* pnDeltas = nullptr)
+{
+    if (nHistoryStart < 0 || nHeight < nHistoryStart - 1)
+        return false;
+
+    state = {};
+    uint8_t nDeltas = 0;
+    std::unique_ptr<CPendingRowsIterator> pcursor(rows.NewIterator());
+    pcursor->Seek(historyKey(name, nHeight));
+    historyKeyType key;
+    if (pcursor->Valid() && pcursor->GetKey(key) && key.first == TRIE_NAME_HISTORY && key.second.first == name
+        && !readHistoryRow(*pcursor, name, state, nDeltas))
+        return error("%s(): error reading the history of %s", __func__, name);
+    // a name without a row had nothing then
+    if (pnDeltas)
+        *pnDeltas = nDeltas;
+    return true;
+}
+
+bool CClaimTrie::UpgradeNameHistory()
+{
+    // the rows were the state itself, that of a full row follows its nDeltas of 0 (see CNameHistoryRow)
+    bool fFound = false;
+    CDBBatch batch(*db);
+    std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+    for (pcursor->Seek(std::make_pair(TRIE_NAME_HISTORY_V1, std::string())); pcursor->Valid(); pcursor->Next()) {
+        historyKeyType key;
+        if (!pcursor->GetKey(key) || key.first != TRIE_NAME_HISTORY_V1)
+            break;
+        if (!fFound) {
+            LogPrintf("Upgrading the claim trie history...\n");
+            fFound = true;
+        }
+        CRawRow value;
+        if (!pcursor->GetValue(value))
+            return error("%s(): error reading the claim trie history", __func__);
+        batch.Write(historyKey(key.second.first, key.second.second.nHeight), std::make_pair(uint8_t(0), CSerializedRow{value.row}));
+        batch.Erase(key);
+        if (batch.SizeEstimate() > (1 << 24)) {
+            if (!db->WriteBatch(batch))
+                return error("%s(): error writing the claim trie history", __func__);
+            batch.Clear();
+        }
+    }
+    return !fFound || db->WriteBatch(batch, true);
+}
+
+bool CClaimTrie::getNameStateAt(const std::string& name, int nHeight, CClaimNameState& state) const
+{
+    return readNameStateAt(rows(), nHistoryStart, name, nHeight, state);
+}
+
+CClaimTrieReadView::CClaimTrieReadView(const CDBWrapper& db, std::shared_ptr<const CPendingLayer> pending, int nNextHeight, int nHistoryStart)
+    : nNextHeight(nNextHeight), snapshot(db), pending(std::move(pending)), nHistoryStart(nHistoryStart)
+{
+}
+
+CPendingRows<CDBSnapshot> CClaimTrieReadView::rows() const
+{
+    return {snapshot, *pending};
+}
+
+bool CClaimTrieReadView::getNameStateAt(const std::string& name, int nHeight, CClaimNameState& state) const
+{
+    return readNameStateAt(rows(), nHistoryStart, name, nHeight, state);
+}
+
+bool CClaimTrieReadView::getSpentOutput(const COutPoint& outPoint, CTxOut& txout) const
+{
+    return rows().Read(std::make_pair(TRIE_SPENT_OUTPUT, outPoint), txout);
+}
+
+// the order of the rows keyed by a name: that of the serialized string, the shorter names first
+static bool rowNameBefore(const std::string& lhs, const std::string& rhs)
+{
+    return lhs.size() != rhs.size() ? lhs.size() < rhs.size() : lhs < rhs;
+}
+
+bool CClaimTrieReadView::iterateNamesAt(int nHeight, const std::function<void(const std::string&, const CClaimNameState&)>& callback) const
+{
+    // the block of the view itself needs no history
+    const bool fTip = nHeight == nNextHeight - 1;
+    if (!fTip && (nHistoryStart < 0 || nHeight < nHistoryStart - 1))
+        return false;
+
+    auto rows = this->rows();
+    if (!fTip) {
+        // a name that had something at nHeight has a history row in effect there, the oldest
+        // rows of the names being kept for that (see buildNameHistory and pruneNameHistory)
+        std::unique_ptr<CPendingRowsIterator> pcursor(rows.NewIterator());
+        pcursor->Seek(std::make_pair(TRIE_NAME_HISTORY, std::string()));
+        for (historyKeyType key; pcursor->Valid() && pcursor->GetKey(key) && key.first == TRIE_NAME_HISTORY;) {
+            const auto name = std::move(key.second.first);
+            pcursor->Seek(historyKey(name, nHeight));
+            CClaimNameState state;
+            uint8_t nDeltas;
+            if (pcursor->Valid() && pcursor->GetKey(key) && key.first == TRIE_NAME_HISTORY && key.second.first == name) {
+                if (!readHistoryRow(*pcursor, name, state, nDeltas))
+                    return error("%s(): error reading the history of %s", __func__, name);
+                if (!state.empty())
+                    callback(name, state);
+            }
+            // on to the next name, past the row of the name at height 0
+            pcursor->Seek(historyKey(name, 0));
+            if (pcursor->Valid() && pcursor->GetKey(key) && key.first == TRIE_NAME_HISTORY && key.second.first == name)
+                pcursor->Next();
+        }
+        return true;
+    }
+
+    // the rows that make up the state of the names, each read in order with a cursor of its own
+    const uint8_t dbkeys[] = {TRIE_NODE, SUPPORT, CLAIM_QUEUE_NAME_ROW, SUPPORT_QUEUE_NAME_ROW};
+    const std::size_t nCursors = sizeof(dbkeys) / sizeof(dbkeys[0]);
+    std::unique_ptr<CPendingRowsIterator> cursors[nCursors];
+    std::pair<uint8_t, std::string> keys[nCursors];
+    const auto settle = [&](std::size_t i) {
+        if (!cursors[i]->Valid() || !cursors[i]->GetKey(keys[i]) || keys[i].first != dbkeys[i])
+            keys[i].first = 0;
+    };
+    for (std::size_t i = 0; i < nCursors; ++i) {
+        cursors[i].reset(rows.NewIterator());
+        cursors[i]->Seek(std::make_pair(dbkeys[i], std::string()));
+        settle(i);
+    }
+    for (;;) {
+        const std::string* next = nullptr;
+        for (auto& key : keys)
+            if (key.first && (!next || rowNameBefore(key.second, *next)))
+                next = &key.second;
+        if (!next)
+            return true;
+        const auto name = *next;
+
+        CClaimNameState state;
+        queueNameRowType claimRows, supportRows;
+        for (std::size_t i = 0; i < nCursors; ++i) {
+            if (!keys[i].first || keys[i].second != name)
+                continue;
+            bool fRead = true;
+            if (dbkeys[i] == TRIE_NODE) {
+                CClaimTrieData data;
+                fRead = cursors[i]->GetValue(data);
+                state.claims = std::move(data.claims);
+                state.nHeightOfLastTakeover = data.nHeightOfLastTakeover;
+            } else if (dbkeys[i] == SUPPORT) {
+                fRead = cursors[i]->GetValue(state.supports);
+            } else {
+                fRead = cursors[i]->GetValue(dbkeys[i] == CLAIM_QUEUE_NAME_ROW ? claimRows : supportRows);
+            }
+            if (!fRead)
+                return error("%s(): error reading the claim trie rows of %s", __func__, name);
+            cursors[i]->Next();
+            settle(i);
+        }
+        insertRowsFromQueue(state.queuedClaims, claimRows, CLAIM_QUEUE_ROW, name);
+        insertRowsFromQueue(state.queuedSupports, supportRows, SUPPORT_QUEUE_ROW, name);
+        if (!state.empty())
+            callback(name, state);
+    }
+}
+
+CClaimTrieTotals CClaimTrieReadView::getTotals() const
+{
+    CClaimTrieTotals totals;
+    rows().Read(std::make_pair(TRIE_TOTALS, std::string()), totals);
+    return totals;
+}
+
+template <typename T>
+void CClaimTrieReadView::insertRowsFromQueue(std::vector<T>& result, const queueNameRowType& nameRows, uint8_t rowKey, const std::string& name) const
+{
+    for (auto& nameRow : nameRows) {
+        std::vector<queueEntryType<T>> queueRows;
+        if (rows().Read(std::make_pair(rowKey, CQueueHeight(nameRow.nHeight)), queueRows))
+            for (auto& row : queueRows)
+                if (row.first == name)
+                    result.push_back(row.second);
+    }
+}
+
+CClaimNameState CClaimTrieReadView::getNameState(const std::string& name) const
+{
+    CClaimNameState state;
+    CClaimTrieData data;
+    if (rows().Read(std::make_pair(TRIE_NODE, name), data)) {
+        state.claims = std::move(data.claims);
+        state.nHeightOfLastTakeover = data.nHeightOfLastTakeover;
+    }
+    rows().Read(std::make_pair(SUPPORT, name), state.supports);
+    queueNameRowType nameRows;
+    if (rows().Read(std::make_pair(CLAIM_QUEUE_NAME_ROW, name), nameRows))
+        insertRowsFromQueue(state.queuedClaims, nameRows, CLAIM_QUEUE_ROW, name);
+    nameRows.clear();
+    if (rows().Read(std::make_pair(SUPPORT_QUEUE_NAME_ROW, name), nameRows))
+        insertRowsFromQueue(state.queuedSupports, nameRows, SUPPORT_QUEUE_ROW, name);
+    return state;
+}
+
+std::string CClaimTrieReadView::normalizeClaimName(const std::string& name) const
+{
+    return nNextHeight > Params().GetConsensus().nNormalizedNameForkHeight ? CClaimTrieCacheNormalizationFork::normalizeName(name) : name;
+}
+
+CClaimSupportToName CClaimTrieReadView::getClaimsForName(const std::string& name) const
+{
+    auto normalized = normalizeClaimName(name);
+    return getNameState(normalized).getClaimsForName(normalized, nNextHeight);
+}
+
+bool CClaimTrieReadView::getClaimById(const uint160& claimId, std::string& name, CClaimValue* claim) const
+{
+    if (claimId.IsNull())
+        return false;
+
+    CClaimIndexElement element;
+    if (!rows().Read(std::make_pair(CLAIM_BY_ID, claimId), element))
+        return false;
+    if (element.claim.claimId == claimId) {
+        name = element.name;
+        if (claim)
+            *claim = element.claim;
+        return true;
+    }
+    return false;
+}
+
+bool CClaimTrieReadView::getClaimById(const std::string& partialId, std::string& name, CClaimValue* claim) const
+{
+    static constexpr std::size_t claimIdHexLength = 40;
+    if (partialId.empty() || partialId.size() > claimIdHexLength || !IsHex(partialId + (partialId.size() % 2 ? "0" : "")))
+        return false;
+
+    // the ids starting with partialId are the CLAIM_BY_ID_HEX keys from partialId00.. to partialIdff..
+    auto padding = claimIdHexLength - partialId.size();
+    uint160 first, last;
+    first.SetHex(partialId + std::string(padding, '0'));
+    last.SetHex(partialId + std::string(padding, 'f'));
+    first = claimIdHexKey(first);
+    last = claimIdHexKey(last);
+
+    std::unique_ptr<CPendingRowsIterator> pcursor(rows().NewIterator());
+
+    for (pcursor->Seek(std::make_pair(CLAIM_BY_ID_HEX, first)); pcursor->Valid(); pcursor->Next()) {
+        std::pair<uint8_t, uint160> key;
+        if (!pcursor->GetKey(key) || key.first != CLAIM_BY_ID_HEX || last < key.second)
+            break;
+
+        std::string claimName;
+        if (!pcursor->GetValue(claimName) || (!name.empty() && name != claimName))
+            continue;
+
+        std::string foundName;
+        if (getClaimById(claimIdHexKey(key.second), foundName, claim)) {
+            name = foundName;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<const CClaimTrieReadView> CClaimTrie::getReadView() const
+{
+    LOCK(cs_pending);
+    if (!readView)
+        readView = std::make_shared<const CClaimTrieReadView>(*db, pending, nNextHeight, nHistoryStart);
+    return readView;
+}
+
+void CClaimTrie::publishReadView()
+{
+    LOCK(cs_pending);
+    readView.reset();
+}
+
+void CClaimTrie::SetVerified()
+{
+    fVerified = true;
+}
+
+void CClaimTrie::clear()
+{
+    CPrefixTrie<std::string, CClaimTrieData>::clear();
+    recentNodes.clear();
+    recentNodesIndex.clear();
+    nNodeCacheUsage = 0;
+}
+
+bool CClaimTrie::pageIn(const const_iterator& it)
+{
+    if (!it || !it->fPagedOut) {
+        if (it && nNodeCacheBytes)
+            touch(it.key(), it.data());
+        return true;
+    }
+
+    auto& name = it.key();
+    CClaimTrieData data;
+    if (!rows().Read(std::make_pair(TRIE_NODE, name), data))
+        return error("%s(): error reading claim trie node %s from disk", __func__, name);
+
+    // nEffectiveAmount isn't serialized
+    supportEntryType supports;
+    rows().Read(std::make_pair(SUPPORT, name), supports);
+    data.reorderClaims(supports);
+    data.hash = it->hash;
+    insert(name, std::move(data));
+    touch(name, it.data());
+    return true;
+}
+
+void CClaimTrie::pageOut(const const_iterator& it)
+{
+    if (!nNodeCacheBytes || !it || it->fPagedOut || it->empty())
+        return;
+
+    auto& name = it.key();
+    auto rit = recentNodesIndex.find(name);
+    if (rit != recentNodesIndex.end()) {
+        nNodeCacheUsage -= rit->second.second;
+        recentNodes.erase(rit->second.first);
+        recentNodesIndex.erase(rit);
+    }
+
+    CClaimTrieData stub;
+    stub.hash = it->hash;
+    stub.fPagedOut = true;
+    insert(name, std::move(stub));
+}
+
+void CClaimTrie::touch(const std::string& name, const CClaimTrieData& data)
+{
+    if (!nNodeCacheBytes)
+        return;
+
+    auto rit = recentNodesIndex.find(name);
+    if (rit != recentNodesIndex.end()) {
+        nNodeCacheUsage -= rit->second.second;
+        recentNodes.erase(rit->second.first);
+        recentNodesIndex.erase(rit);
+    }
+    if (data.empty())
+        return;
+
+    auto usage = name.size() + sizeof(CClaimTrieData) + memusage::DynamicUsage(data.claims);
+    recentNodes.push_front(name);
+    recentNodesIndex.emplace(name, std::make_pair(recentNodes.begin(), usage));
+    nNodeCacheUsage += usage;
 }
 
-bool CClaimTrie::SyncToDisk()
+void CClaimTrie::trim()
 {
-    return db && db->Sync();
+    while (nNodeCacheUsage > nNodeCacheBytes && !recentNodes.empty()) {
+        // pageOut drops the entry from the recent list; nodes erased meanwhile only need their entry dropped
+        auto name = recentNodes.back();
+        const_iterator it = find(name);
+        if (it && !it->fPagedOut && !it->empty()) {
+            pageOut(it);
+            continue;
+        }
+        auto rit = recentNodesIndex.find(name);
+        nNodeCacheUsage -= rit->second.second;
+        recentNodesIndex.erase(rit);
+        recentNodes.pop_back();
+    }
 }
 
 template <typename T>
 using rm_ref = typename std::remove_reference<T>::type;
 
 template <typename Key, typename Map>
-auto getRow(const CDBWrapper& db, uint8_t dbkey, const Key& key, Map& queue) -> COptional<rm_ref<decltype(queue.at(key))>>
+auto getRow(const CClaimTrie& trie, uint8_t dbkey, const Key& key, Map& queue) -> COptional<rm_ref<decltype(queue.at(key))>>
 {
     auto it = queue.find(key);
     if (it != queue.end())
         return {&(it->second)};
     typename Map::mapped_type row;
-    if (db.Read(std::make_pair(dbkey, key), row))
+    if (trie.ReadQueueRow(dbkey, key, row))
         return {std::move(row)};
     return {};
 }
 
 template <typename Key, typename Value>
-Value* getQueue(const CDBWrapper& db, uint8_t dbkey, const Key& key, std::map<Key, Value>& queue, bool create)
+Value* getQueue(const CClaimTrie& trie, uint8_t dbkey, const Key& key, std::map<Key, Value>& queue, bool create)
 {
-    auto row = getRow(db, dbkey, key, queue);
+    auto row = getRow(trie, dbkey, key, queue);
     if (row.unique() || (!row && create)) {
         auto ret = queue.emplace(key, row ? std::move(*row) : Value{});
         assert(ret.second);
@@ -172,13 +1399,13 @@ inline constexpr bool supportedType()
 template <>
 std::vector<queueEntryType<CClaimValue>>* CClaimTrieCacheBase::getQueueCacheRow(int nHeight, bool createIfNotExists)
 {
-    return getQueue(*(base->db), CLAIM_QUEUE_ROW, nHeight, claimQueueCache, createIfNotExists);
+    return getQueue(*base, CLAIM_QUEUE_ROW, nHeight, claimQueueCache, createIfNotExists);
 }
 
 template <>
 std::vector<queueEntryType<CSupportValue>>* CClaimTrieCacheBase::getQueueCacheRow(int nHeight, bool createIfNotExists)
 {
-    return getQueue(*(base->db), SUPPORT_QUEUE_ROW, nHeight, supportQueueCache, createIfNotExists);
+    return getQueue(*base, SUPPORT_QUEUE_ROW, nHeight, supportQueueCache, createIfNotExists);
 }
 
 template <typename T>
@@ -191,13 +1418,13 @@ std::vector<queueEntryType<T>>* CClaimTrieCacheBase::getQueueCacheRow(int, bool)
 template <>
 COptional<const std::vector<queueEntryType<CClaimValue>>> CClaimTrieCacheBase::getQueueCacheRow(int nHeight) const
 {
-    return getRow(*(base->db), CLAIM_QUEUE_ROW, nHeight, claimQueueCache);
+    return getRow(*base, CLAIM_QUEUE_ROW, nHeight, claimQueueCache);
 }
 
 template <>
 COptional<const std::vector<queueEntryType<CSupportValue>>> CClaimTrieCacheBase::getQueueCacheRow(int nHeight) const
 {
-    return getRow(*(base->db), SUPPORT_QUEUE_ROW, nHeight, supportQueueCache);
+    return getRow(*base, SUPPORT_QUEUE_ROW, nHeight, supportQueueCache);
 }
 
 template <typename T>
@@ -210,13 +1437,13 @@ COptional<const std::vector<queueEntryType<T>>> CClaimTrieCacheBase::getQueueCac
 template <>
 queueNameRowType* CClaimTrieCacheBase::getQueueCacheNameRow<CClaimValue>(const std::string& name, bool createIfNoExists)
 {
-    return getQueue(*(base->db), CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache, createIfNoExists);
+    return getQueue(*base, CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache, createIfNoExists);
 }
 
 template <>
 queueNameRowType* CClaimTrieCacheBase::getQueueCacheNameRow<CSupportValue>(const std::string& name, bool createIfNoExists)
 {
-    return getQueue(*(base->db), SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache, createIfNoExists);
+    return getQueue(*base, SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache, createIfNoExists);
 }
 
 template <typename T>
@@ -229,13 +1456,13 @@ queueNameRowType* CClaimTrieCacheBase::getQueueCacheNameRow(const std::string&,
 template <>
 COptional<const queueNameRowType> CClaimTrieCacheBase::getQueueCacheNameRow<CClaimValue>(const std::string& name) const
 {
-    return getRow(*(base->db), CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache);
+    return getRow(*base, CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache);
 }
 
 template <>
 COptional<const queueNameRowType> CClaimTrieCacheBase::getQueueCacheNameRow<CSupportValue>(const std::string& name) const
 {
-    return getRow(*(base->db), SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache);
+    return getRow(*base, SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache);
 }
 
 template <typename T>
@@ -248,13 +1475,13 @@ COptional<const queueNameRowType> CClaimTrieCacheBase::getQueueCacheNameRow(cons
 template <>
 expirationQueueRowType* CClaimTrieCacheBase::getExpirationQueueCacheRow<CClaimValue>(int nHeight, bool createIfNoExists)
 {
-    return getQueue(*(base->db), CLAIM_EXP_QUEUE_ROW, nHeight, expirationQueueCache, createIfNoExists);
+    return getQueue(*base, CLAIM_EXP_QUEUE_ROW, nHeight, expirationQueueCache, createIfNoExists);
 }
 
 template <>
 expirationQueueRowType* CClaimTrieCacheBase::getExpirationQueueCacheRow<CSupportValue>(int nHeight, bool createIfNoExists)
 {
-    return getQueue(*(base->db), SUPPORT_EXP_QUEUE_ROW, nHeight, supportExpirationQueueCache, createIfNoExists);
+    return getQueue(*base, SUPPORT_EXP_QUEUE_ROW, nHeight, supportExpirationQueueCache, createIfNoExists);
 }
 
 template <typename T>
@@ -283,7 +1510,7 @@ supportEntryType CClaimTrieCacheBase::getSupportsForName(const std::string& name
         return sit->second;
 
     supportEntryType supports;
-    if (base->db->Read(std::make_pair(SUPPORT, name), supports)) // don't trust the try/catch in here
+    if (base->rows().Read(std::make_pair(SUPPORT, name), supports)) // don't trust the try/catch in here
         return supports;
     return {};
 }
@@ -320,33 +1547,100 @@ bool CClaimTrieCacheBase::haveSupportInQueue(const std::string& name, const COut
     return haveInQueue<CSupportValue>(name, outPoint, nValidAtHeight);
 }
 
+void CClaimTrieTotals::add(const CClaimTrieData& data, int sign)
+{
+    assert(!data.fPagedOut);
+    if (data.claims.empty())
+        return;
+    nNames += sign;
+    nClaims += sign * int64_t(data.claims.size());
+    for (auto& claim : data.claims)
+        nValue += sign * claim.nAmount;
+    nControllingValue += sign * data.claims.front().nAmount;
+}
+
+CClaimTrieTimings& CClaimTrieTimings::operator+=(const CClaimTrieTimings& other)
+{
+    nTimeScripts += other.nTimeScripts;
+    nTimeQueues += other.nTimeQueues;
+    nTimeTakeovers += other.nTimeTakeovers;
+    nTimeMerkle += other.nTimeMerkle;
+    nTimeFlush += other.nTimeFlush;
+    nFlushBytes += other.nFlushBytes;
+    nBlocks += other.nBlocks;
+    return *this;
+}
+
 std::size_t CClaimTrie::getTotalNamesInTrie() const
 {
-    std::size_t count = 0;
-    for (auto it = begin(); it != end(); ++it)
-        if (!it->empty()) ++count;
-    return count;
+    return totals.nNames;
 }
 
 std::size_t CClaimTrie::getTotalClaimsInTrie() const
 {
-    std::size_t count = 0;
-    for (auto it = begin(); it != end(); ++it)
-        count += it->claims.size();
-    return count;
+    return totals.nClaims;
 }
 
 CAmount CClaimTrie::getTotalValueOfClaimsInTrie(bool fControllingOnly) const
 {
-    CAmount value_in_subtrie = 0;
-    for (auto it = begin(); it != end(); ++it) {
-        for (auto& claim : it->claims) {
-            value_in_subtrie += claim.nAmount;
-            if (fControllingOnly)
+    return fControllingOnly ? totals.nControllingValue : totals.nValue;
+}
+
+void CClaimTrie::iterateNames(const std::string& prefix, const std::string* after, bool fClaims,
+    const std::function<bool(const std::string&, const CClaimTrieData&)>& callback)
+{
+    // the names under prefix are the subtree of the first node whose name starts with it
+    auto path = static_cast<const CClaimTrie&>(*this).nodes(prefix);
+    if (path.empty())
+        return;
+    auto top = path.back();
+    if (top.key() != prefix) {
+        top = {};
+        for (auto& child : path.back().children()) {
+            if (child.key().compare(0, prefix.size(), prefix) == 0) {
+                top = child;
                 break;
+            }
+        }
+        if (!top)
+            return;
+    }
+
+    std::function<bool(const const_iterator&)> walk = [&](const const_iterator& it) {
+        auto& name = it.key();
+        if (!after || name > *after) {
+            if (!it->empty()) {
+                const auto paged = fClaims && it->fPagedOut;
+                if (paged)
+                    pageIn(it);
+                const bool fContinue = callback(name, it.data());
+                if (paged)
+                    pageOut(it);
+                if (!fContinue)
+                    return false;
+            }
+        } else if (after->compare(0, name.size(), name) != 0) {
+            // everything below sorts before *after too
+            return true;
         }
+        for (auto& child : it.children())
+            if (!walk(child))
+                return false;
+        return true;
+    };
+    walk(top);
+}
+
+CClaimTrieTotals CClaimTrie::countTotals()
+{
+    CClaimTrieTotals count;
+    for (auto it = cbegin(); it != cend(); ++it) {
+        const auto paged = it->fPagedOut;
+        pageIn(it);
+        count.add(it.data(), 1);
+        if (paged) pageOut(it);
     }
-    return value_in_subtrie;
+    return count;
 }
 
 bool CClaimTrieCacheBase::getInfoForName(const std::string& name, CClaimValue& claim) const
@@ -367,38 +1661,62 @@ void CClaimTrieCacheBase::insertRowsFromQueue(std::vector<T>& result, const std:
                         result.push_back(row.second);
 }
 
-CClaimSupportToName CClaimTrieCacheBase::getClaimsForName(const std::string& name) const
+CClaimNameState CClaimTrieCacheBase::getNameState(const std::string& name) const
 {
-    claimEntryType claims;
-    int nLastTakeoverHeight = 0;
-    auto supports = getSupportsForName(name);
-    insertRowsFromQueue(supports, name);
-
+    CClaimNameState state;
     if (auto it = find(name)) {
-        claims = it->claims;
-        nLastTakeoverHeight = it->nHeightOfLastTakeover;
+        state.claims = it->claims;
+        state.nHeightOfLastTakeover = it->nHeightOfLastTakeover;
     }
-    insertRowsFromQueue(claims, name);
+    state.supports = getSupportsForName(name);
+    insertRowsFromQueue(state.queuedClaims, name);
+    insertRowsFromQueue(state.queuedSupports, name);
+    return state;
+}
 
-    auto find = [&supports](decltype(supports)::iterator& it, const CClaimValue& claim) {
-        it = std::find_if(it, supports.end(), [&claim](const CSupportValue& support) {
-            return claim.claimId == support.supportedClaimId;
-        });
-        return it != supports.end();
-    };
+CClaimSupportToName CClaimNameState::getClaimsForName(const std::string& name, int nNextHeight) const
+{
+    auto supports = this->supports;
+    supports.insert(supports.end(), queuedSupports.begin(), queuedSupports.end());
+
+    // the supports of each claim id, in their order, so that matching doesn't go over all of them per claim
+    std::map<uint160, std::vector<std::size_t>> supportsById;
+    for (std::size_t i = 0; i < supports.size(); ++i)
+        supportsById[supports[i].supportedClaimId].push_back(i);
+    std::vector<bool> matched(supports.size());
 
     // match support to claim
     std::vector<CClaimNsupports> claimsNsupports;
-    for (const auto& claim : claims) {
+    claimsNsupports.reserve(claims.size() + queuedClaims.size());
+    auto match = [&](const CClaimValue& claim) {
         CAmount nAmount = claim.nValidAtHeight < nNextHeight ? claim.nAmount : 0;
         auto ic = claimsNsupports.emplace(claimsNsupports.end(), claim, nAmount);
-        for (auto it = supports.begin(); find(it, claim); it = supports.erase(it)) {
-            if (it->nValidAtHeight < nNextHeight)
-                ic->effectiveAmount += it->nAmount;
-            ic->supports.emplace_back(std::move(*it));
+        auto it = supportsById.find(claim.claimId);
+        if (it == supportsById.end())
+            return;
+        for (auto i : it->second) {
+            if (supports[i].nValidAtHeight < nNextHeight)
+                ic->effectiveAmount += supports[i].nAmount;
+            ic->supports.push_back(std::move(supports[i]));
+            matched[i] = true;
         }
-    }
-    return {name, nLastTakeoverHeight, std::move(claimsNsupports), std::move(supports)};
+        supportsById.erase(it);
+    };
+    for (const auto& claim : claims)
+        match(claim);
+    for (const auto& claim : queuedClaims)
+        match(claim);
+
+    supportEntryType unmatched;
+    for (std::size_t i = 0; i < supports.size(); ++i)
+        if (!matched[i])
+            unmatched.push_back(std::move(supports[i]));
+    return {name, nHeightOfLastTakeover, std::move(claimsNsupports), std::move(unmatched)};
+}
+
+CClaimSupportToName CClaimTrieCacheBase::getClaimsForName(const std::string& name) const
+{
+    return getNameState(name).getClaimsForName(name, nNextHeight);
 }
 
 void completeHash(uint256& partialHash, const std::string& key, std::size_t to)
@@ -439,15 +1757,21 @@ uint256 recursiveMerkleHash(TIterator& it, const iCbType<TIterator>& process)
     return Hash(vchToHash.begin(), vchToHash.end());
 }
 
-bool CClaimTrieCacheBase::recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed) const
+bool CClaimTrieCacheBase::recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed, bool fRecursive) const
 {
     struct CRecursiveBreak {};
     using iterator = CClaimTrie::const_iterator;
-    iCbType<iterator> process = [&failed, &process](iterator& it) {
-        if (it->hash.IsNull() || it->hash != recursiveMerkleHash(it, process)) {
+    const auto start = it.key();
+    iCbType<iterator> process = [this, &failed, &process, &start, fRecursive](iterator& it) {
+        if (!fRecursive && it.key() != start)
+            return; // take the stored hashes of the children as they are
+        // parents only need the hash of their children so paged out nodes can go back out once checked
+        const auto paged = it->fPagedOut;
+        if (!base->pageIn(it) || it->hash.IsNull() || it->hash != recursiveMerkleHash(it, process)) {
             failed = it.key();
             throw CRecursiveBreak();
         }
+        if (paged) base->pageOut(it);
     };
 
     try {
@@ -458,14 +1782,16 @@ bool CClaimTrieCacheBase::recursiveCheckConsistency(CClaimTrie::const_iterator&
     return true;
 }
 
-bool CClaimTrieCacheBase::checkConsistency() const
+bool CClaimTrieCacheBase::checkConsistency(const std::string& name, bool fRecursive) const
 {
     if (base->empty())
         return true;
 
-    auto it = base->cbegin();
+    CClaimTrie::const_iterator it = base->find(name);
+    if (!it)
+        return true;
     std::string failed;
-    auto consistent = recursiveCheckConsistency(it, failed);
+    auto consistent = recursiveCheckConsistency(it, failed, fRecursive);
     if (!consistent) {
         LogPrintf("\nPrinting base tree from its parent:\n");
         auto basePath = base->nodes(failed);
@@ -486,26 +1812,118 @@ bool CClaimTrieCacheBase::checkConsistency() const
     return consistent;
 }
 
+template <typename K>
+static std::pair<uint8_t, K> queueKey(uint8_t dbkey, const K& key)
+{
+    return std::make_pair(dbkey, key);
+}
+
+static std::pair<uint8_t, CQueueHeight> queueKey(uint8_t dbkey, int nHeight)
+{
+    return std::make_pair(dbkey, CQueueHeight(nHeight));
+}
+
 template <typename K, typename T>
-void BatchWrite(CDBBatch& batch, uint8_t dbkey, const K& key, const std::vector<T>& value)
+void BatchWrite(CPendingBatch& batch, uint8_t dbkey, const K& key, const std::vector<T>& value)
 {
     if (value.empty()) {
-        batch.Erase(std::make_pair(dbkey, key));
+        batch.Erase(queueKey(dbkey, key));
     } else {
-        batch.Write(std::make_pair(dbkey, key), value);
+        batch.Write(queueKey(dbkey, key), value);
     }
 }
 
 template <typename Container>
-void BatchWriteQueue(CDBBatch& batch, uint8_t dbkey, const Container& queue)
+void BatchWriteQueue(CPendingBatch& batch, uint8_t dbkey, const Container& queue)
 {
     for (auto& itQueue : queue)
         BatchWrite(batch, dbkey, itQueue.first, itQueue.second);
 }
 
+void CClaimTrieCacheBase::recordNameHistory(CPendingBatch& batch)
+{
+    if (base->nHistoryStart < 0 || nNextHeight == base->nNextHeight)
+        return;
+
+    const auto startKey = std::make_pair(TRIE_HISTORY_START, std::string());
+    if (nNextHeight == base->nNextHeight - 1) {
+        // the block at nNextHeight was disconnected, the rows it wrote go with it
+        std::vector<std::string> names;
+        if (base->rows().Read(std::make_pair(TRIE_HISTORY_NAMES, nNextHeight), names)) {
+            for (auto& name : names)
+                batch.Erase(historyKey(name, nNextHeight));
+            batch.Erase(std::make_pair(TRIE_HISTORY_NAMES, nNextHeight));
+        }
+        std::vector<COutPoint> spent;
+        if (base->rows().Read(std::make_pair(TRIE_HISTORY_SPENT, nNextHeight), spent)) {
+            for (auto& outPoint : spent)
+                batch.Erase(std::make_pair(TRIE_SPENT_OUTPUT, outPoint));
+            batch.Erase(std::make_pair(TRIE_HISTORY_SPENT, nNextHeight));
+        }
+        if (nNextHeight >= base->nHistoryStart)
+            return;
+    } else if (nNextHeight == base->nNextHeight + 1) {
+        const int nHeight = nNextHeight - 1;
+        std::set<std::string> names(nodesToDelete.begin(), nodesToDelete.end());
+        for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it) {
+            // the nodes above the changed ones only have a new hash
+            auto old = base->find(it.key());
+            if (it->empty() && (!old || old->empty()))
+                continue;
+            if (!old || old->fPagedOut || old->claims != it->claims || old->nHeightOfLastTakeover != it->nHeightOfLastTakeover)
+                names.insert(it.key());
+        }
+        for (auto& support : supportCache)
+            names.insert(support.first);
+        for (auto& row : claimQueueNameCache)
+            names.insert(row.first);
+        for (auto& row : supportQueueNameCache)
+            names.insert(row.first);
+
+        std::vector<std::string> written;
+        for (auto& name : names) {
+            CClaimNameState previous;
+            uint8_t nDeltas = 0;
+            auto state = getNameState(name);
+            if (!readNameStateAt(base->rows(), base->nHistoryStart, name, nHeight, previous, &nDeltas))
+                previous = {};
+            else if (state == previous)
+                continue;
+            // a row after one with nothing, and every HISTORY_FULL_ROW_INTERVAL rows, holds the whole state
+            if (previous.empty() || nDeltas + 1 >= HISTORY_FULL_ROW_INTERVAL)
+                batch.Write(historyKey(name, nHeight), CNameHistoryRow(std::move(state)));
+            else
+                batch.Write(historyKey(name, nHeight), CNameHistoryRow(previous, state, nDeltas + 1));
+            written.push_back(name);
+        }
+        if (!written.empty())
+            batch.Write(std::make_pair(TRIE_HISTORY_NAMES, nHeight), written);
+
+        // the history has the claims as of the older blocks, these are the outputs behind them
+        std::vector<COutPoint> spent;
+        for (auto& output : spentOutputs) {
+            batch.Write(std::make_pair(TRIE_SPENT_OUTPUT, output.first), output.second);
+            spent.push_back(output.first);
+        }
+        if (!spent.empty())
+            batch.Write(std::make_pair(TRIE_HISTORY_SPENT, nHeight), spent);
+        pruneNameHistory(batch, nHeight);
+        return;
+    }
+
+    // several blocks at once (replayed) or the block the history starts from was disconnected:
+    // the history ends here and is started over on the next load (see buildNameHistory)
+    LogPrintf("%s: the claim trie history stops at height %d\n", __func__, base->nNextHeight - 1);
+    batch.Erase(startKey);
+    base->nHistoryStart = -1;
+}
+
 bool CClaimTrieCacheBase::flush()
 {
-    CDBBatch batch(*(base->db));
+    int64_t nTimeStart = GetTimeMicros();
+    CPendingBatch batch;
+
+    recordNameHistory(batch);
 
     for (const auto& claim : claimsToDeleteFromByIdIndex) {
         auto it = std::find_if(claimsToAddToByIdIndex.begin(), claimsToAddToByIdIndex.end(),
@@ -513,18 +1931,35 @@ bool CClaimTrieCacheBase::flush()
                 return e.claim.claimId == claim.claimId;
             }
         );
-        if (it == claimsToAddToByIdIndex.end())
+        if (it == claimsToAddToByIdIndex.end()) {
             batch.Erase(std::make_pair(CLAIM_BY_ID, claim.claimId));
+            batch.Erase(std::make_pair(CLAIM_BY_ID_HEX, claimIdHexKey(claim.claimId)));
+        }
     }
 
-    for (const auto& e : claimsToAddToByIdIndex)
+    for (const auto& e : claimsToAddToByIdIndex) {
         batch.Write(std::make_pair(CLAIM_BY_ID, e.claim.claimId), e);
+        batch.Write(std::make_pair(CLAIM_BY_ID_HEX, claimIdHexKey(e.claim.claimId)), e.name);
+    }
 
     getMerkleHash();
 
+    // the totals need the claims of the nodes being replaced, read in before the trie is changed
+    for (const auto& nodeName : nodesToDelete) {
+        if (!nodesToAddOrUpdate.contains(nodeName) && !base->pageIn(base->find(nodeName)))
+            return error("%s(): error reading claim trie node %s", __func__, nodeName);
+    }
+    for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it) {
+        if (!base->pageIn(base->find(it.key())))
+            return error("%s(): error reading claim trie node %s", __func__, it.key());
+    }
+
+    auto totals = base->totals;
     for (const auto& nodeName : nodesToDelete) {
         if (nodesToAddOrUpdate.contains(nodeName))
             continue;
+        if (auto old = base->find(nodeName))
+            totals.add(old.data(), -1);
         auto nodes = base->nodes(nodeName);
         base->erase(nodeName);
         for (auto& node : nodes)
@@ -535,9 +1970,14 @@ bool CClaimTrieCacheBase::flush()
     for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it) {
         auto old = base->find(it.key());
         if (!old || old.data() != it.data()) {
-            base->copy(it);
+            if (old)
+                totals.add(old.data(), -1);
+            totals.add(it.data(), 1);
             batch.Write(std::make_pair(TRIE_NODE, it.key()), it.data());
         }
+        // the comparison above skips nEffectiveAmount, which supports change without touching the row
+        base->copy(it);
+        base->touch(it.key(), it.data());
     }
 
     BatchWriteQueue(batch, SUPPORT, supportCache);
@@ -550,72 +1990,272 @@ bool CClaimTrieCacheBase::flush()
     BatchWriteQueue(batch, SUPPORT_QUEUE_NAME_ROW, supportQueueNameCache);
     BatchWriteQueue(batch, SUPPORT_EXP_QUEUE_ROW, supportExpirationQueueCache);
 
-    base->nNextHeight = nNextHeight;
+    if (totals != base->totals)
+        batch.Write(std::make_pair(TRIE_TOTALS, std::string()), totals);
+
     if (!nodesToAddOrUpdate.empty() && (LogAcceptCategory(BCLog::CLAIMS) || LogAcceptCategory(BCLog::BENCH))) {
         LogPrintf("TrieCache size: %zu nodes on block %d, batch writes %zu bytes.\n",
                 nodesToAddOrUpdate.height(), nNextHeight, batch.SizeEstimate());
     }
-    auto ret = base->db->WriteBatch(batch);
+    // db is written with the coins (see FlushStateToDisk), until then the rows stay pending
+    timings.nFlushBytes += batch.SizeEstimate();
+    base->applyPending(std::move(batch.rows), nNextHeight);
+    base->totals = totals;
 
     clear();
-    return ret;
+    base->trim();
+    timings.nTimeFlush += GetTimeMicros() - nTimeStart;
+    return true;
+}
+
+// the heights pruneNameHistory goes through in one flush, so that a lower -claimtriehistory
+// than before takes effect over a number of blocks rather than in one huge batch
+static const int MAX_HISTORY_PRUNE_HEIGHTS = 100;
+
+void CClaimTrieCacheBase::pruneNameHistory(CPendingBatch& batch, int nHeight)
+{
+    if (nClaimTrieHistoryBlocks <= 0)
+        return;
+    const int nStart = std::min(nHeight - nClaimTrieHistoryBlocks + 1, base->nHistoryStart + MAX_HISTORY_PRUNE_HEIGHTS);
+    if (nStart <= base->nHistoryStart)
+        return;
+
+    // a name's rows before the one in effect at nStart - 1 go, that one stays as a full row
+    // (unless the name had nothing then); the names without rows before that aren't visited
+    auto rows = base->rows();
+    std::unique_ptr<CPendingRowsIterator> pcursor(rows.NewIterator());
+    for (int nPruned = std::max(base->nHistoryStart - 1, 0); nPruned < nStart - 1; ++nPruned) {
+        const auto namesKey = std::make_pair(TRIE_HISTORY_NAMES, nPruned);
+        std::vector<std::string> names;
+        if (!rows.Read(namesKey, names))
+            continue;
+        for (auto& name : names) {
+            historyKeyType key;
+            pcursor->Seek(historyKey(name, nStart - 1));
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != TRIE_NAME_HISTORY || key.second.first != name)
+                continue; // pruned already
+            const auto inEffect = key;
+            CClaimNameState state;
+            uint8_t nDeltas;
+            if (!readHistoryRow(*pcursor, name, state, nDeltas)) {
+                error("%s(): error reading the history of %s", __func__, name);
+                continue;
+            }
+            if (state.empty())
+                batch.Erase(inEffect);
+            else if (nDeltas)
+                batch.Write(inEffect, CNameHistoryRow(std::move(state)));
+            for (pcursor->Seek(inEffect), pcursor->Next(); pcursor->Valid(); pcursor->Next()) {
+                if (!pcursor->GetKey(key) || key.first != TRIE_NAME_HISTORY || key.second.first != name)
+                    break;
+                batch.Erase(key);
+            }
+        }
+        batch.Erase(namesKey);
+    }
+    // the outputs spent by a block are those of the claims the block before had
+    for (int nPruned = std::max(base->nHistoryStart.load(), 0); nPruned < nStart; ++nPruned) {
+        const auto spentKey = std::make_pair(TRIE_HISTORY_SPENT, nPruned);
+        std::vector<COutPoint> spent;
+        if (!rows.Read(spentKey, spent))
+            continue;
+        for (auto& outPoint : spent)
+            batch.Erase(std::make_pair(TRIE_SPENT_OUTPUT, outPoint));
+        batch.Erase(spentKey);
+    }
+    batch.Write(std::make_pair(TRIE_HISTORY_START, std::string()), nStart);
+    base->nHistoryStart = nStart;
+}
+
+bool CClaimTrieCacheBase::buildNameHistory()
+{
+    const auto startKey = std::make_pair(TRIE_HISTORY_START, std::string());
+    int start;
+    if (base->db->Read(startKey, start)) {
+        base->nHistoryStart = start;
+        return true;
+    }
+
+    LogPrintf("Building the claim trie history...\n");
+    CDBBatch batch(*(base->db));
+    auto writeBatch = [this, &batch](bool fForce) {
+        if (!fForce && batch.SizeEstimate() <= (1 << 24))
+            return true;
+        if (!base->db->WriteBatch(batch))
+            return error("buildNameHistory(): error writing the claim trie history");
+        batch.Clear();
+        base->trim();
+        return true;
+    };
+
+    // whatever is left of an earlier history doesn't line up with this one
+    std::unique_ptr<CDBIterator> pcursor(base->db->NewIterator());
+    for (pcursor->Seek(std::make_pair(TRIE_NAME_HISTORY, std::string())); pcursor->Valid(); pcursor->Next()) {
+        historyKeyType key;
+        if (!pcursor->GetKey(key) || key.first != TRIE_NAME_HISTORY)
+            break;
+        batch.Erase(key);
+        if (!writeBatch(false))
+            return false;
+    }
+    for (auto dbkey : {TRIE_HISTORY_NAMES, TRIE_HISTORY_SPENT}) {
+        for (pcursor->Seek(std::make_pair(uint8_t(dbkey), 0)); pcursor->Valid(); pcursor->Next()) {
+            std::pair<uint8_t, int> key;
+            if (!pcursor->GetKey(key) || key.first != dbkey)
+                break;
+            batch.Erase(key);
+            if (!writeBatch(false))
+                return false;
+        }
+    }
+    for (pcursor->Seek(std::make_pair(TRIE_SPENT_OUTPUT, std::string())); pcursor->Valid(); pcursor->Next()) {
+        std::pair<uint8_t, COutPoint> key;
+        if (!pcursor->GetKey(key) || key.first != TRIE_SPENT_OUTPUT)
+            break;
+        batch.Erase(key);
+        if (!writeBatch(false))
+            return false;
+    }
+
+    // every name with claims or supports, active or queued, starts with the state it has now
+    const int nHeight = nNextHeight - 1;
+    for (auto dbkey : {TRIE_NODE, SUPPORT, CLAIM_QUEUE_NAME_ROW, SUPPORT_QUEUE_NAME_ROW}) {
+        for (pcursor->Seek(std::make_pair(uint8_t(dbkey), std::string())); pcursor->Valid(); pcursor->Next()) {
+            std::pair<uint8_t, std::string> key;
+            if (!pcursor->GetKey(key) || key.first != dbkey)
+                break;
+            auto state = getNameState(key.second);
+            if (state.empty())
+                continue;
+            batch.Write(historyKey(key.second, nHeight), CNameHistoryRow(std::move(state)));
+            if (!writeBatch(false))
+                return false;
+        }
+    }
+    batch.Write(startKey, nNextHeight);
+    if (!writeBatch(true))
+        return false;
+    base->nHistoryStart = nNextHeight;
+    return true;
 }
 
-bool CClaimTrieCacheBase::ReadFromDisk(const CBlockIndex* tip)
+bool CClaimTrieCacheBase::ReadFromDisk(const CBlockIndex* tip, bool* pfCheckDeferred)
 {
     LogPrintf("Loading the claim trie from disk...\n");
 
+    // what was flushed before is part of the trie on disk too
+    if (!base->WritePending(uint256(), true))
+        return error("%s(): error writing the pending claim trie rows", __func__);
+
     base->nNextHeight = nNextHeight = tip ? tip->nHeight + 1 : 0;
+    base->fVerified = false;
+    if (pfCheckDeferred)
+        *pfCheckDeferred = false;
 
     if (tip && base->db->Exists(std::make_pair(TRIE_NODE_CHILDREN, std::string()))) {
         LogPrintf("The claim trie database contains deprecated data and will need to be rebuilt.\n");
         return false;
     }
 
+    if (!base->BuildClaimIdHexIndex() || !base->UpgradeQueueRows() || !base->UpgradeNameHistory())
+        return false;
+
+    // the marker is only good for the one start after the clean shutdown that wrote it
+    std::pair<uint256, int> marker;
+    const auto markerKey = std::make_pair(TRIE_CLEAN_SHUTDOWN, std::string());
+    bool fCleanShutdown = base->db->Read(markerKey, marker);
+    if (fCleanShutdown && !base->db->Erase(markerKey, true))
+        return error("%s(): error erasing the clean shutdown marker", __func__);
+    fCleanShutdown = fCleanShutdown && tip && marker.first == tip->hashClaimTrie && marker.second == tip->nHeight;
+
     clear();
     base->clear();
-    boost::scoped_ptr<CDBIterator> pcursor(base->db->NewIterator());
+    if (fCleanShutdown && base->ReadImage(tip->hashClaimTrie, tip->nHeight)) {
+        LogPrintf("Loaded the claim trie from %s\n", base->imagePath.string());
+    } else {
+        if (!fCleanShutdown)
+            fs::remove(base->imagePath);
+        boost::scoped_ptr<CDBIterator> pcursor(base->db->NewIterator());
+
+        // Our old tries had many nodes without claims. Only those still joining others are kept,
+        // which is known once their children are in; their rows come before the children's.
+        std::vector<std::pair<std::string, uint256>> emptyNodes;
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            std::pair<uint8_t, std::string> key;
+            if (!pcursor->GetKey(key) || key.first != TRIE_NODE)
+                continue;
 
-    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
-        std::pair<uint8_t, std::string> key;
-        if (!pcursor->GetKey(key) || key.first != TRIE_NODE)
-            continue;
+            if (base->nNodeCacheBytes) {
+                // the claims are read on first access (see CClaimTrie::pageIn)
+                CTrieNodeHash row;
+                if (!pcursor->GetValue(row))
+                    return error("%s(): error reading claim trie from disk", __func__);
+                if (row.fEmpty) {
+                    emptyNodes.emplace_back(key.second, row.hash);
+                    continue;
+                }
+                CClaimTrieData stub;
+                stub.hash = row.hash;
+                stub.fPagedOut = true;
+                base->insert(key.second, std::move(stub));
+                continue;
+            }
 
-        CClaimTrieData data;
-        if (pcursor->GetValue(data)) {
+            CClaimTrieData data;
+            if (!pcursor->GetValue(data))
+                return error("%s(): error reading claim trie from disk", __func__);
             if (data.empty()) {
-                // we have a situation where our old trie had many empty nodes
-                // we don't want to automatically throw those all into our prefix trie
-                // we'll run a second pass to clean them up
+                emptyNodes.emplace_back(key.second, data.hash);
                 continue;
             }
-
             // nEffectiveAmount isn't serialized but it needs to be initialized (as done in reorderClaims):
             auto supports = getSupportsForName(key.second);
             data.reorderClaims(supports);
             base->insert(key.second, std::move(data));
-        } else {
-            return error("%s(): error reading claim trie from disk", __func__);
         }
-    }
 
-    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
-        std::pair<uint8_t, std::string> key;
-        if (!pcursor->GetKey(key) || key.first != TRIE_NODE)
-            continue;
-        auto hit = base->find(key.second);
-        if (hit) {
-            CClaimTrieData data;
-            if (pcursor->GetValue(data))
-                hit->hash = data.hash;
-        }
-        else {
-            base->db->Erase(key); // this uses a lot of memory and it's 1-time upgrade from 12.4 so we aren't going to batch it
+        for (auto& node : emptyNodes) {
+            if (auto hit = base->find(node.first))
+                hit->hash = node.second;
+            else
+                base->db->Erase(std::make_pair(TRIE_NODE, node.first)); // this uses a lot of memory and it's 1-time upgrade from 12.4 so we aren't going to batch it
         }
     }
 
+    const auto totalsKey = std::make_pair(TRIE_TOTALS, std::string());
+    if (!base->db->Read(totalsKey, base->totals)) {
+        LogPrintf("Counting the names and claims in the claim trie...\n");
+        base->totals = base->countTotals();
+        if (!base->db->Write(totalsKey, base->totals, true))
+            return error("%s(): error writing the claim trie totals", __func__);
+    }
+
+    if (!buildNameHistory())
+        return false;
+    base->publishReadView();
+
+    if (fCleanShutdown && pfCheckDeferred) {
+        // the caller verifies the trie once the node is up (see CClaimTrie::SetVerified)
+        LogPrintf("The claim trie was written by a clean shutdown at height %d; deferring the consistency check\n", marker.second);
+        *pfCheckDeferred = true;
+        if (getMerkleHash() != tip->hashClaimTrie)
+            return error("%s(): hashes don't match when reading claimtrie from disk", __func__);
+        return true;
+    }
+
+    if (base->nNodeCacheBytes && tip && pfCheckDeferred) {
+        // checking it here would read every node back in; the stored hashes are checked in the background
+        LogPrintf("The claim trie is paged from disk; deferring the consistency check\n");
+        *pfCheckDeferred = true;
+        if (getMerkleHash() != tip->hashClaimTrie)
+            return error("%s(): hashes don't match when reading claimtrie from disk", __func__);
+        return true;
+    }
+
     LogPrintf("Checking claim trie consistency... ");
     if (checkConsistency()) {
+        base->trim();
+        base->fVerified = true;
         LogPrintf("consistent\n");
         if (tip && tip->hashClaimTrie != getMerkleHash())
             return error("%s(): hashes don't match when reading claimtrie from disk", __func__);
@@ -636,6 +2276,93 @@ int CClaimTrieCacheBase::expirationTime() const
     return Params().GetConsensus().nOriginalClaimExpirationTime;
 }
 
+int nClaimTrieHashThreads = 0;
+int nClaimTrieHistoryBlocks = DEFAULT_CLAIMTRIE_HISTORY;
+
+/**
+ * Hashes one dirty subtree of the claim trie. Subtrees handed to different
+ * threads share no nodes, so every node's hash is written by exactly one thread.
+ */
+class CClaimTrieHashCheck
+{
+public:
+    CClaimTrieHashCheck() = default;
+    CClaimTrieHashCheck(const CClaimTrie::iterator& it, const std::function<void(CClaimTrie::iterator&)>* process) : it(it), process(process)
+    {
+    }
+
+    bool operator()()
+    {
+        (*process)(it);
+        return true;
+    }
+
+    void swap(CClaimTrieHashCheck& check)
+    {
+        std::swap(it, check.it);
+        std::swap(process, check.process);
+    }
+
+private:
+    CClaimTrie::iterator it;
+    const std::function<void(CClaimTrie::iterator&)>* process = nullptr;
+};
+
+// subtrees vary wildly in size, so let the threads take them one at a time
+static CCheckQueue<CClaimTrieHashCheck> claimTrieHashQueue(1);
+
+void ThreadClaimTrieHash()
+{
+    RenameThread("lbrycrd-triehash");
+    claimTrieHashQueue.Thread();
+}
+
+// the dirty nodes from it down (a node is only dirty under dirty ones); the keys of those with
+// more than nLarge of them go in large
+static std::size_t countDirtyNodes(const CClaimTrie::iterator& it, std::size_t nLarge, std::unordered_set<std::string>* large)
+{
+    std::size_t nDirty = 1;
+    for (auto& child : it.children())
+        if (child->hash.IsNull())
+            nDirty += countDirtyNodes(child, nLarge, large);
+    if (large && nDirty > nLarge)
+        large->insert(it.key());
+    return nDirty;
+}
+
+void CClaimTrieCacheBase::computeChildHashesInParallel(CClaimTrie::iterator& it, const std::function<void(CClaimTrie::iterator&)>& process)
+{
+    if (!nClaimTrieHashThreads || !it->hash.IsNull())
+        return;
+
+    // A subtree with more dirty nodes than a thread's share is split into its dirty children (and
+    // so on down), so that one large subtree doesn't leave the other threads idle. The nodes that
+    // were split are hashed by the caller afterwards, with it.
+    std::unordered_set<std::string> large;
+    const std::size_t nShare = countDirtyNodes(it, 0, nullptr) / nClaimTrieHashThreads;
+    countDirtyNodes(it, nShare, &large);
+
+    std::vector<CClaimTrieHashCheck> vChecks;
+    std::function<void(const CClaimTrie::iterator&)> split = [&](const CClaimTrie::iterator& node) {
+        for (auto& child : node.children()) {
+            if (!child->hash.IsNull())
+                continue;
+            if (large.count(child.key()))
+                split(child);
+            else
+                vChecks.emplace_back(child, &process);
+        }
+    };
+    split(it);
+
+    if (vChecks.size() < 2)
+        return;
+
+    CCheckQueueControl<CClaimTrieHashCheck> control(&claimTrieHashQueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 uint256 CClaimTrieCacheBase::recursiveComputeMerkleHash(CClaimTrie::iterator& it)
 {
     using iterator = CClaimTrie::iterator;
@@ -644,16 +2371,20 @@ uint256 CClaimTrieCacheBase::recursiveComputeMerkleHash(CClaimTrie::iterator& it
             it->hash = recursiveMerkleHash(it, process);
         assert(!it->hash.IsNull());
     };
+    computeChildHashesInParallel(it, process);
     process(it);
     return it->hash;
 }
 
 uint256 CClaimTrieCacheBase::getMerkleHash()
 {
+    int64_t nTimeStart = GetTimeMicros();
     auto it = nodesToAddOrUpdate.begin();
     if (!it && nodesToDelete.empty())
         it = base->begin();
-    return !it ? one : recursiveComputeMerkleHash(it);
+    auto hash = !it ? one : recursiveComputeMerkleHash(it);
+    timings.nTimeMerkle += GetTimeMicros() - nTimeStart;
+    return hash;
 }
 
 CClaimTrie::const_iterator CClaimTrieCacheBase::find(const std::string& name) const
@@ -661,7 +2392,9 @@ CClaimTrie::const_iterator CClaimTrieCacheBase::find(const std::string& name) co
     auto it = nodesToAddOrUpdate.find(name);
     if (it || nodesToDelete.count(name))
         return it;
-    return base->find(name);
+    auto bit = base->find(name);
+    base->pageIn(bit);
+    return bit;
 }
 
 bool CClaimTrieCacheBase::empty() const
@@ -687,8 +2420,9 @@ CClaimTrie::iterator CClaimTrieCacheBase::cacheData(const std::string& name, boo
     auto nodes = base->nodes(name);
     for (auto& node: nodes) {
         for (auto& child : node.children())
-            if (!nodesAlreadyCached.count(child.key()))
+            if (!nodesAlreadyCached.count(child.key()) && base->pageIn(child))
                 nodesToAddOrUpdate.copy(child);
+        base->pageIn(node);
         insert(node);
     }
 
@@ -716,6 +2450,7 @@ bool CClaimTrieCacheBase::getLastTakeoverForName(const std::string& name, uint16
         return true;
     }
     if (auto it = base->find(name)) {
+        base->pageIn(it);
         takeoverHeight = it->nHeightOfLastTakeover;
         CClaimValue claim;
         if (it->getBestClaim(claim)) {
@@ -738,9 +2473,7 @@ void CClaimTrieCacheBase::markAsDirty(const std::string& name, bool fCheckTakeov
 bool CClaimTrieCacheBase::insertClaimIntoTrie(const std::string& name, const CClaimValue& claim, bool fCheckTakeover)
 {
     auto it = cacheData(name);
-    it->insertClaim(claim);
-    auto supports = getSupportsForName(name);
-    it->reorderClaims(supports);
+    it->insertClaim(claim, getSupportsForName(name));
     markAsDirty(name, fCheckTakeover);
     return true;
 }
@@ -754,10 +2487,8 @@ bool CClaimTrieCacheBase::removeClaimFromTrie(const std::string& name, const COu
         return false;
     }
 
-    if (!it->claims.empty()) {
-        auto supports = getSupportsForName(name);
-        it->reorderClaims(supports);
-    } else {
+    // the claims left keep their order
+    if (it->claims.empty()) {
         // in case we pull a child into our spot; we will then need their kids for hash
         bool hasChild = it.hasChildren();
         for (auto& child: it.children())
@@ -863,6 +2594,11 @@ bool CClaimTrieCacheBase::undoSpendSupport(const std::string& name, const COutPo
     return undoSpend(name, support, nValidAtHeight);
 }
 
+void CClaimTrieCacheBase::addSpentOutput(const COutPoint& outPoint, const CTxOut& txout)
+{
+    spentOutputs.emplace_back(outPoint, txout);
+}
+
 template <typename T>
 bool CClaimTrieCacheBase::removeFromQueue(const std::string& name, const COutPoint& outPoint, T& value)
 {
@@ -978,7 +2714,7 @@ bool CClaimTrieCacheBase::insertSupportIntoMap(const std::string& name, const CS
 
     if (auto it = cacheData(name, false)) {
         markAsDirty(name, fCheckTakeover);
-        it->reorderClaims(sit->second);
+        it->addSupportAmount(support.supportedClaimId, support.nAmount);
     }
 
     return true;
@@ -995,7 +2731,7 @@ bool CClaimTrieCacheBase::removeSupportFromMap(const std::string& name, const CO
 
         if (auto dit = cacheData(name, false)) {
             markAsDirty(name, fCheckTakeover);
-            dit->reorderClaims(sit->second);
+            dit->addSupportAmount(support.supportedClaimId, -support.nAmount);
         }
         return true;
     }
@@ -1011,6 +2747,7 @@ void CClaimTrieCacheBase::dumpToLog(CClaimTrie::const_iterator it, bool diffFrom
             return;
     }
 
+    base->pageIn(it);
     std::string indent(it.depth(), ' ');
     auto children = it.children();
     auto empty = children.empty() && it->claims.empty();
@@ -1147,8 +2884,11 @@ void CClaimTrieCacheBase::undoIncrement(const std::string& name, insertUndoType&
 
 bool CClaimTrieCacheBase::incrementBlock(insertUndoType& insertUndo, claimQueueRowType& expireUndo, insertUndoType& insertSupportUndo, supportQueueRowType& expireSupportUndo, std::vector<std::pair<std::string, int>>& takeoverHeightUndo)
 {
+    int64_t nTimeStart = GetTimeMicros();
     undoIncrement(insertUndo, expireUndo, &claimsToDeleteFromByIdIndex);
     undoIncrement(insertSupportUndo, expireSupportUndo);
+    int64_t nTimeQueues = GetTimeMicros();
+    timings.nTimeQueues += nTimeQueues - nTimeStart;
 
     // check each potentially taken over name to see if a takeover occurred.
     // if it did, then check the claim and support insertion queues for
@@ -1218,6 +2958,7 @@ bool CClaimTrieCacheBase::incrementBlock(insertUndoType& insertUndo, claimQueueR
     namesToCheckForTakeover.clear();
     takeoverWorkaround.clear();
     nNextHeight++;
+    timings.nTimeTakeovers += GetTimeMicros() - nTimeQueues;
     return true;
 }
 
@@ -1266,15 +3007,18 @@ void CClaimTrieCacheBase::undoDecrement(insertUndoType& insertUndo, std::vector<
 
 bool CClaimTrieCacheBase::decrementBlock(insertUndoType& insertUndo, claimQueueRowType& expireUndo, insertUndoType& insertSupportUndo, supportQueueRowType& expireSupportUndo)
 {
+    int64_t nTimeStart = GetTimeMicros();
     nNextHeight--;
 
     undoDecrement(insertSupportUndo, expireSupportUndo);
     undoDecrement(insertUndo, expireUndo, &claimsToAddToByIdIndex, &claimsToDeleteFromByIdIndex);
+    timings.nTimeQueues += GetTimeMicros() - nTimeStart;
     return true;
 }
 
 bool CClaimTrieCacheBase::finalizeDecrement(std::vector<std::pair<std::string, int>>& takeoverHeightUndo)
 {
+    int64_t nTimeStart = GetTimeMicros();
     for (auto itTakeoverHeightUndo = takeoverHeightUndo.crbegin(); itTakeoverHeightUndo != takeoverHeightUndo.crend(); ++itTakeoverHeightUndo) {
         auto it = cacheData(itTakeoverHeightUndo->first, false);
         if (it && itTakeoverHeightUndo->second) {
@@ -1287,6 +3031,7 @@ bool CClaimTrieCacheBase::finalizeDecrement(std::vector<std::pair<std::string, i
         }
     }
 
+    timings.nTimeTakeovers += GetTimeMicros() - nTimeStart;
     return true;
 }
 
@@ -1325,7 +3070,9 @@ int CClaimTrieCacheBase::getNumBlocksOfContinuousOwnership(const std::string& na
         return 0;
     }
     auto it = nodesToAddOrUpdate.find(name);
-    return (it || (it = base->find(name))) && !it->empty() ? nNextHeight - it->nHeightOfLastTakeover : 0;
+    if (!it && (it = base->find(name)))
+        base->pageIn(it);
+    return it && !it->empty() ? nNextHeight - it->nHeightOfLastTakeover : 0;
 }
 
 int CClaimTrieCacheBase::getDelayForName(const std::string& name) const
@@ -1368,6 +3115,7 @@ bool CClaimTrieCacheBase::clear()
     namesToCheckForTakeover.clear();
     supportExpirationQueueCache.clear();
     claimsToDeleteFromByIdIndex.clear();
+    spentOutputs.clear();
     return true;
 }
 
@@ -1419,10 +3167,18 @@ bool CClaimTrieCacheBase::getProofForName(const std::string& name, CClaimTriePro
 
 void CClaimTrieCacheBase::iterate(std::function<void(const std::string&, const CClaimTrieData&)> callback) const
 {
+    // paged out nodes are only brought in for the duration of the callback
+    const auto baseCallback = [this, &callback](const CClaimTrie::const_iterator& it) {
+        const auto paged = it->fPagedOut;
+        base->pageIn(it);
+        callback(it.key(), it.data());
+        if (paged) base->pageOut(it);
+    };
+
     if (nodesToAddOrUpdate.empty()) {
         for (auto it = base->cbegin(); it != base->cend(); ++it)
             if (!nodesToDelete.count(it.key()))
-                callback(it.key(), it.data());
+                baseCallback(it);
         return;
     }
     for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it) {
@@ -1433,6 +3189,6 @@ void CClaimTrieCacheBase::iterate(std::function<void(const std::string&, const C
         for (auto& child : children)
             for (; child; ++child)
                 if (!nodesToDelete.count(child.key()))
-                    callback(child.key(), child.data());
+                    baseCallback(child);
     }
 }
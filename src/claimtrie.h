@@ -4,14 +4,20 @@
 #include <amount.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <crypto/common.h>
 #include <dbwrapper.h>
 #include <prefixtrie.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <sync.h>
 #include <uint256.h>
 #include <util.h>
 
+#include <atomic>
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -21,16 +27,113 @@
 #define TRIE_NODE 'n'
 #define TRIE_NODE_CHILDREN 'b'
 #define CLAIM_BY_ID 'i'
-#define CLAIM_QUEUE_ROW 'r'
+#define CLAIM_QUEUE_ROW 'R'
 #define CLAIM_QUEUE_NAME_ROW 'm'
-#define CLAIM_EXP_QUEUE_ROW 'e'
+#define CLAIM_EXP_QUEUE_ROW 'E'
 #define SUPPORT 's'
-#define SUPPORT_QUEUE_ROW 'u'
+#define SUPPORT_QUEUE_ROW 'U'
 #define SUPPORT_QUEUE_NAME_ROW 'p'
-#define SUPPORT_EXP_QUEUE_ROW 'x'
+#define SUPPORT_EXP_QUEUE_ROW 'X'
+#define TRIE_CLEAN_SHUTDOWN 'c'
+#define CLAIM_BY_ID_HEX 'h'
+#define TRIE_NAME_HISTORY 'V'
+#define TRIE_HISTORY_NAMES 'w'
+#define TRIE_HISTORY_START 'o'
+#define TRIE_SPENT_OUTPUT 'y'
+#define TRIE_HISTORY_SPENT 'z'
+#define TRIE_TOTALS 't'
+#define TRIE_BEST_BLOCK 'k'
+// the height keyed queue rows as written before CQueueHeight (see CClaimTrie::UpgradeQueueRows)
+#define CLAIM_QUEUE_ROW_LE 'r'
+#define CLAIM_EXP_QUEUE_ROW_LE 'e'
+#define SUPPORT_QUEUE_ROW_LE 'u'
+#define SUPPORT_EXP_QUEUE_ROW_LE 'x'
+// the name history rows as written before they could be deltas (see CClaimTrie::UpgradeNameHistory)
+#define TRIE_NAME_HISTORY_V1 'v'
+
+/** Number of heights from the next block on whose queue rows are read ahead together (see CClaimTrie::ReadQueueRow) */
+static const int QUEUE_WINDOW_HEIGHTS = 128;
+/** Maximum number of threads hashing claim trie subtrees concurrently */
+static const int MAX_CLAIMTRIE_HASH_THREADS = 16;
+/** -parclaimtrie default (number of claim trie hashing threads, 0 = as many as cores) */
+static const int DEFAULT_CLAIMTRIE_HASH_THREADS = 0;
+/** Number of name proofs kept for the current trie (see getnameproof) */
+static const std::size_t MAX_CLAIMTRIE_PROOFS = 10000;
+/** -claimtriehistory default (number of blocks the claim trie history goes back, 0 = all of them) */
+static const int DEFAULT_CLAIMTRIE_HISTORY = 0;
+
+extern int nClaimTrieHashThreads;
+extern int nClaimTrieHistoryBlocks;
+
+/** Run an instance of the claim trie hashing worker */
+void ThreadClaimTrieHash();
 
 uint256 getValueHash(const COutPoint& outPoint, int nHeightOfLastTakeover);
 
+// CLAIM_BY_ID_HEX keys hold the claim id bytes in the order of its hex form, so that
+// the ids starting with some hex digits are one range of the index; applying it twice gives the id back
+uint160 claimIdHexKey(const uint160& claimId);
+
+/**
+ * The height in the key of a height keyed queue row (CLAIM_QUEUE_ROW and the like): big endian,
+ * so that the rows of a run of heights are one range of db and one cursor reads them all.
+ */
+struct CQueueHeight
+{
+    int nHeight = 0;
+
+    CQueueHeight() = default;
+    explicit CQueueHeight(int nHeight) : nHeight(nHeight)
+    {
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        uint8_t bytes[4];
+        WriteBE32(bytes, uint32_t(nHeight));
+        s.write((char*)bytes, sizeof(bytes));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        uint8_t bytes[4];
+        s.read((char*)bytes, sizeof(bytes));
+        nHeight = int(ReadBE32(bytes));
+    }
+};
+
+/**
+ * The height in a TRIE_NAME_HISTORY key: big endian and inverted, so that the rows of a name
+ * run from the newest to the oldest and seeking to a height finds the row in effect there.
+ */
+struct CHistoryHeight
+{
+    int nHeight = 0;
+
+    CHistoryHeight() = default;
+    explicit CHistoryHeight(int nHeight) : nHeight(nHeight)
+    {
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        uint8_t bytes[4];
+        WriteBE32(bytes, ~uint32_t(nHeight));
+        s.write((char*)bytes, sizeof(bytes));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        uint8_t bytes[4];
+        s.read((char*)bytes, sizeof(bytes));
+        nHeight = int(~ReadBE32(bytes));
+    }
+};
+
 struct CClaimValue
 {
     COutPoint outPoint;
@@ -139,6 +242,7 @@ struct CClaimTrieData
     uint256 hash;
     claimEntryType claims;
     int nHeightOfLastTakeover = 0;
+    bool fPagedOut = false; // only the hash is in memory, see CClaimTrie::pageIn
 
     CClaimTrieData() = default;
     CClaimTrieData(CClaimTrieData&&) = default;
@@ -146,10 +250,13 @@ struct CClaimTrieData
     CClaimTrieData& operator=(CClaimTrieData&&) = default;
     CClaimTrieData& operator=(const CClaimTrieData& d) = default;
 
-    bool insertClaim(const CClaimValue& claim);
+    // claims are kept in bid order; insertClaim takes the effective amount of the claim from supports
+    bool insertClaim(const CClaimValue& claim, const supportEntryType& supports = {});
     bool removeClaim(const COutPoint& outPoint, CClaimValue& claim);
     bool getBestClaim(CClaimValue& claim) const;
     bool haveClaim(const COutPoint& outPoint) const;
+    // moves the claims of claimId to their bid after a support of nAmount came (or went, when negative)
+    void addSupportAmount(const uint160& claimId, CAmount nAmount);
     void reorderClaims(const supportEntryType& support);
 
     ADD_SERIALIZE_METHODS;
@@ -185,7 +292,7 @@ struct CClaimTrieData
 
     bool empty() const
     {
-        return claims.empty();
+        return claims.empty() && !fPagedOut;
     }
 };
 
@@ -343,35 +450,244 @@ struct CClaimSupportToName
     const std::vector<CSupportValue> unmatchedSupports;
 };
 
-class CClaimTrie : public CPrefixTrie<std::string, CClaimTrieData>
+// everything the trie holds for one name, active and queued; the rows of the name history
+struct CClaimNameState
+{
+    claimEntryType claims;
+    int nHeightOfLastTakeover = 0;
+    supportEntryType supports;
+    claimEntryType queuedClaims;
+    supportEntryType queuedSupports;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(claims);
+        READWRITE(nHeightOfLastTakeover);
+        READWRITE(supports);
+        READWRITE(queuedClaims);
+        READWRITE(queuedSupports);
+    }
+
+    bool operator==(const CClaimNameState& other) const
+    {
+        return nHeightOfLastTakeover == other.nHeightOfLastTakeover && claims == other.claims && supports == other.supports
+            && queuedClaims == other.queuedClaims && queuedSupports == other.queuedSupports;
+    }
+
+    bool operator!=(const CClaimNameState& other) const
+    {
+        return !(*this == other);
+    }
+
+    bool empty() const
+    {
+        return claims.empty() && supports.empty() && queuedClaims.empty() && queuedSupports.empty();
+    }
+
+    // the claims and their supports as seen by the block at nNextHeight
+    CClaimSupportToName getClaimsForName(const std::string& name, int nNextHeight) const;
+};
+
+// Rows flushed from caches but not written to db yet (see CClaimTrie::WritePending), by their
+// serialized key so that they sort the way db does. An erased row has no value.
+typedef std::map<std::string, std::shared_ptr<const std::string>> pendingRowsType;
+
+template <typename T>
+std::string serializeRow(const T& obj)
+{
+    CDataStream ssRow(SER_DISK, CLIENT_VERSION);
+    ssRow << obj;
+    return std::string(ssRow.begin(), ssRow.end());
+}
+
+template <typename T>
+bool unserializeRow(const std::string& row, T& obj)
+{
+    try {
+        CDataStream ssRow(row.data(), row.data() + row.size(), SER_DISK, CLIENT_VERSION);
+        ssRow >> obj;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The pending rows in layers, the newest on top, a row hiding those of its key in the layers
+ * below. A layer a read view can see is never changed again: the next flush puts a layer of
+ * its own rows over it rather than copying it (see CClaimTrie::applyPending).
+ */
+struct CPendingLayer
+{
+    pendingRowsType rows;
+    std::shared_ptr<const CPendingLayer> below;
+    std::size_t nUsage = 0; // that of rows, see PENDING_ROW_OVERHEAD
+
+    // the row of the newest layer from this one down that has key, null if none has
+    const std::shared_ptr<const std::string>* find(const std::string& key) const;
+    bool empty() const
+    {
+        return rows.empty() && !below;
+    }
+};
+
+// what a flush changes, applied to the pending rows as a whole
+class CPendingBatch
 {
 public:
-    CClaimTrie() = default;
-    virtual ~CClaimTrie() = default;
-    CClaimTrie(CClaimTrie&&) = delete;
-    CClaimTrie(const CClaimTrie&) = delete;
-    CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor = 32, std::size_t cacheMB=200);
+    template <typename K, typename V>
+    void Write(const K& key, const V& value)
+    {
+        auto ssKey = serializeRow(key);
+        auto row = std::make_shared<const std::string>(serializeRow(value));
+        nSizeEstimate += ssKey.size() + row->size();
+        rows[std::move(ssKey)] = std::move(row);
+    }
 
-    CClaimTrie& operator=(CClaimTrie&&) = delete;
-    CClaimTrie& operator=(const CClaimTrie&) = delete;
+    template <typename K>
+    void Erase(const K& key)
+    {
+        auto ssKey = serializeRow(key);
+        nSizeEstimate += ssKey.size();
+        rows[std::move(ssKey)] = nullptr;
+    }
 
-    bool SyncToDisk();
+    std::size_t SizeEstimate() const
+    {
+        return nSizeEstimate;
+    }
 
-    friend class CClaimTrieCacheBase;
-    friend struct ClaimTrieChainFixture;
-    friend class CClaimTrieCacheExpirationFork;
-    friend class CClaimTrieCacheNormalizationFork;
-    friend bool getClaimById(const uint160&, std::string&, CClaimValue*);
-    friend bool getClaimById(const std::string&, std::string&, CClaimValue*);
+    pendingRowsType rows;
 
-    std::size_t getTotalNamesInTrie() const;
-    std::size_t getTotalClaimsInTrie() const;
-    CAmount getTotalValueOfClaimsInTrie(bool fControllingOnly) const;
+private:
+    std::size_t nSizeEstimate = 0;
+};
 
-protected:
-    int nNextHeight = 0;
-    int nProportionalDelayFactor = 0;
-    std::unique_ptr<CDBWrapper> db;
+// iterates db and the layers of pending rows together, the newest row winning where several have the key
+class CPendingRowsIterator
+{
+public:
+    CPendingRowsIterator(CDBIterator* piter, const CPendingLayer& pending);
+
+    bool Valid() const;
+    void SeekToFirst();
+    void Next();
+
+    template <typename K>
+    void Seek(const K& key)
+    {
+        piter->Seek(key);
+        const auto ssKey = serializeRow(key);
+        for (auto& layer : layers)
+            layer.second = layer.first->lower_bound(ssKey);
+        settle();
+    }
+
+    template <typename K>
+    bool GetKey(K& key)
+    {
+        return fPending ? unserializeRow(layers[nLayer].second->first, key) : piter->GetKey(key);
+    }
+
+    template <typename V>
+    bool GetValue(V& value)
+    {
+        return fPending ? unserializeRow(*layers[nLayer].second->second, value) : piter->GetValue(value);
+    }
+
+private:
+    std::unique_ptr<CDBIterator> piter;
+    // the rows of every layer, the newest first, each at its next row
+    std::vector<std::pair<const pendingRowsType*, pendingRowsType::const_iterator>> layers;
+    std::size_t nLayer = 0;
+    bool fPending = false; // whether the current row is that of layers[nLayer] rather than piter
+
+    void settle();
+};
+
+// db (a CDBWrapper or a CDBSnapshot) as if the pending rows had been written to it
+template <typename DB>
+class CPendingRows
+{
+public:
+    CPendingRows(const DB& db, const CPendingLayer& pending) : db(db), pending(pending)
+    {
+    }
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const
+    {
+        auto row = pending.find(serializeRow(key));
+        if (!row)
+            return db.Read(key, value);
+        return *row && unserializeRow(**row, value);
+    }
+
+    template <typename K>
+    bool Exists(const K& key) const
+    {
+        auto row = pending.find(serializeRow(key));
+        return row ? bool(*row) : db.Exists(key);
+    }
+
+    CPendingRowsIterator* NewIterator() const
+    {
+        return new CPendingRowsIterator(db.NewIterator(), pending);
+    }
+
+private:
+    const DB& db;
+    const CPendingLayer& pending;
+};
+
+// what the gettotal* RPCs report; flush keeps it up to date with the nodes it writes
+struct CClaimTrieTotals
+{
+    uint64_t nNames = 0;
+    uint64_t nClaims = 0;
+    CAmount nValue = 0;
+    CAmount nControllingValue = 0; // of the first claim of every name
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nNames);
+        READWRITE(nClaims);
+        READWRITE(nValue);
+        READWRITE(nControllingValue);
+    }
+
+    bool operator==(const CClaimTrieTotals& other) const
+    {
+        return nNames == other.nNames && nClaims == other.nClaims && nValue == other.nValue && nControllingValue == other.nControllingValue;
+    }
+
+    bool operator!=(const CClaimTrieTotals& other) const
+    {
+        return !(*this == other);
+    }
+
+    // sign is 1 for a node that was added and -1 for one that was removed
+    void add(const CClaimTrieData& data, int sign);
+};
+
+// microseconds spent on each stage of the claim trie work of a block, see getclaimtrietimings
+struct CClaimTrieTimings
+{
+    int64_t nTimeScripts = 0;   // claim scripts of the transactions (UpdateCache)
+    int64_t nTimeQueues = 0;    // activating and expiring queued claims and supports
+    int64_t nTimeTakeovers = 0; // deciding which names changed hands
+    int64_t nTimeMerkle = 0;
+    int64_t nTimeFlush = 0;
+    uint64_t nFlushBytes = 0;   // rows handed to the trie by flush
+    uint64_t nBlocks = 0;       // connected and disconnected
+
+    CClaimTrieTimings& operator+=(const CClaimTrieTimings& other);
 };
 
 struct CClaimTrieProofNode
@@ -406,6 +722,149 @@ struct CClaimTrieProof
     COutPoint outPoint;
 };
 
+class CClaimTrieReadView;
+
+class CClaimTrie : public CPrefixTrie<std::string, CClaimTrieData>
+{
+public:
+    CClaimTrie() = default;
+    virtual ~CClaimTrie() = default;
+    CClaimTrie(CClaimTrie&&) = delete;
+    CClaimTrie(const CClaimTrie&) = delete;
+    CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor = 32, std::size_t cacheMB=200, std::size_t nodeCacheBytes=0);
+
+    CClaimTrie& operator=(CClaimTrie&&) = delete;
+    CClaimTrie& operator=(const CClaimTrie&) = delete;
+
+    // Writes the rows flushed since the last call to db, together with the block they are the
+    // trie of (see LoadClaimTrie). A null hashBlock leaves the trie unattached to a block.
+    bool WritePending(const uint256& hashBlock, bool fSync = false);
+    std::size_t PendingMemoryUsage() const;
+    bool GetBestBlock(uint256& hashBlock) const;
+
+    bool WriteCleanShutdown();
+    void SetVerified();
+
+    // Replaces the rows of db with those of a snapshot of the trie as of hashBlock (see
+    // CClaimTrieReadView::writeSnapshot). The rows are checked against the block by ReadFromDisk.
+    bool LoadSnapshot(const fs::path& path, const uint256& hashBlock);
+    // the block a snapshot is of, from its header
+    static bool ReadSnapshotBlock(const fs::path& path, uint256& hashBlock, int& nHeight);
+    // Erases every row of db, leaving the trie of no block at all (see RebuildClaimTrie).
+    bool Wipe();
+
+    friend class CClaimTrieCacheBase;
+    friend struct ClaimTrieChainFixture;
+    friend class CClaimTrieCacheExpirationFork;
+    friend class CClaimTrieCacheNormalizationFork;
+    friend class CClaimTrieCacheHashFork;
+
+    std::size_t getTotalNamesInTrie() const;
+    std::size_t getTotalClaimsInTrie() const;
+    CAmount getTotalValueOfClaimsInTrie(bool fControllingOnly) const;
+
+    // Calls callback with the names that have claims under prefix and, when given, after *after, in
+    // the order of the trie (that of std::string) until it returns false. Subtrees out of that range
+    // aren't visited. Paged out nodes are only read from db when fClaims asks for their claims.
+    void iterateNames(const std::string& prefix, const std::string* after, bool fClaims,
+        const std::function<bool(const std::string&, const CClaimTrieData&)>& callback);
+
+    void clear();
+
+    std::shared_ptr<const CClaimTrieReadView> getReadView() const;
+
+    // Reads the queue row of dbkey at key as the pending rows and db have it.
+    template <typename K, typename V>
+    bool ReadQueueRow(uint8_t dbkey, const K& key, V& row) const
+    {
+        return rows().Read(std::make_pair(dbkey, key), row);
+    }
+
+    // The height keyed rows of the next QUEUE_WINDOW_HEIGHTS heights are read ahead, all of those
+    // of dbkey with one cursor, rather than with a lookup for each height a block gets to.
+    template <typename V>
+    bool ReadQueueRow(uint8_t dbkey, int nHeight, V& row) const
+    {
+        std::string value;
+        return readQueueWindow(dbkey, nHeight, value) && unserializeRow(value, row);
+    }
+
+    // moves the queue rows written before CQueueHeight (CLAIM_QUEUE_ROW_LE and the like) to their keys
+    bool UpgradeQueueRows();
+    // moves the name history rows written before the deltas (TRIE_NAME_HISTORY_V1) to their keys, as full rows
+    bool UpgradeNameHistory();
+
+protected:
+    int nNextHeight = 0;
+    int nProportionalDelayFactor = 0;
+    std::unique_ptr<CDBWrapper> db;
+
+    // Flushes apply to these, db is only written by WritePending. A read view shares the layers
+    // of its time, the top one is only changed in place while no view holds it.
+    std::shared_ptr<CPendingLayer> pending = std::make_shared<CPendingLayer>();
+    std::size_t nPendingUsage = 0;
+    mutable CCriticalSection cs_pending;
+    void applyPending(pendingRowsType&& rows, int nNewNextHeight);
+    CPendingRows<CDBWrapper> rows() const;
+
+    // The rows of a window (null where a height has none) cover [nBegin, nEnd) of their row type;
+    // applyPending keeps them in step with the rows it changes.
+    struct CQueueWindow
+    {
+        int nBegin = 0;
+        int nEnd = 0;
+        std::unordered_map<int, std::shared_ptr<const std::string>> rows;
+    };
+    mutable std::map<uint8_t, CQueueWindow> queueWindows;
+    mutable CCriticalSection cs_queueWindows;
+    bool readQueueWindow(uint8_t dbkey, int nHeight, std::string& row) const;
+    void clearQueueWindows();
+
+    // whether every node was re-hashed since loading; only then may a clean shutdown be recorded
+    bool fVerified = false;
+
+    // When nNodeCacheBytes is set, the claims of the least recently used nodes are dropped
+    // from memory once that budget is exceeded. Their hash stays behind (parents need it)
+    // and the rest is read back from db the next time the node is accessed.
+    std::size_t nNodeCacheBytes = 0;
+    std::size_t nNodeCacheUsage = 0;
+    std::list<std::string> recentNodes;
+    std::unordered_map<std::string, std::pair<std::list<std::string>::iterator, std::size_t>> recentNodesIndex;
+
+    bool pageIn(const const_iterator& it);
+    void pageOut(const const_iterator& it);
+    void touch(const std::string& name, const CClaimTrieData& data);
+    void trim();
+
+    // The image is a memory mapped copy of the trie layout written on clean shutdown.
+    // Loading it skips the scan of db; the claims themselves are paged in from db.
+    fs::path imagePath;
+    bool WriteImage(const uint256& hash, int height) const;
+    bool ReadImage(const uint256& hash, int height);
+
+    // fills CLAIM_BY_ID_HEX from CLAIM_BY_ID for databases written before it existed
+    bool BuildClaimIdHexIndex();
+
+    // the history holds the state after every block from nHistoryStart - 1 on, -1 if there is none
+    std::atomic<int> nHistoryStart{-1};
+    bool getNameStateAt(const std::string& name, int nHeight, CClaimNameState& state) const;
+
+    // as of the last flush; recounted from the nodes only for databases written before TRIE_TOTALS
+    CClaimTrieTotals totals;
+    CClaimTrieTotals countTotals();
+
+    // made by getReadView on first use after a change, under cs_pending
+    mutable std::shared_ptr<const CClaimTrieReadView> readView;
+    void publishReadView();
+
+    // Proofs handed out for the trie of proofsRoot (see CClaimTrieCacheHashFork::getProofForName).
+    // Dirtying any name changes the sibling hashes along every path, so they all go with the root.
+    uint256 proofsRoot;
+    bool fProofsAllClaims = false;
+    std::map<std::pair<std::string, uint160>, CClaimTrieProof> proofs;
+    CCriticalSection cs_proofs;
+};
+
 template <typename T>
 class COptional
 {
@@ -476,6 +935,57 @@ typedef std::map<int, expirationQueueRowType> expirationQueueType;
 typedef std::set<CClaimValue> claimIndexClaimListType;
 typedef std::vector<CClaimIndexElement> claimIndexElementListType;
 
+/**
+ * The trie as the last flush left it, read from a snapshot of the claim trie database.
+ * CClaimTrie publishes a new one after every flush; a view never changes, so the read
+ * RPCs use it without cs_main for as long as they hold on to it.
+ */
+class CClaimTrieReadView
+{
+public:
+    CClaimTrieReadView(const CDBWrapper& db, std::shared_ptr<const CPendingLayer> pending, int nNextHeight, int nHistoryStart);
+
+    const int nNextHeight;
+
+    // as the block at nNextHeight would
+    std::string normalizeClaimName(const std::string& name) const;
+
+    CClaimNameState getNameState(const std::string& name) const;
+    // the name is normalized first
+    CClaimSupportToName getClaimsForName(const std::string& name) const;
+
+    bool getClaimById(const uint160& claimId, std::string& name, CClaimValue* claim = nullptr) const;
+    // the first claim whose id starts with the hex digits of partialId (and is a claim for name when that's set)
+    bool getClaimById(const std::string& partialId, std::string& name, CClaimValue* claim = nullptr) const;
+
+    CClaimTrieTotals getTotals() const;
+
+    // Writes the rows of the trie (nodes, supports, queues, the claim id indexes and the totals)
+    // to a checksummed file for CClaimTrie::LoadSnapshot; hashBlock is the block of the view.
+    bool writeSnapshot(const fs::path& path, const uint256& hashBlock, uint64_t& nRows) const;
+
+    // The name history has a row for each name every block that changed it, the changes to the
+    // row before or, every few rows, the whole state. So reading the trie as of an older block
+    // needs neither cs_main nor disconnecting blocks. These return false for the blocks before
+    // the history starts (see -claimtriehistory). iterateNamesAt visits the names in the
+    // order of their rows (the shorter names first), merging the cursors over the rows of the names
+    // for the block of the view (nNextHeight - 1) and seeking the history for the blocks before.
+    bool getNameStateAt(const std::string& name, int nHeight, CClaimNameState& state) const;
+    bool iterateNamesAt(int nHeight, const std::function<void(const std::string&, const CClaimNameState&)>& callback) const;
+    // The outputs of the claims and supports spent since the history starts are kept along with
+    // it, so that those of an older block needn't be read from the blocks that made them.
+    bool getSpentOutput(const COutPoint& outPoint, CTxOut& txout) const;
+
+private:
+    CDBSnapshot snapshot;
+    const std::shared_ptr<const CPendingLayer> pending;
+    const int nHistoryStart;
+    CPendingRows<CDBSnapshot> rows() const;
+
+    template <typename T>
+    void insertRowsFromQueue(std::vector<T>& result, const queueNameRowType& nameRows, uint8_t rowKey, const std::string& name) const;
+};
+
 class CClaimTrieCacheBase
 {
 public:
@@ -486,8 +996,8 @@ public:
 
     bool flush();
     bool empty() const;
-    bool checkConsistency() const;
-    bool ReadFromDisk(const CBlockIndex* tip);
+    bool checkConsistency(const std::string& name = std::string(), bool fRecursive = true) const;
+    bool ReadFromDisk(const CBlockIndex* tip, bool* pfCheckDeferred = nullptr);
 
     bool haveClaim(const std::string& name, const COutPoint& outPoint) const;
     bool haveClaimInQueue(const std::string& name, const COutPoint& outPoint, int& nValidAtHeight) const;
@@ -507,6 +1017,9 @@ public:
     bool spendSupport(const std::string& name, const COutPoint& outPoint, int nHeight, int& nValidAtHeight);
     bool undoSpendSupport(const std::string& name, const COutPoint& outPoint, const uint160& supportedClaimId, CAmount nAmount, int nHeight, int nValidAtHeight);
 
+    // the output of a claim or support the block spent, kept with the name history (see TRIE_SPENT_OUTPUT)
+    void addSpentOutput(const COutPoint& outPoint, const CTxOut& txout);
+
     virtual bool incrementBlock(insertUndoType& insertUndo,
         claimQueueRowType& expireUndo,
         insertUndoType& insertSupportUndo,
@@ -533,6 +1046,8 @@ public:
     void dumpToLog(CClaimTrie::const_iterator it, bool diffFromBase = true) const;
     virtual std::string adjustNameForValidHeight(const std::string& name, int validHeight) const;
 
+    CClaimTrieTimings timings; // of the work done by this cache so far
+
 protected:
     CClaimTrie* base;
     CClaimTrie nodesToAddOrUpdate; // nodes pulled in from base (and possibly modified thereafter), written to base on flush
@@ -540,7 +1055,10 @@ protected:
     std::unordered_set<std::string> namesToCheckForTakeover; // takeover numbers are updated on increment
 
     virtual uint256 recursiveComputeMerkleHash(CClaimTrie::iterator& it);
-    virtual bool recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed) const;
+    virtual bool recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed, bool fRecursive) const;
+    // hash the dirty subtrees under it on the claim trie hashing threads; it and the nodes between
+    // it and those subtrees are left to the caller
+    static void computeChildHashesInParallel(CClaimTrie::iterator& it, const std::function<void(CClaimTrie::iterator&)>& process);
 
     virtual bool insertClaimIntoTrie(const std::string& name, const CClaimValue& claim, bool fCheckTakeover);
     virtual bool removeClaimFromTrie(const std::string& name, const COutPoint& outPoint, CClaimValue& claim, bool fCheckTakeover);
@@ -549,6 +1067,14 @@ protected:
     virtual bool removeSupportFromMap(const std::string& name, const COutPoint& outPoint, CSupportValue& support, bool fCheckTakeover);
 
     supportEntryType getSupportsForName(const std::string& name) const;
+    CClaimNameState getNameState(const std::string& name) const;
+
+    // writes the history rows of the block being flushed (or erases them when it's disconnected)
+    void recordNameHistory(CPendingBatch& batch);
+    // erases the rows of the blocks more than nClaimTrieHistoryBlocks before the one at nHeight
+    void pruneNameHistory(CPendingBatch& batch, int nHeight);
+    // starts the history at the current tip for databases written before it existed
+    bool buildNameHistory();
 
     int getDelayForName(const std::string& name) const;
     virtual int getDelayForName(const std::string& name, const uint160& claimId) const;
@@ -584,6 +1110,7 @@ private:
     std::unordered_set<std::string> nodesToDelete; // to be removed from base (and disk) on flush
     std::unordered_map<std::string, bool> takeoverWorkaround;
     std::unordered_set<std::string> removalWorkaround;
+    std::vector<std::pair<COutPoint, CTxOut>> spentOutputs; // written with the name history on flush
 
     bool shouldUseTakeoverWorkaround(const std::string& key) const;
     void addTakeoverWorkaroundPotential(const std::string& key);
@@ -694,6 +1221,7 @@ public:
     // lower-case and normalize any input string name
     // see: https://unicode.org/reports/tr15/#Norm_Forms
     std::string normalizeClaimName(const std::string& name, bool force = false) const; // public only for validating name field on update op
+    static std::string normalizeName(const std::string& name); // the above, whatever the height
 
     bool incrementBlock(insertUndoType& insertUndo,
         claimQueueRowType& expireUndo,
@@ -738,6 +1266,10 @@ public:
 
     bool getProofForName(const std::string& name, CClaimTrieProof& proof) override;
     bool getProofForName(const std::string& name, CClaimTrieProof& proof, const std::function<bool(const CClaimValue&)>& comp);
+    // the proof of claimId, or of the best claim when it's null; base keeps it until its root changes
+    bool getProofForName(const std::string& name, const uint160& claimId, CClaimTrieProof& proof);
+    // proofs of many names; the parts of the paths they have in common are worked out once
+    bool getProofsForNames(const std::vector<std::pair<std::string, uint160>>& names, std::vector<CClaimTrieProof>& proofs);
     void initializeIncrement() override;
     bool finalizeDecrement(std::vector<std::pair<std::string, int>>& takeoverHeightUndo) override;
 
@@ -745,10 +1277,15 @@ public:
 
 protected:
     uint256 recursiveComputeMerkleHash(CClaimTrie::iterator& it) override;
-    bool recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed) const override;
+    bool recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed, bool fRecursive) const override;
 
 private:
     void copyAllBaseToCache();
+
+    // the pairs of the nodes on a path, by the key of the node after them
+    typedef std::unordered_map<std::string, std::vector<std::pair<bool, uint256>>> proofPathPairsType;
+    bool getProofForName(const std::string& name, CClaimTrieProof& proof, const std::function<bool(const CClaimValue&)>& comp, proofPathPairsType* pathPairs);
+    bool getProofForName(const std::string& name, const uint160& claimId, CClaimTrieProof& proof, proofPathPairsType* pathPairs);
 };
 
 typedef CClaimTrieCacheHashFork CClaimTrieCache;
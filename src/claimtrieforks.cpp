@@ -8,7 +8,9 @@
 #include <boost/locale/conversion.hpp>
 #include <boost/locale/localization_backend.hpp>
 #include <boost/scope_exit.hpp>
-#include <boost/scoped_ptr.hpp>
+
+#include <cstring>
+#include <unordered_map>
 
 CClaimTrieCacheExpirationFork::CClaimTrieCacheExpirationFork(CClaimTrie* base)
     : CClaimTrieCacheBase(base)
@@ -72,12 +74,12 @@ bool CClaimTrieCacheExpirationFork::forkForExpirationChange(bool increment)
     */
 
     //look through db for expiration queues, if we haven't already found it in dirty expiration queue
-    boost::scoped_ptr<CDBIterator> pcursor(base->db->NewIterator());
+    std::unique_ptr<CPendingRowsIterator> pcursor(base->rows().NewIterator());
     for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
-        std::pair<uint8_t, int> key;
+        std::pair<uint8_t, CQueueHeight> key;
         if (!pcursor->GetKey(key))
             continue;
-        int height = key.second;
+        int height = key.second.nHeight;
         if (key.first == CLAIM_EXP_QUEUE_ROW) {
             expirationQueueRowType row;
             if (pcursor->GetValue(row)) {
@@ -103,23 +105,51 @@ bool CClaimTrieCacheNormalizationFork::shouldNormalize() const
     return nNextHeight > Params().GetConsensus().nNormalizedNameForkHeight;
 }
 
-std::string CClaimTrieCacheNormalizationFork::normalizeClaimName(const std::string& name, bool force) const
+static const std::locale& utf8Locale()
 {
-    if (!force && !shouldNormalize())
-        return name;
-
-    static std::locale utf8;
-    static bool initialized = false;
-    if (!initialized) {
+    // initialized once even with several threads normalizing (see CClaimTrieReadView)
+    static const std::locale utf8 = []() {
         static boost::locale::localization_backend_manager manager =
             boost::locale::localization_backend_manager::global();
         manager.select("icu");
 
         static boost::locale::generator curLocale(manager);
-        utf8 = curLocale("en_US.UTF8");
-        initialized = true;
+        return curLocale("en_US.UTF8");
+    }();
+    return utf8;
+}
+
+std::string CClaimTrieCacheNormalizationFork::normalizeClaimName(const std::string& name, bool force) const
+{
+    if (!force && !shouldNormalize())
+        return name;
+    return normalizeName(name);
+}
+
+// whether name is 7-bit only, looked at a word at a time
+static bool isAscii(const std::string& name)
+{
+    const char* data = name.data();
+    auto size = name.size();
+    uint64_t bits = 0;
+    for (; size >= sizeof(bits); data += sizeof(bits), size -= sizeof(bits)) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        bits |= word;
     }
+    for (; size > 0; ++data, --size)
+        bits |= uint8_t(*data);
+    return (bits & 0x8080808080808080ULL) == 0;
+}
+
+// names outside of ASCII normalized so far, dropped all at once when there are too many
+static const std::size_t MAX_NORMALIZED_NAMES = 10000;
+static CCriticalSection cs_normalizedNames;
+static std::unordered_map<std::string, std::string> normalizedNames; // guarded by cs_normalizedNames
 
+static std::string normalizeNameICU(const std::string& name)
+{
+    auto& utf8 = utf8Locale();
     std::string normalized;
     try {
         // Check if it is a valid utf-8 string. If not, it will throw a
@@ -144,6 +174,31 @@ std::string CClaimTrieCacheNormalizationFork::normalizeClaimName(const std::stri
     return normalized;
 }
 
+std::string CClaimTrieCacheNormalizationFork::normalizeName(const std::string& name)
+{
+    // NFD leaves ASCII as it is and case folding only lowers A to Z
+    if (isAscii(name)) {
+        std::string normalized(name);
+        for (auto& c : normalized)
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+        return normalized;
+    }
+
+    {
+        LOCK(cs_normalizedNames);
+        auto it = normalizedNames.find(name);
+        if (it != normalizedNames.end())
+            return it->second;
+    }
+    auto normalized = normalizeNameICU(name);
+    LOCK(cs_normalizedNames);
+    if (normalizedNames.size() >= MAX_NORMALIZED_NAMES)
+        normalizedNames.clear();
+    normalizedNames.emplace(name, normalized);
+    return normalized;
+}
+
 bool CClaimTrieCacheNormalizationFork::insertClaimIntoTrie(const std::string& name, const CClaimValue& claim, bool fCheckTakeover)
 {
     return CClaimTrieCacheExpirationFork::insertClaimIntoTrie(normalizeClaimName(name, overrideInsertNormalization), claim, fCheckTakeover);
@@ -303,21 +358,27 @@ uint256 CClaimTrieCacheHashFork::recursiveComputeMerkleHash(CClaimTrie::iterator
         assert(!it->hash.IsNull());
         return it->hash;
     };
+    computeChildHashesInParallel(it, [&process](iterator& child) { process(child); });
     return process(it);
 }
 
-bool CClaimTrieCacheHashFork::recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed) const
+bool CClaimTrieCacheHashFork::recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed, bool fRecursive) const
 {
     if (nNextHeight < Params().GetConsensus().nAllClaimsInMerkleForkHeight)
-        return CClaimTrieCacheNormalizationFork::recursiveCheckConsistency(it, failed);
+        return CClaimTrieCacheNormalizationFork::recursiveCheckConsistency(it, failed, fRecursive);
 
     struct CRecursiveBreak {};
     using iterator = CClaimTrie::const_iterator;
-    iCbType<iterator> process = [&failed, &process](iterator& it) -> uint256 {
-        if (it->hash.IsNull() || it->hash != recursiveBinaryTreeHash(it, process)) {
+    const auto start = it.key();
+    iCbType<iterator> process = [this, &failed, &process, &start, fRecursive](iterator& it) -> uint256 {
+        if (!fRecursive && it.key() != start)
+            return it->hash;
+        const auto paged = it->fPagedOut;
+        if (!base->pageIn(it) || it->hash.IsNull() || it->hash != recursiveBinaryTreeHash(it, process)) {
             failed = it.key();
             throw CRecursiveBreak();
         }
+        if (paged) base->pageOut(it);
         return it->hash;
     };
 
@@ -390,10 +451,77 @@ bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTri
 }
 
 bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTrieProof& proof, const std::function<bool(const CClaimValue&)>& comp)
+{
+    return getProofForName(name, proof, comp, nullptr);
+}
+
+bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, const uint160& claimId, CClaimTrieProof& proof)
+{
+    return getProofForName(name, claimId, proof, nullptr);
+}
+
+bool CClaimTrieCacheHashFork::getProofsForNames(const std::vector<std::pair<std::string, uint160>>& names, std::vector<CClaimTrieProof>& proofs)
+{
+    proofPathPairsType pathPairs;
+    proofs.clear();
+    proofs.reserve(names.size());
+    for (auto& name : names) {
+        proofs.emplace_back();
+        if (!getProofForName(name.first, name.second, proofs.back(), &pathPairs))
+            return false;
+    }
+    return true;
+}
+
+bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, const uint160& claimId, CClaimTrieProof& proof, proofPathPairsType* pathPairs)
+{
+    // the proof is a function of the root hash (which commits to every node and claim) and the format;
+    // spellings of a name that normalize the same share it
+    const auto root = getMerkleHash();
+    const bool fAllClaims = nNextHeight >= Params().GetConsensus().nAllClaimsInMerkleForkHeight;
+    const auto key = std::make_pair(normalizeClaimName(name), claimId);
+    {
+        LOCK(base->cs_proofs);
+        if (base->proofsRoot == root && base->fProofsAllClaims == fAllClaims) {
+            auto it = base->proofs.find(key);
+            if (it != base->proofs.end()) {
+                proof = it->second;
+                return true;
+            }
+        }
+    }
+
+    std::function<bool(const CClaimValue&)> comp;
+    if (!claimId.IsNull())
+        comp = [&claimId](const CClaimValue& claim) {
+            return claim.claimId == claimId;
+        };
+    if (!getProofForName(key.first, proof, comp, pathPairs))
+        return false;
+
+    // only the tip is worth keeping, caches rolled back for older blocks would just push it out
+    if (nNextHeight != base->nNextHeight)
+        return true;
+
+    LOCK(base->cs_proofs);
+    if (base->proofsRoot != root || base->fProofsAllClaims != fAllClaims || base->proofs.size() >= MAX_CLAIMTRIE_PROOFS) {
+        base->proofs.clear();
+        base->proofsRoot = root;
+        base->fProofsAllClaims = fAllClaims;
+    }
+    base->proofs.emplace(key, proof);
+    return true;
+}
+
+bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTrieProof& proof, const std::function<bool(const CClaimValue&)>& comp, proofPathPairsType* pathPairs)
 {
     if (nNextHeight < Params().GetConsensus().nAllClaimsInMerkleForkHeight)
         return CClaimTrieCacheNormalizationFork::getProofForName(name, proof);
 
+    const auto normalized = normalizeClaimName(name);
+    if (normalized != name)
+        return getProofForName(normalized, proof, comp, pathPairs);
+
     auto fillPairs = [&proof](const std::vector<uint256>& hashes, uint32_t idx) {
         auto partials = ComputeMerklePath(hashes, idx);
         for (int i = partials.size() - 1; i >= 0; --i)
@@ -404,7 +532,20 @@ bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTri
     cacheData(name, false);
     getMerkleHash();
     proof = CClaimTrieProof();
-    for (auto& it : static_cast<const CClaimTrie&>(nodesToAddOrUpdate).nodes(name)) {
+    auto nodes = static_cast<const CClaimTrie&>(nodesToAddOrUpdate).nodes(name);
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        auto& it = nodes[i];
+        // the pairs of a node above name only depend on the child the path goes on to
+        const std::string* next = i + 1 < nodes.size() ? &nodes[i + 1].key() : nullptr;
+        if (next && pathPairs) {
+            auto pit = pathPairs->find(*next);
+            if (pit != pathPairs->end()) {
+                proof.pairs.insert(proof.pairs.end(), pit->second.begin(), pit->second.end());
+                continue;
+            }
+        }
+        const auto nPairs = proof.pairs.size();
+
         std::vector<uint256> childHashes;
         uint32_t nextCurrentIdx = 0;
         for (auto& child : it.children()) {
@@ -439,6 +580,8 @@ bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTri
             proof.pairs.emplace_back(false, hash);
             if (!childHashes.empty())
                 fillPairs(childHashes, nextCurrentIdx);
+            if (next && pathPairs)
+                pathPairs->emplace(*next, std::vector<std::pair<bool, uint256>>(proof.pairs.begin() + nPairs, proof.pairs.end()));
         }
     }
     std::reverse(proof.pairs.begin(), proof.pairs.end());
@@ -447,9 +590,14 @@ bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTri
 
 void CClaimTrieCacheHashFork::copyAllBaseToCache()
 {
-    for (auto it = base->cbegin(); it != base->cend(); ++it)
-        if (nodesAlreadyCached.insert(it.key()).second)
+    for (auto it = base->cbegin(); it != base->cend(); ++it) {
+        if (nodesAlreadyCached.insert(it.key()).second) {
+            const auto paged = it->fPagedOut;
+            base->pageIn(it);
             nodesToAddOrUpdate.insert(it.key(), it.data());
+            if (paged) base->pageOut(it);
+        }
+    }
 
     for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it)
         it->hash.SetNull();
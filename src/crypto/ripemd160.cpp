@@ -6,8 +6,19 @@
 
 #include <crypto/common.h>
 
+#include <assert.h>
 #include <string.h>
 
+namespace ripemd160_32_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace ripemd160_32_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -233,10 +244,66 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[4] = t + b1 + c2;
 }
 
+/** Compute the RIPEMD-160 of a 32-byte input, in a single padded chunk. */
+void Transform32(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[5];
+    unsigned char chunk[64] = {0};
+    memcpy(chunk, in, 32);
+    chunk[32] = 0x80;
+    chunk[57] = 0x01; // 256 bits
+    Initialize(s);
+    Transform(s, chunk);
+    for (int i = 0; i < 5; ++i)
+        WriteLE32(out + 4 * i, s[i]);
+}
+
 } // namespace ripemd160
 
+typedef void (*Transform32Type)(unsigned char*, const unsigned char*);
+
+Transform32Type Transform32_4way = nullptr;
+Transform32Type Transform32_8way = nullptr;
+
+bool SelfTest()
+{
+    unsigned char in[16 * 32], out[16 * 20], expected[20];
+    for (int i = 0; i < 16 * 32; ++i)
+        in[i] = i * 7 + 1;
+    // one of each width
+    RIPEMD160_32(out, in, 15);
+    for (int i = 0; i < 15; ++i) {
+        CRIPEMD160().Write(in + 32 * i, 32).Finalize(expected);
+        if (memcmp(out + 20 * i, expected, 20))
+            return false;
+    }
+    return true;
+}
+
 } // namespace
 
+std::string RIPEMD160AutoDetect()
+{
+    std::string ret = "standard";
+#if !defined(BUILD_BITCOIN_INTERNAL) && defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#if defined(ENABLE_SSE41)
+    if (__builtin_cpu_supports("sse4.1")) {
+        Transform32_4way = ripemd160_32_sse41::Transform_4way;
+        ret = "sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        Transform32_8way = ripemd160_32_avx2::Transform_8way;
+        ret += Transform32_4way ? ",avx2(8way)" : "avx2(8way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
 ////// RIPEMD160
 
 CRIPEMD160::CRIPEMD160() : bytes(0)
@@ -290,3 +357,29 @@ CRIPEMD160& CRIPEMD160::Reset()
     ripemd160::Initialize(s);
     return *this;
 }
+
+void RIPEMD160_32(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (Transform32_8way) {
+        while (blocks >= 8) {
+            Transform32_8way(out, in);
+            out += 160;
+            in += 256;
+            blocks -= 8;
+        }
+    }
+    if (Transform32_4way) {
+        while (blocks >= 4) {
+            Transform32_4way(out, in);
+            out += 80;
+            in += 128;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        ripemd160::Transform32(out, in);
+        out += 20;
+        in += 32;
+        --blocks;
+    }
+}
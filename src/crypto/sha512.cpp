@@ -6,8 +6,14 @@
 
 #include <crypto/common.h>
 
+#include <assert.h>
 #include <string.h>
 
+namespace sha512_32_avx2
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -144,10 +150,57 @@ void Transform(uint64_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Compute the SHA-512 of a 32-byte input, in a single padded chunk. */
+void Transform32(unsigned char* out, const unsigned char* in)
+{
+    uint64_t s[8];
+    unsigned char chunk[128] = {0};
+    memcpy(chunk, in, 32);
+    chunk[32] = 0x80;
+    chunk[126] = 0x01; // 256 bits
+    Initialize(s);
+    Transform(s, chunk);
+    for (int i = 0; i < 8; ++i)
+        WriteBE64(out + 8 * i, s[i]);
+}
+
 } // namespace sha512
 
+typedef void (*Transform32Type)(unsigned char*, const unsigned char*);
+
+Transform32Type Transform32_4way = nullptr;
+
+bool SelfTest()
+{
+    unsigned char in[8 * 32], out[8 * 64], expected[64];
+    for (int i = 0; i < 8 * 32; ++i)
+        in[i] = i * 7 + 1;
+    // one of each width
+    SHA512_32(out, in, 7);
+    for (int i = 0; i < 7; ++i) {
+        CSHA512().Write(in + 32 * i, 32).Finalize(expected);
+        if (memcmp(out + 64 * i, expected, 64))
+            return false;
+    }
+    return true;
+}
+
 } // namespace
 
+std::string SHA512AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL) && defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    if (__builtin_cpu_supports("avx2")) {
+        Transform32_4way = sha512_32_avx2::Transform_4way;
+        ret = "avx2(4way)";
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
 
 ////// SHA-512
 
@@ -205,3 +258,21 @@ CSHA512& CSHA512::Reset()
     sha512::Initialize(s);
     return *this;
 }
+
+void SHA512_32(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (Transform32_4way) {
+        while (blocks >= 4) {
+            Transform32_4way(out, in);
+            out += 256;
+            in += 128;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        sha512::Transform32(out, in);
+        out += 64;
+        in += 32;
+        --blocks;
+    }
+}
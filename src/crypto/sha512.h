@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-512. */
 class CSHA512
@@ -25,4 +26,16 @@ public:
     CSHA512& Reset();
 };
 
+/** Autodetect the best available implementation of SHA512_32.
+ *  Returns the name of the implementation.
+ */
+std::string SHA512AutoDetect();
+
+/** Compute multiple SHA512's of 32-byte blobs.
+ *  output:  pointer to a blocks*64 byte output buffer
+ *  input:   pointer to a blocks*32 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA512_32(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA512_H
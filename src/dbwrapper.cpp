@@ -242,6 +242,23 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper &_parent) : parent(_parent), snapshot(_parent.pdb->GetSnapshot()), readoptions(_parent.readoptions)
+{
+    readoptions.snapshot = snapshot;
+}
+
+CDBSnapshot::~CDBSnapshot()
+{
+    parent.pdb->ReleaseSnapshot(snapshot);
+}
+
+CDBIterator *CDBSnapshot::NewIterator() const
+{
+    leveldb::ReadOptions iteroptions = parent.iteroptions;
+    iteroptions.snapshot = snapshot;
+    return new CDBIterator(parent, parent.pdb->NewIterator(iteroptions));
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
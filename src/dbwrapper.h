@@ -96,6 +96,11 @@ public:
         return piter->value().size();
     }
 
+    //! Compares the current key with an already serialized one, for merging with rows kept outside the database
+    int CompareKey(const std::string& key) const {
+        return piter->key().compare(leveldb::Slice(key));
+    }
+
 };
 
 class CDBBatch;
@@ -103,6 +108,7 @@ class CDBBatch;
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -219,7 +225,7 @@ public:
 
     bool Sync();
 
-    CDBIterator *NewIterator()
+    CDBIterator *NewIterator() const
     {
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
@@ -263,6 +269,52 @@ public:
 
 };
 
+/**
+ * Read-only view of a CDBWrapper as of the moment it was created. Unlike the
+ * wrapper's own Read it keeps no shared state, so any thread may use it.
+ */
+class CDBSnapshot
+{
+private:
+    const CDBWrapper &parent;
+    const leveldb::Snapshot *snapshot;
+    leveldb::ReadOptions readoptions;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper &_parent);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+
+        std::string strValue;
+        leveldb::Status status = parent.pdb->Get(readoptions, slKey, &strValue);
+        if (!status.ok()) {
+            if (status.IsNotFound())
+                return false;
+            LogPrintf("LevelDB read failure: %s\n", status.ToString());
+            dbwrapper_private::HandleError(status);
+        }
+        try {
+            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
+            ssValue >> value;
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    CDBIterator *NewIterator() const;
+};
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -5,6 +5,9 @@
 #include <hash.h>
 #include <crypto/common.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/sha512.h>
+
+#include <algorithm>
 
 
 inline uint32_t ROTL32(uint32_t x, int8_t r)
@@ -12,42 +15,42 @@ inline uint32_t ROTL32(uint32_t x, int8_t r)
     return (x << r) | (x >> (32 - r));
 }
 
-uint256 PoWHash(const std::vector<unsigned char>& input)
-{
-    CHash256 h256;
-    CSHA512 h512;
-    CRIPEMD160 h160;
-
-    std::vector<unsigned char> out;
-    out.resize(h512.OUTPUT_SIZE);
-
-    std::vector<unsigned char> out_small;
-    out_small.resize(h160.OUTPUT_SIZE);
-
-    h256.Write(input.data(), input.size());
-    h256.Finalize(&out[0]);
-    h256.Reset();
-
-    h512.Write(out.data(), h256.OUTPUT_SIZE);
-    h512.Finalize(&out[0]);
-
-    h160.Write(out.data(), h512.OUTPUT_SIZE / 2);
-    h160.Finalize(&out_small[0]);
-    h160.Reset();
-
-    h256.Write(out_small.data(), h160.OUTPUT_SIZE);
+// as many inputs as the widest RIPEMD160_32 takes, there are two of them per PoW hash
+static const size_t POW_HASH_BATCH = 4;
 
-    h160.Write(out.data() + h512.OUTPUT_SIZE / 2, h512.OUTPUT_SIZE / 2);
-    h160.Finalize(&out_small[0]);
-
-    out.resize(h256.OUTPUT_SIZE);
-    h256.Write(out_small.data(), h160.OUTPUT_SIZE);
-    h256.Finalize(&out[0]);
+void PoWHashes(uint256* output, const unsigned char* input, size_t size, size_t count)
+{
+    // each step hashes the digests of the one before, laid out back to back
+    unsigned char digests256[POW_HASH_BATCH * CHash256::OUTPUT_SIZE];
+    unsigned char digests512[POW_HASH_BATCH * CSHA512::OUTPUT_SIZE];
+    unsigned char digests160[POW_HASH_BATCH * 2 * CRIPEMD160::OUTPUT_SIZE];
+
+    while (count) {
+        size_t n = std::min(count, POW_HASH_BATCH);
+        for (size_t i = 0; i < n; ++i)
+            CHash256().Write(input + i * size, size).Finalize(digests256 + i * CHash256::OUTPUT_SIZE);
+        SHA512_32(digests512, digests256, n);
+        // the halves of a SHA512 digest are 32 bytes each, so that these are the RIPEMD160s of both
+        RIPEMD160_32(digests160, digests512, 2 * n);
+        for (size_t i = 0; i < n; ++i)
+            CHash256().Write(digests160 + i * 2 * CRIPEMD160::OUTPUT_SIZE, 2 * CRIPEMD160::OUTPUT_SIZE).Finalize(output[i].begin());
+        input += n * size;
+        output += n;
+        count -= n;
+    }
+}
 
-    uint256 result(out);
+uint256 PoWHash(const unsigned char* input, size_t size)
+{
+    uint256 result;
+    PoWHashes(&result, input, size, 1);
     return result;
 }
 
+uint256 PoWHash(const std::vector<unsigned char>& input)
+{
+    return PoWHash(input.data(), input.size());
+}
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash)
 {
@@ -190,7 +190,12 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
     return ss.GetHash();
 }
 
+/** The LBRY proof-of-work hash: SHA256d, SHA512, RIPEMD160 of either half of that, then SHA256d of both. */
+uint256 PoWHash(const unsigned char* input, size_t size);
 uint256 PoWHash(const std::vector<unsigned char>& input);
+/** The PoWHash of count inputs of size bytes each, laid out back to back. The SHA512 and RIPEMD160 steps
+ *  of several inputs run side by side where the CPU allows (see SHA512AutoDetect and RIPEMD160AutoDetect). */
+void PoWHashes(uint256* output, const unsigned char* input, size_t size, size_t count);
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
@@ -188,7 +188,36 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq);
+            // A result written in parts goes out as a chunked reply from its first part on,
+            // wrapped the way JSONRPCReply does. Errors can't be reported once it started,
+            // the connection is dropped instead so that the client sees the reply is incomplete.
+            bool fChunked = false;
+            jreq.writeResult = [req, &fChunked](const std::string& part) {
+                if (!fChunked) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->WriteReplyStart(HTTP_OK);
+                    req->WriteReplyChunk("{\"result\":");
+                    fChunked = true;
+                }
+                if (!req->WriteReplyChunk(part))
+                    throw JSONRPCError(RPC_MISC_ERROR, "Client went away");
+            };
+
+            UniValue result;
+            try {
+                result = tableRPC.execute(jreq);
+            } catch (...) {
+                if (!fChunked)
+                    throw;
+                LogPrintf("ThreadRPCServer %s stopped in the middle of its reply to %s\n", SanitizeString(jreq.strMethod), jreq.peerAddr);
+                req->WriteReplyAbort();
+                return false;
+            }
+            if (fChunked) {
+                req->WriteReplyChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                req->WriteReplyEnd();
+                return true;
+            }
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
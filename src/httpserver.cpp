@@ -22,6 +22,9 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <future>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 #include <event2/thread.h>
 #include <event2/buffer.h>
@@ -144,6 +147,8 @@ struct evhttp* eventHTTP = nullptr;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = nullptr;
+//! Seconds a client may take to send its request or take the reply
+static int httpServerTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -388,7 +393,8 @@ bool InitHTTPServer()
         return false;
     }
 
-    evhttp_set_timeout(http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    httpServerTimeout = gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    evhttp_set_timeout(http, httpServerTimeout);
     evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, nullptr);
@@ -532,7 +538,10 @@ HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && chunkedReply) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        WriteReplyEnd();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -578,6 +587,22 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket once a reply is out. This is the second part
+ * of the libevent workaround in http_request_cb.
+ */
+static void EnableReading(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -593,23 +618,141 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
+        EnableReading(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+/** What a chunked reply shares with the closures that send it on the main http thread.
+ * If the client leaves in between, libevent frees the request with the connection; the
+ * close callback marks that so that the closures left don't touch it any more.
+ */
+struct HTTPChunkedReply
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool fClosed = false;
+    size_t nQueued = 0; // bytes the client has yet to take
+    size_t nSent = 0; // of those, the bytes handed to libevent
+};
+
+static void ChunkedReplyClosed(evhttp_connection*, void* arg)
+{
+    auto reply = static_cast<HTTPChunkedReply*>(arg);
+    {
+        std::lock_guard<std::mutex> lock(reply->mutex);
+        reply->fClosed = true;
+    }
+    reply->cond.notify_all();
+}
+
+// libevent wrote out everything it was handed, the chunks sent so far included
+static void ChunkedReplyWritten(evhttp_connection*, void* arg)
+{
+    auto reply = static_cast<HTTPChunkedReply*>(arg);
+    {
+        std::lock_guard<std::mutex> lock(reply->mutex);
+        reply->nQueued -= reply->nSent;
+        reply->nSent = 0;
+    }
+    reply->cond.notify_all();
+}
+
+static bool IsChunkedReplyClosed(const std::shared_ptr<HTTPChunkedReply>& reply)
+{
+    std::lock_guard<std::mutex> lock(reply->mutex);
+    return reply->fClosed;
+}
+
+/** The chunks go to the main http thread one closure each, in order. */
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !chunkedReply && req);
+    chunkedReply = std::make_shared<HTTPChunkedReply>();
+    auto req_copy = req;
+    auto reply = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus, reply]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn)
+            evhttp_connection_set_closecb(conn, ChunkedReplyClosed, reply.get());
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && chunkedReply && req);
+    {
+        std::unique_lock<std::mutex> lock(chunkedReply->mutex);
+        auto reply = chunkedReply.get();
+        if (!reply->cond.wait_for(lock, std::chrono::seconds(httpServerTimeout), [reply] {
+                return reply->fClosed || reply->nQueued < MAX_HTTP_CHUNKED_REPLY_QUEUE;
+            }) || reply->fClosed)
+            return false;
+        reply->nQueued += strChunk.size();
+    }
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    auto req_copy = req;
+    auto reply = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, evb, reply]{
+        if (!IsChunkedReplyClosed(reply)) {
+            {
+                std::lock_guard<std::mutex> lock(reply->mutex);
+                reply->nSent += evbuffer_get_length(evb);
             }
+            evhttp_send_reply_chunk_with_cb(req_copy, evb, ChunkedReplyWritten, reply.get());
         }
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+    return true;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(!replySent && chunkedReply && req);
+    auto req_copy = req;
+    auto reply = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, reply]{
+        if (IsChunkedReplyClosed(reply))
+            return;
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn)
+            evhttp_connection_set_closecb(conn, nullptr, nullptr);
+        // replaces ChunkedReplyWritten, which can't be called once reply is gone
+        evhttp_send_reply_end(req_copy);
+        EnableReading(req_copy);
     });
     ev->trigger(nullptr);
     replySent = true;
     req = nullptr; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyAbort()
+{
+    assert(!replySent && chunkedReply && req);
+    auto req_copy = req;
+    auto reply = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, reply]{
+        if (IsChunkedReplyClosed(reply))
+            return;
+        // without the last chunk, the client sees the reply cut short; the request goes with the connection
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn) {
+            evhttp_connection_set_closecb(conn, nullptr, nullptr);
+            evhttp_connection_free(conn);
+        }
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // freed on the main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
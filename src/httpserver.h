@@ -5,6 +5,7 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <memory>
 #include <string>
 #include <stdint.h>
 #include <functional>
@@ -12,11 +13,14 @@
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Bytes of a chunked reply the client may have yet to take before the writer waits for it */
+static const size_t MAX_HTTP_CHUNKED_REPLY_QUEUE = 16 << 20;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReply;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -59,6 +63,8 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    // set once a chunked reply started, see WriteReplyStart
+    std::shared_ptr<HTTPChunkedReply> chunkedReply;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -114,6 +120,20 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write HTTP reply in chunks, as they are made, instead of all at once.
+     * WriteReplyStart sends the status and the headers, WriteReplyChunk a part of the body
+     * (false if the client went away, there's no point in making more) and WriteReplyEnd
+     * finishes the reply like WriteReply does. WriteReplyAbort drops the connection instead,
+     * so that the client can tell the reply is incomplete.
+     * WriteReplyChunk waits while the client has more than MAX_HTTP_CHUNKED_REPLY_QUEUE bytes
+     * to take, and gives up on it (false) when it takes nothing for -rpcservertimeout.
+     */
+    void WriteReplyStart(int nStatus);
+    bool WriteReplyChunk(const std::string& strChunk);
+    void WriteReplyEnd();
+    void WriteReplyAbort();
 };
 
 /** Event handler closure.
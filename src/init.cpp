@@ -17,6 +17,8 @@
 #include <claimtrie.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/ripemd160.h>
+#include <crypto/sha512.h>
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
@@ -267,6 +269,8 @@ void Shutdown()
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
+        if (pclaimTrie && pclaimTrie->WriteCleanShutdown())
+            LogPrintf("%s: recorded a clean shutdown of the claim trie\n", __func__);
         delete pclaimTrie;
         pclaimTrie = nullptr;
     }
@@ -352,7 +356,7 @@ void SetupServerArgs()
     const auto testnetChainParams = CreateChainParams(CBaseChainParams::TESTNET);
 
     // Hidden Options
-    std::vector<std::string> hidden_args = {"-rpcssl", "-benchmark", "-h", "-help", "-socks", "-tor", "-debugnet", "-whitelistalwaysrelay",
+    std::vector<std::string> hidden_args = {"-memfile", "-rpcssl", "-benchmark", "-h", "-help", "-socks", "-tor", "-debugnet", "-whitelistalwaysrelay",
         "-prematurewitness", "-walletprematurewitness", "-promiscuousmempoolflags", "-blockminsize", "-dbcrashratio", "-forcecompactdb", "-usehd",
         // GUI args. These will be overwritten by SetupUIArgs for the GUI
         "-allowselfsignedrootcertificates", "-choosedatadir", "-lang=<lang>", "-min", "-resetguisettings", "-rootcertificates=<file>", "-splash", "-uiplatform"};
@@ -372,6 +376,9 @@ void SetupServerArgs()
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Set database cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-claimtriecache=<n>", strprintf("Set claim trie cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimtriehistory=<n>", strprintf("Keep the claim trie history (the claims of older blocks, see getclaimsforname and the like) for the last <n> blocks only (0 = all of them, else at least %u, default: %u)", MIN_BLOCKS_TO_KEEP, DEFAULT_CLAIMTRIE_HISTORY), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimtrienodecache=<n>", "Keep the claims of at most <n> megabytes of claim trie nodes in memory and read the others from disk when needed (0 = keep the whole trie in memory, default: 0)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadclaimtrie=<file>", "On startup, replace the claim trie with a snapshot of it as of a block of the chain, as written by dumpclaimtrie, and connect it from there up to the chain tip. Ignored once the trie is at the block of the snapshot or past it; the node won't start when the block isn't on its chain yet. Relative paths will be prefixed by a net-specific datadir location.", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", false, OptionsCategory::OPTIONS);
@@ -382,6 +389,8 @@ void SetupServerArgs()
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parclaimtrie=<n>", strprintf("Set the number of claim trie hashing threads (%u to %d, 0 = one per core, 1 = hash serially, <0 = leave that many cores free, default: %d)",
+        -GetNumCores(), MAX_CLAIMTRIE_HASH_THREADS, DEFAULT_CLAIMTRIE_HASH_THREADS), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), false, OptionsCategory::OPTIONS);
@@ -399,7 +408,6 @@ void SetupServerArgs()
     hidden_args.emplace_back("-sysperms");
 #endif
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), false, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-memfile=<GiB>", "Use a memory mapped file for the claimtrie allocations (default: use RAM instead)", false, OptionsCategory::OPTIONS);
 
     gArgs.AddArg("-addnode=<ip>", "Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info). This option can be specified multiple times to add multiple nodes.", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-banscore=<n>", strprintf("Threshold for disconnecting misbehaving peers (default: %u)", DEFAULT_BANSCORE_THRESHOLD), false, OptionsCategory::CONNECTION);
@@ -711,6 +719,42 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
     g_is_mempool_loaded = !ShutdownRequested();
 }
 
+/**
+ * Re-hash a claim trie that was loaded without checkConsistency (see the clean shutdown
+ * marker in CClaimTrieCacheBase::ReadFromDisk). cs_main is only held for one subtree
+ * of the root at a time so that the node keeps processing blocks meanwhile.
+ */
+static void ThreadVerifyClaimTrie()
+{
+    std::vector<std::string> names;
+    {
+        LOCK(cs_main);
+        if (auto it = pclaimTrie->find(std::string()))
+            for (auto& child : it.children())
+                names.push_back(child.key());
+    }
+
+    const int64_t nStart = GetTimeMillis();
+    bool consistent = true;
+    for (std::size_t i = 0; consistent && i <= names.size(); ++i) {
+        boost::this_thread::interruption_point();
+        LOCK(cs_main);
+        CClaimTrieCache trieCache(pclaimTrie);
+        // the root itself goes last, against the (by then verified) hashes of its children
+        consistent = i < names.size() ? trieCache.checkConsistency(names[i]) : trieCache.checkConsistency(std::string(), false);
+        if (consistent && i == names.size())
+            pclaimTrie->SetVerified();
+    }
+
+    if (!consistent) {
+        LogPrintf("%s: the claim trie is inconsistent, shutting down\n", __func__);
+        uiInterface.ThreadSafeMessageBox(_("Error: the claim trie database is corrupted. Please restart with -reindex."), "", CClientUIInterface::MSG_ERROR);
+        StartShutdown();
+        return;
+    }
+    LogPrintf("Verified the claim trie in %dms\n", GetTimeMillis() - nStart);
+}
+
 /** Sanity checks
  *  Ensure that Bitcoin is running in a usable environment with all
  *  necessary library support.
@@ -999,6 +1043,9 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-benchmark", false))
         InitWarning(_("Unsupported argument -benchmark ignored, use -debug=bench."));
 
+    if (gArgs.IsArgSet("-memfile"))
+        InitWarning(_("Unsupported argument -memfile ignored, the claim trie image is written on shutdown instead."));
+
     if (gArgs.GetBoolArg("-whitelistalwaysrelay", false))
         InitWarning(_("Unsupported argument -whitelistalwaysrelay ignored, use -whitelistrelay and/or -whitelistforcerelay."));
 
@@ -1057,6 +1104,21 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -parclaimtrie is read the same way: 0 is one thread per core and 1 hashes the trie serially,
+    // which is what nClaimTrieHashThreads==0 means
+    nClaimTrieHashThreads = gArgs.GetArg("-parclaimtrie", DEFAULT_CLAIMTRIE_HASH_THREADS);
+    if (nClaimTrieHashThreads <= 0)
+        nClaimTrieHashThreads += GetNumCores();
+    if (nClaimTrieHashThreads <= 1)
+        nClaimTrieHashThreads = 0;
+    else if (nClaimTrieHashThreads > MAX_CLAIMTRIE_HASH_THREADS)
+        nClaimTrieHashThreads = MAX_CLAIMTRIE_HASH_THREADS;
+
+    // the history has to reach back past the blocks a reorganization may disconnect
+    nClaimTrieHistoryBlocks = gArgs.GetArg("-claimtriehistory", DEFAULT_CLAIMTRIE_HISTORY);
+    if (nClaimTrieHistoryBlocks < 0 || (nClaimTrieHistoryBlocks > 0 && nClaimTrieHistoryBlocks < int(MIN_BLOCKS_TO_KEEP)))
+        return InitError(strprintf(_("-claimtriehistory must be 0 or at least %u."), MIN_BLOCKS_TO_KEEP));
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1201,6 +1263,7 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    LogPrintf("Using the '%s' SHA512 and '%s' RIPEMD160 implementations for the PoW hash\n", SHA512AutoDetect(), RIPEMD160AutoDetect());
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1266,6 +1329,12 @@ bool AppInitMain()
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    LogPrintf("Using %u threads for claim trie hashing\n", nClaimTrieHashThreads);
+    if (nClaimTrieHashThreads) {
+        for (int i=0; i<nClaimTrieHashThreads-1; i++)
+            threadGroup.create_thread(&ThreadClaimTrieHash);
+    }
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1437,9 +1506,8 @@ bool AppInitMain()
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
-    g_memfileSize = gArgs.GetArg("-memfile", 0u);
-
     bool fLoaded = false;
+    bool fClaimTrieCheckDeferred = false;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1463,7 +1531,8 @@ bool AppInitMain()
                 int64_t trieCacheMB = gArgs.GetArg("-claimtriecache", nDefaultDbCache);
                 trieCacheMB = std::min(trieCacheMB, nMaxDbCache);
                 trieCacheMB = std::max(trieCacheMB, nMinDbCache);
-                pclaimTrie = new CClaimTrie(false, fReindex || fReindexChainState, 32, trieCacheMB);
+                int64_t trieNodeCacheMB = std::max<int64_t>(gArgs.GetArg("-claimtrienodecache", 0), 0);
+                pclaimTrie = new CClaimTrie(false, fReindex || fReindexChainState, 32, trieCacheMB, trieNodeCacheMB << 20);
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1535,15 +1604,27 @@ bool AppInitMain()
                         break;
                     }
                     assert(chainActive.Tip() != nullptr);
-                }
 
-                CClaimTrieCache trieCache(pclaimTrie);
-                if (!trieCache.ReadFromDisk(chainActive.Tip()))
-                {
-                    strLoadError = _("Error loading the claim trie from disk");
+                    if (gArgs.IsArgSet("-loadclaimtrie") && !LoadClaimTrieSnapshot(AbsPathForConfigVal(gArgs.GetArg("-loadclaimtrie", "")))) {
+                        strLoadError = _("Error loading the claim trie snapshot");
+                        break;
+                    }
+                } else if (gArgs.IsArgSet("-loadclaimtrie")) {
+                    // the coins aren't in a snapshot, the blocks up to its own have to be connected first
+                    strLoadError = _("A claim trie snapshot can only be loaded once the chain has the block of the snapshot, start without -loadclaimtrie until then");
                     break;
                 }
 
+                if (!LoadClaimTrie(chainparams, &fClaimTrieCheckDeferred)) {
+                    // the blocks still have every claim, it takes a lot less than -reindex to get them back
+                    LogPrintf("The claim trie can't be used as it is on disk\n");
+                    fClaimTrieCheckDeferred = false;
+                    if (!RebuildClaimTrie(chainparams)) {
+                        strLoadError = _("Error loading the claim trie from disk");
+                        break;
+                    }
+                }
+
                 if (!fReset) {
                     // Note that RewindBlockIndex MUST run even if we're about to -reindex-chainstate.
                     // It both disconnects blocks based on chainActive, and drops block data in
@@ -1615,6 +1696,9 @@ bool AppInitMain()
         return false;
     }
 
+    if (fClaimTrieCheckDeferred)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "trieverify", &ThreadVerifyClaimTrie));
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
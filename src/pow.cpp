@@ -8,9 +8,19 @@
 
 #include <arith_uint256.h>
 #include <chain.h>
+#include <hash.h>
 #include <primitives/block.h>
 #include <uint256.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+/** Headers serialized and hashed together by the CheckProofOfWork of many headers */
+static const size_t POW_CHECK_CHUNK = 64;
+/** The fewest headers worth a thread of their own */
+static const size_t POW_CHECK_MIN_PER_THREAD = 256;
+
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     unsigned int nProofOfWorkLimit = UintToArith256(params.powLimit).GetCompact();
@@ -90,3 +100,48 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&
 
     return true;
 }
+
+// Hashes the chunks handed out by nNext, in order, lowering nInvalid to the index of the first
+// header that fails. No chunk after a known failure is handed out, so the work past the first
+// failure is at most a chunk per thread.
+static void CheckProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& params, std::atomic<size_t>& nNext, std::atomic<size_t>& nInvalid)
+{
+    unsigned char inputs[POW_CHECK_CHUNK * CBlockHeader::SERIALIZED_SIZE];
+    uint256 hashes[POW_CHECK_CHUNK];
+    for (size_t i = nNext.fetch_add(POW_CHECK_CHUNK); i < headers.size() && i < nInvalid.load(); i = nNext.fetch_add(POW_CHECK_CHUNK)) {
+        const size_t nCount = std::min(POW_CHECK_CHUNK, headers.size() - i);
+        for (size_t j = 0; j < nCount; ++j)
+            headers[i + j].SerializeTo(inputs + j * CBlockHeader::SERIALIZED_SIZE);
+        PoWHashes(hashes, inputs, CBlockHeader::SERIALIZED_SIZE, nCount);
+        for (size_t j = 0; j < nCount; ++j) {
+            if (!CheckProofOfWork(hashes[j], headers[i + j].nBits, params)) {
+                size_t nFirst = nInvalid.load();
+                while (i + j < nFirst && !nInvalid.compare_exchange_weak(nFirst, i + j));
+                return;
+            }
+        }
+    }
+}
+
+bool CheckProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& params, int nThreads, size_t* pnInvalid)
+{
+    const size_t nWorkers = std::max<size_t>(1, std::min<size_t>(nThreads, headers.size() / POW_CHECK_MIN_PER_THREAD));
+    std::atomic<size_t> nNext(0);
+    std::atomic<size_t> nFirstInvalid(headers.size());
+    auto check = [&]() {
+        CheckProofOfWork(headers, params, nNext, nFirstInvalid);
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nWorkers; ++i)
+        threads.emplace_back(check);
+    check();
+    for (auto& thread : threads)
+        thread.join();
+
+    const size_t nInvalid = nFirstInvalid.load();
+    if (nInvalid == headers.size())
+        return true;
+    if (pnInvalid)
+        *pnInvalid = nInvalid;
+    return false;
+}
@@ -9,6 +9,7 @@
 #include <consensus/params.h>
 
 #include <stdint.h>
+#include <vector>
 
 class CBlockHeader;
 class CBlockIndex;
@@ -20,4 +21,11 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
+/**
+ * Check the proof of work of many headers on up to nThreads threads, which take chunks of them in
+ * order and stop at the first that fails. When one fails and pnInvalid is given, it is set to the
+ * index of the first header that does.
+ */
+bool CheckProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params&, int nThreads, size_t* pnInvalid = nullptr);
+
 #endif // BITCOIN_POW_H
@@ -1,83 +1,19 @@
 
 #include <claimtrie.h>
-#include <fs.h>
-#include <lbry.h>
+#include <crypto/common.h>
 #include <limits>
 #include <memory>
 #include <prefixtrie.h>
 
-#include <boost/interprocess/allocators/private_node_allocator.hpp>
-#include <boost/interprocess/indexes/null_index.hpp>
-#include <boost/interprocess/managed_mapped_file.hpp>
-
-namespace bip = boost::interprocess;
-
-typedef bip::basic_managed_mapped_file <
-    char,
-    bip::rbtree_best_fit<bip::null_mutex_family, bip::offset_ptr<void>>,
-    bip::null_index
-> managed_mapped_file;
-
-template <typename T>
-using node_allocator = bip::private_node_allocator<T, managed_mapped_file::segment_manager>;
-
-static managed_mapped_file::segment_manager* segmentManager()
-{
-    struct CSharedMemoryFile
-    {
-        CSharedMemoryFile() : file(GetDataDir() / "shared.mem")
-        {
-            fs::remove(file);
-            auto size = (uint64_t)g_memfileSize * 1024ULL * 1024ULL * 1024ULL;
-            // using string() to remove w_char filename encoding on Windows
-            menaged_file.reset(new managed_mapped_file(bip::create_only, file.string().c_str(), size));
-        }
-        ~CSharedMemoryFile()
-        {
-            menaged_file.reset();
-            fs::remove(file);
-        }
-        managed_mapped_file::segment_manager* segmentManager()
-        {
-            return menaged_file->get_segment_manager();
-        }
-        const fs::path file;
-        std::unique_ptr<managed_mapped_file> menaged_file;
-    };
-    static CSharedMemoryFile shem;
-    return shem.segmentManager();
-}
-
-template <typename T>
-static node_allocator<T>& nodeAllocator()
-{
-    static node_allocator<T> allocator(segmentManager());
-    return allocator;
-}
-
-template <typename T, class... Args>
-static std::shared_ptr<T> nodeAllocate(Args&&... args)
-{
-    return std::allocate_shared<T>(nodeAllocator<T>(), std::forward<Args>(args)...);
-}
+template <typename TKey, typename TData>
+constexpr uint32_t CPrefixTrie<TKey, TData>::npos;
 
-template <typename T, class... Args>
-static std::shared_ptr<T> allocateShared(Args&&... args)
-{
-    static auto allocate = g_memfileSize ? nodeAllocate<T, Args...> : std::make_shared<T, Args...>;
-    try {
-        return allocate(std::forward<Args>(args)...);
-    }
-    catch (const bip::bad_alloc&) {
-        allocate = std::make_shared<T, Args...>; // in case we fill up the memfile
-        LogPrint(BCLog::BENCH, "WARNING: The memfile is full; reverting to the RAM allocator for %s.\n", typeid(T).name());
-        return allocate(std::forward<Args>(args)...);
-    }
-}
+template <typename TKey, typename TData>
+constexpr uint32_t CPrefixTrie<TKey, TData>::root;
 
 template <typename TKey, typename TData>
 template <bool IsConst>
-CPrefixTrie<TKey, TData>::Iterator<IsConst>::Iterator(const TKey& name, const std::shared_ptr<Node>& node) noexcept : name(name), node(node)
+CPrefixTrie<TKey, TData>::Iterator<IsConst>::Iterator(const TKey& name, const CPrefixTrie* trie, uint32_t node) noexcept : name(name), trie(trie), node(node), generation(trie->at(node).generation)
 {
 }
 
@@ -87,7 +23,9 @@ template <bool C>
 typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>& CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator=(const CPrefixTrie<TKey, TData>::Iterator<C>& o) noexcept
 {
     name = o.name;
+    trie = o.trie;
     node = o.node;
+    generation = o.generation;
     stack.clear();
     stack.reserve(o.stack.size());
     for (auto& i : o.stack)
@@ -95,18 +33,36 @@ typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>& CPrefixTrie<TKey,
     return *this;
 }
 
+template <typename TKey, typename TData>
+template <bool IsConst>
+const typename CPrefixTrie<TKey, TData>::Node* CPrefixTrie<TKey, TData>::Iterator<IsConst>::get() const
+{
+    if (!trie || node == npos) return nullptr;
+    auto& n = trie->at(node);
+    return n.generation == generation ? &n : nullptr;
+}
+
+template <typename TKey, typename TData>
+template <bool IsConst>
+void CPrefixTrie<TKey, TData>::Iterator<IsConst>::enter(uint32_t edge)
+{
+    auto& e = trie->edgePool[edge];
+    auto label = trie->labels.begin() + e.offset;
+    name.insert(name.end(), label, label + e.length);
+    node = e.node;
+    generation = trie->at(node).generation;
+}
+
 template <typename TKey, typename TData>
 template <bool IsConst>
 bool CPrefixTrie<TKey, TData>::Iterator<IsConst>::hasNext() const
 {
-    auto shared = node.lock();
+    auto shared = get();
     if (!shared) return false;
-    if (!shared->children.empty()) return true;
-    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
-        auto mark = *it; // copy
-        if (++mark.it != mark.end)
+    if (shared->count) return true;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+        if (it->it + 1 != it->end)
             return true;
-    }
     return false;
 }
 
@@ -114,17 +70,13 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>& CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator++()
 {
-    auto shared = node.lock();
+    auto shared = get();
     assert(shared);
     // going in pre-order (NLR). See https://en.wikipedia.org/wiki/Tree_traversal
     // if there are any children we have to go there first
-    if (!shared->children.empty()) {
-        auto& children = shared->children;
-        auto it = children.begin();
-        stack.emplace_back(Bookmark{name, it, children.end()});
-        auto& postfix = it->first;
-        name.insert(name.end(), postfix.begin(), postfix.end());
-        node = it->second;
+    if (shared->count) {
+        stack.emplace_back(Bookmark{name, shared->edges, shared->edges + shared->count});
+        enter(shared->edges);
         return *this;
     }
 
@@ -133,16 +85,14 @@ typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>& CPrefixTrie<TKey,
         auto& back = stack.back();
         if (++back.it != back.end) {
             name = back.name;
-            auto& postfix = back.it->first;
-            name.insert(name.end(), postfix.begin(), postfix.end());
-            node = back.it->second;
+            enter(back.it);
             return *this;
         }
         stack.pop_back();
     }
 
     // must be at the end:
-    node.reset();
+    node = npos;
     name = TKey();
     return *this;
 }
@@ -160,14 +110,14 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator bool() const
 {
-    return !node.expired();
+    return get() != nullptr;
 }
 
 template <typename TKey, typename TData>
 template <bool IsConst>
 bool CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator==(const Iterator& o) const
 {
-    return node.lock() == o.node.lock();
+    return get() == o.get();
 }
 
 template <typename TKey, typename TData>
@@ -216,7 +166,7 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>::data_reference CPrefixTrie<TKey, TData>::Iterator<IsConst>::data()
 {
-    auto shared = node.lock();
+    auto shared = get();
     assert(shared);
     return *(shared->data);
 }
@@ -225,7 +175,7 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 const TData& CPrefixTrie<TKey, TData>::Iterator<IsConst>::data() const
 {
-    auto shared = node.lock();
+    auto shared = get();
     assert(shared);
     return *(shared->data);
 }
@@ -241,190 +191,401 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 bool CPrefixTrie<TKey, TData>::Iterator<IsConst>::hasChildren() const
 {
-    auto shared = node.lock();
-    return shared && !shared->children.empty();
+    auto shared = get();
+    return shared && shared->count;
 }
 
 template <typename TKey, typename TData>
 template <bool IsConst>
 std::vector<typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>> CPrefixTrie<TKey, TData>::Iterator<IsConst>::children() const
 {
-    auto shared = node.lock();
+    auto shared = get();
     if (!shared) return {};
     std::vector<Iterator<IsConst>> ret;
-    ret.reserve(shared->children.size());
-    for (auto& child : shared->children) {
+    ret.reserve(shared->count);
+    for (auto i = shared->edges; i < shared->edges + shared->count; ++i) {
+        auto& edge = trie->edgePool[i];
+        auto label = trie->labels.begin() + edge.offset;
         auto key = name;
-        key.insert(key.end(), child.first.begin(), child.first.end());
-        ret.emplace_back(key, child.second);
+        key.insert(key.end(), label, label + edge.length);
+        ret.emplace_back(key, trie, edge.node);
     }
     return ret;
 }
 
 template <typename TKey, typename TData>
-template <typename TIterator, typename TNode>
-TIterator CPrefixTrie<TKey, TData>::find(const TKey& key, TNode node, TIterator end)
+typename CPrefixTrie<TKey, TData>::Node& CPrefixTrie<TKey, TData>::at(uint32_t node)
 {
-    TIterator it(key, TNode());
-    using CBType = callback<TNode>;
-    CBType cb = [&it](const TKey&, TNode node) {
-        it.node = node;
-    };
-    return find(key, node, cb) ? it : end;
+    auto slab = node < 64 ? 0 : CountBits(node >> 6);
+    return slabs[slab][slab ? node - (64U << (slab - 1)) : node];
 }
 
 template <typename TKey, typename TData>
-template <typename TNode>
-bool CPrefixTrie<TKey, TData>::find(const TKey& key, TNode node, const callback<TNode>& cb)
+const typename CPrefixTrie<TKey, TData>::Node& CPrefixTrie<TKey, TData>::at(uint32_t node) const
 {
-    auto& children = node->children;
-    if (children.empty()) return false;
-    auto it = children.lower_bound(key);
-    if (it != children.end() && it->first == key) {
-        cb(key, it->second);
-        return true;
+    auto slab = node < 64 ? 0 : CountBits(node >> 6);
+    return slabs[slab][slab ? node - (64U << (slab - 1)) : node];
+}
+
+template <typename TKey, typename TData>
+uint32_t CPrefixTrie<TKey, TData>::allocateNode()
+{
+    if (!freeNodes.empty()) {
+        auto node = freeNodes.back();
+        freeNodes.pop_back();
+        return node;
+    }
+    if (nodesUsed == (slabs.empty() ? 0 : 64U << (slabs.size() - 1)))
+        slabs.emplace_back(new Node[slabs.empty() ? 64 : 64U << (slabs.size() - 1)]);
+    return nodesUsed++;
+}
+
+template <typename TKey, typename TData>
+void CPrefixTrie<TKey, TData>::releaseNode(uint32_t node)
+{
+    auto& n = at(node);
+    if (n.capacity)
+        releaseEdges(n.edges, n.capacity);
+    n.edges = n.count = n.capacity = 0;
+    n.data.reset();
+    ++n.generation;
+    freeNodes.push_back(node);
+}
+
+template <typename TKey, typename TData>
+uint32_t CPrefixTrie<TKey, TData>::allocateEdges(uint32_t capacity)
+{
+    auto bucket = CountBits(capacity) - 1;
+    if (bucket < freeEdges.size() && !freeEdges[bucket].empty()) {
+        auto edges = freeEdges[bucket].back();
+        freeEdges[bucket].pop_back();
+        return edges;
+    }
+    auto edges = uint32_t(edgePool.size());
+    edgePool.resize(edgePool.size() + capacity);
+    return edges;
+}
+
+template <typename TKey, typename TData>
+void CPrefixTrie<TKey, TData>::releaseEdges(uint32_t edges, uint32_t capacity)
+{
+    auto bucket = CountBits(capacity) - 1;
+    if (bucket >= freeEdges.size())
+        freeEdges.resize(bucket + 1);
+    freeEdges[bucket].push_back(edges);
+}
+
+template <typename TKey, typename TData>
+uint32_t CPrefixTrie<TKey, TData>::findEdge(uint32_t node, TChar first) const
+{
+    auto& n = at(node);
+    auto begin = edgePool.begin() + n.edges, end = begin + n.count;
+    auto it = std::lower_bound(begin, end, first, [](const Edge& edge, TChar c) {
+        return std::char_traits<TChar>::lt(edge.first, c);
+    });
+    return it != end && it->first == first ? uint32_t(it - edgePool.begin()) : npos;
+}
+
+template <typename TKey, typename TData>
+void CPrefixTrie<TKey, TData>::addEdge(uint32_t node, const Edge& edge)
+{
+    auto& n = at(node);
+    if (n.count == n.capacity) {
+        auto capacity = n.capacity ? n.capacity * 2 : 1;
+        auto edges = allocateEdges(capacity);
+        std::copy(edgePool.begin() + n.edges, edgePool.begin() + n.edges + n.count, edgePool.begin() + edges);
+        if (n.capacity)
+            releaseEdges(n.edges, n.capacity);
+        n.edges = edges;
+        n.capacity = capacity;
+    }
+    auto begin = edgePool.begin() + n.edges, end = begin + n.count;
+    auto it = std::lower_bound(begin, end, edge.first, [](const Edge& e, TChar c) {
+        return std::char_traits<TChar>::lt(e.first, c);
+    });
+    std::copy_backward(it, end, end + 1);
+    *it = edge;
+    ++n.count;
+}
+
+template <typename TKey, typename TData>
+void CPrefixTrie<TKey, TData>::removeEdge(uint32_t node, uint32_t edge)
+{
+    auto& n = at(node);
+    labelGarbage += edgePool[edge].length;
+    std::copy(edgePool.begin() + edge + 1, edgePool.begin() + n.edges + n.count, edgePool.begin() + edge);
+    --n.count;
+}
+
+template <typename TKey, typename TData>
+std::size_t CPrefixTrie<TKey, TData>::match(const TKey& key, std::size_t pos, const Edge& edge) const
+{
+    std::size_t count = 0;
+    auto label = labels.begin() + edge.offset;
+    while (count < edge.length && pos + count < key.size() && key[pos + count] == label[count])
+        ++count;
+    return count;
+}
+
+template <typename TKey, typename TData>
+void CPrefixTrie<TKey, TData>::compactLabels()
+{
+    TKey compacted;
+    compacted.reserve(labels.size() - labelGarbage);
+    std::vector<uint32_t> pending{root};
+    while (!pending.empty()) {
+        auto& n = at(pending.back());
+        pending.pop_back();
+        for (auto i = n.edges; i < n.edges + n.count; ++i) {
+            auto& edge = edgePool[i];
+            auto label = labels.begin() + edge.offset;
+            edge.offset = uint32_t(compacted.size());
+            compacted.insert(compacted.end(), label, label + edge.length);
+            pending.push_back(edge.node);
+        }
+    }
+    labels.swap(compacted);
+    labelGarbage = 0;
+}
+
+template <typename TKey, typename TData>
+template <typename TCallback>
+bool CPrefixTrie<TKey, TData>::findPath(const TKey& key, uint32_t node, TCallback cb) const
+{
+    for (std::size_t pos = 0; pos < key.size();) {
+        auto edge = findEdge(node, key[pos]);
+        if (edge == npos) return false;
+        auto& e = edgePool[edge];
+        if (match(key, pos, e) != e.length) return false;
+        pos += e.length;
+        node = e.node;
+        cb(pos, node);
     }
-    if (it != children.begin()) --it;
-    const auto count = match(key, it->first);
-    if (count != it->first.size()) return false;
-    if (count == key.size()) return false;
-    cb(it->first, it->second);
-    return find(TKey(key.begin() + count, key.end()), it->second, cb);
+    return true;
 }
 
 template <typename TKey, typename TData>
-template <typename TIterator, typename TNode>
-std::vector<TIterator> CPrefixTrie<TKey, TData>::nodes(const TKey& key, TNode root)
+template <typename TIterator>
+TIterator CPrefixTrie<TKey, TData>::find(const TKey& key, uint32_t node, TIterator end) const
+{
+    auto found = npos;
+    auto cb = [&found](std::size_t, uint32_t node) {
+        found = node;
+    };
+    return findPath(key, node, cb) ? TIterator(key, this, found) : end;
+}
+
+template <typename TKey, typename TData>
+template <typename TIterator>
+std::vector<TIterator> CPrefixTrie<TKey, TData>::nodes(const TKey& key, uint32_t node) const
 {
     std::vector<TIterator> ret;
     ret.reserve(1 + key.size());
-    ret.emplace_back(TKey{}, root);
+    ret.emplace_back(TKey{}, this, node);
     if (key.empty()) return ret;
-    TKey name;
-    using CBType = callback<TNode>;
-    CBType cb = [&name, &ret](const TKey& key, TNode node) {
-        name.insert(name.end(), key.begin(), key.end());
-        ret.emplace_back(name, node);
+    auto cb = [this, &key, &ret](std::size_t pos, uint32_t node) {
+        ret.emplace_back(TKey(key.begin(), key.begin() + pos), this, node);
     };
-    find(key, root, cb);
+    findPath(key, node, cb);
     return ret;
 }
 
 template <typename TKey, typename TData>
-std::shared_ptr<typename CPrefixTrie<TKey, TData>::Node>& CPrefixTrie<TKey, TData>::insert(const TKey& key, std::shared_ptr<typename CPrefixTrie<TKey, TData>::Node>& node)
+uint32_t CPrefixTrie<TKey, TData>::insert(const TKey& key, uint32_t node)
 {
-    std::size_t count = 0;
-    auto& children = node->children;
-    auto it = children.lower_bound(key);
-    if (it != children.end()) {
-        if (it->first == key)
-            return it->second;
-        count = match(key, it->first);
-    }
-    if (count == 0 && it != children.begin()) {
-        --it;
-        count = match(key, it->first);
-    }
-    if (count == 0) {
-        ++size;
-        it = children.emplace(key, allocateShared<Node>()).first;
-        return it->second;
-    }
-    if (count < it->first.size()) {
-        TKey prefix(key.begin(), key.begin() + count);
-        TKey postfix(it->first.begin() + count, it->first.end());
-        auto nodes = std::move(it->second);
-        children.erase(it);
-        ++size;
-        it = children.emplace(std::move(prefix), allocateShared<Node>()).first;
-        it->second->children.emplace(std::move(postfix), std::move(nodes));
-        if (key.size() == count)
-            return it->second;
-        it->second->data = allocateShared<TData>();
+    for (std::size_t pos = 0; pos < key.size();) {
+        auto edge = findEdge(node, key[pos]);
+        if (edge == npos) {
+            ++size;
+            auto child = allocateNode();
+            addEdge(node, Edge{uint32_t(labels.size()), uint32_t(key.size() - pos), child, key[pos]});
+            labels.insert(labels.end(), key.begin() + pos, key.end());
+            return child;
+        }
+        auto e = edgePool[edge];
+        auto count = match(key, pos, e);
+        if (count < e.length) {
+            // split the segment: the new node keeps the shared prefix, the old one hangs below it
+            ++size;
+            auto middle = allocateNode();
+            addEdge(middle, Edge{e.offset + uint32_t(count), e.length - uint32_t(count), e.node, labels[e.offset + count]});
+            edgePool[edge].length = uint32_t(count);
+            edgePool[edge].node = middle;
+            e.node = middle;
+            if (pos + count != key.size())
+                at(middle).data = std::make_shared<TData>();
+        }
+        pos += count;
+        node = e.node;
     }
-    return insert(TKey(key.begin() + count, key.end()), it->second);
+    return node;
 }
 
 template <typename TKey, typename TData>
-void CPrefixTrie<TKey, TData>::erase(const TKey& key, std::shared_ptr<Node>& node)
+void CPrefixTrie<TKey, TData>::erase(const TKey& key, uint32_t node)
 {
-    std::vector<typename TChildren::value_type> nodes;
-    nodes.emplace_back(TKey(), node);
-    using CBType = callback<std::shared_ptr<Node>>;
-    CBType cb = [&nodes](const TKey& k, std::shared_ptr<Node> n) {
-        nodes.emplace_back(k, n);
+    std::vector<std::pair<std::size_t, uint32_t>> nodes;
+    nodes.emplace_back(0, node);
+    auto cb = [&nodes](std::size_t pos, uint32_t n) {
+        nodes.emplace_back(pos, n);
     };
-    if (!find(key, node, cb))
+    if (!findPath(key, node, cb))
         return;
 
-    nodes.back().second->data = allocateShared<TData>();
+    at(nodes.back().second).data = std::make_shared<TData>();
     for (; nodes.size() > 1; nodes.pop_back()) {
         // if we have only one child and no data ourselves, bring them up to our level
-        auto& cNode = nodes.back().second;
-        auto onlyOneChild = cNode->children.size() == 1;
-        auto noData = cNode->data->empty();
+        auto cNode = nodes.back().second;
+        auto& n = at(cNode);
+        auto pNode = nodes[nodes.size() - 2].second;
+        auto pEdge = findEdge(pNode, key[nodes[nodes.size() - 2].first]);
+        auto onlyOneChild = n.count == 1;
+        auto noData = n.data->empty();
         if (onlyOneChild && noData) {
-            auto child = cNode->children.begin();
-            auto& prefix = nodes.back().first;
-            auto newKey = prefix;
-            auto& postfix = child->first;
-            newKey.insert(newKey.end(), postfix.begin(), postfix.end());
-            auto& pNode = nodes[nodes.size() - 2].second;
-            pNode->children.emplace(std::move(newKey), std::move(child->second));
-            pNode->children.erase(prefix);
+            auto child = edgePool[n.edges];
+            auto& edge = edgePool[pEdge];
+            TKey label(labels.begin() + edge.offset, labels.begin() + edge.offset + edge.length);
+            label.insert(label.end(), labels.begin() + child.offset, labels.begin() + child.offset + child.length);
+            auto offset = uint32_t(labels.size());
+            labels.insert(labels.end(), label.begin(), label.end());
+            labelGarbage += edge.length + child.length;
+            edge.offset = offset;
+            edge.length += child.length;
+            edge.node = child.node;
+            releaseNode(cNode);
             --size;
             continue;
         }
 
-        auto noChildren = cNode->children.empty();
+        auto noChildren = n.count == 0;
         if (noChildren && noData) {
-            auto& pNode = nodes[nodes.size() - 2].second;
-            pNode->children.erase(nodes.back().first);
+            removeEdge(pNode, pEdge);
+            releaseNode(cNode);
             --size;
             continue;
         }
         break;
     }
+
+    if (labelGarbage > 4096 && labelGarbage > labels.size() / 2)
+        compactLabels();
+}
+
+template <typename TKey, typename TData>
+void CPrefixTrie<TKey, TData>::flatten(std::vector<FlatNode>& nodes, std::vector<FlatEdge>& edges, TKey& labels, std::vector<std::shared_ptr<TData>>& data) const
+{
+    nodes.clear();
+    edges.clear();
+    labels.clear();
+    data.clear();
+    std::vector<uint32_t> order{root};
+    order.reserve(size + 1);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        auto& n = at(order[i]);
+        nodes.push_back(FlatNode{uint32_t(edges.size()), n.count});
+        data.push_back(n.data);
+        for (auto e = n.edges; e < n.edges + n.count; ++e) {
+            auto& edge = edgePool[e];
+            auto label = this->labels.begin() + edge.offset;
+            edges.push_back(FlatEdge{uint32_t(labels.size()), edge.length});
+            labels.insert(labels.end(), label, label + edge.length);
+            order.push_back(edge.node);
+        }
+    }
 }
 
 template <typename TKey, typename TData>
-CPrefixTrie<TKey, TData>::CPrefixTrie() : size(0), root(allocateShared<Node>())
+bool CPrefixTrie<TKey, TData>::unflatten(const std::vector<FlatNode>& nodes, const std::vector<FlatEdge>& edges, const TKey& labels, std::vector<std::shared_ptr<TData>>& data)
 {
-    root->data = allocateShared<TData>();
+    clear();
+    if (nodes.empty() || edges.size() + 1 != nodes.size() || data.size() != nodes.size())
+        return false;
+
+    // node i goes to slot i, so the edges can point at their node directly
+    freeNodes.clear();
+    while (nodesUsed < nodes.size())
+        allocateNode();
+    for (auto node = nodesUsed - 1; node >= nodes.size(); --node)
+        freeNodes.push_back(node);
+
+    this->labels = labels;
+    uint32_t next = 0;
+    auto load = [&](uint32_t i) -> bool {
+        auto& flat = nodes[i];
+        auto& n = at(i);
+        n.data = std::move(data[i]);
+        if (!n.data || flat.edges != next || flat.count > edges.size() - next || (flat.count && flat.edges < i))
+            return false;
+        next += flat.count;
+        if (!flat.count)
+            return true;
+        auto capacity = 1U;
+        while (capacity < flat.count)
+            capacity <<= 1;
+        n.edges = allocateEdges(capacity);
+        n.capacity = capacity;
+        for (auto e = flat.edges; e < flat.edges + flat.count; ++e, ++n.count) {
+            auto& edge = edges[e];
+            if (!edge.length || edge.offset > labels.size() || edge.length > labels.size() - edge.offset)
+                return false;
+            auto first = labels[edge.offset];
+            if (n.count && !std::char_traits<TChar>::lt(edgePool[n.edges + n.count - 1].first, first))
+                return false;
+            edgePool[n.edges + n.count] = Edge{edge.offset, edge.length, e + 1, first};
+        }
+        return true;
+    };
+
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (!load(i)) {
+            clear();
+            return false;
+        }
+    }
+    size = nodes.size() - 1;
+    return true;
+}
+
+template <typename TKey, typename TData>
+CPrefixTrie<TKey, TData>::CPrefixTrie() : size(0), nodesUsed(0), labelGarbage(0)
+{
+    allocateNode();
+    at(root).data = std::make_shared<TData>();
 }
 
 template <typename TKey, typename TData>
 template <typename TDataUni>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::insert(const TKey& key, TDataUni&& data)
 {
-    auto& node = key.empty() ? root : insert(key, root);
-    node->data = allocateShared<TData>(std::forward<TDataUni>(data));
-    return key.empty() ? begin() : iterator{key, node};
+    auto node = key.empty() ? root : insert(key, root);
+    at(node).data = std::make_shared<TData>(std::forward<TDataUni>(data));
+    return key.empty() ? begin() : iterator{key, this, node};
 }
 
 template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::copy(CPrefixTrie<TKey, TData>::const_iterator it)
 {
     auto& key = it.key();
-    auto& node = key.empty() ? root : insert(key, root);
-    node->data = it.node.lock()->data;
-    return key.empty() ? begin() : iterator{key, node};
+    auto shared = it.get();
+    assert(shared);
+    auto node = key.empty() ? root : insert(key, root);
+    at(node).data = shared->data;
+    return key.empty() ? begin() : iterator{key, this, node};
 }
 
 template <typename TKey, typename TData>
 template <typename TDataUni>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::insert(CPrefixTrie<TKey, TData>::iterator& it, const TKey& key, TDataUni&& data)
 {
-    auto shared = it.node.lock();
-    assert(shared);
+    assert(it.get() && it.trie == this);
     auto copy = it;
     if (!key.empty()) {
         auto name = it.key();
         name.insert(name.end(), key.begin(), key.end());
-        auto& node = insert(key, shared);
-        copy = iterator{std::move(name), node};
+        auto node = insert(key, it.node);
+        copy = iterator{std::move(name), this, node};
     }
-    copy.node.lock()->data = allocateShared<TData>(std::forward<TDataUni>(data));
+    at(copy.node).data = std::make_shared<TData>(std::forward<TDataUni>(data));
     return copy;
 }
 
@@ -432,7 +593,7 @@ template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::find(const TKey& key)
 {
     if (empty()) return end();
-    if (key.empty()) return {key, root};
+    if (key.empty()) return {key, this, root};
     return find(key, root, end());
 }
 
@@ -440,7 +601,7 @@ template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::const_iterator CPrefixTrie<TKey, TData>::find(const TKey& key) const
 {
     if (empty()) return end();
-    if (key.empty()) return {key, root};
+    if (key.empty()) return {key, this, root};
     return find(key, root, end());
 }
 
@@ -448,18 +609,16 @@ template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::find(CPrefixTrie<TKey, TData>::iterator& it, const TKey& key)
 {
     if (key.empty()) return it;
-    auto shared = it.node.lock();
-    assert(shared);
-    return find(key, shared, end());
+    assert(it.get() && it.trie == this);
+    return find(key, it.node, end());
 }
 
 template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::const_iterator CPrefixTrie<TKey, TData>::find(CPrefixTrie<TKey, TData>::const_iterator& it, const TKey& key) const
 {
     if (key.empty()) return it;
-    auto shared = it.node.lock();
-    assert(shared);
-    return find(key, shared, end());
+    assert(it.get() && it.trie == this);
+    return find(key, it.node, end());
 }
 
 template <typename TKey, typename TData>
@@ -493,7 +652,7 @@ bool CPrefixTrie<TKey, TData>::erase(const TKey& key)
 {
     auto size_was = height();
     if (key.empty()) {
-        root->data = allocateShared<TData>();
+        at(root).data = std::make_shared<TData>();
     } else {
         erase(key, root);
     }
@@ -503,9 +662,23 @@ bool CPrefixTrie<TKey, TData>::erase(const TKey& key)
 template <typename TKey, typename TData>
 void CPrefixTrie<TKey, TData>::clear()
 {
+    // the slabs are kept for reuse, every node but the root goes back to the free list
+    freeNodes.clear();
+    for (auto node = nodesUsed - 1; node > root; --node) {
+        auto& n = at(node);
+        n.edges = n.count = n.capacity = 0;
+        n.data.reset();
+        ++n.generation;
+        freeNodes.push_back(node);
+    }
+    auto& n = at(root);
+    n.edges = n.count = n.capacity = 0;
+    n.data = std::make_shared<TData>();
+    edgePool.clear();
+    freeEdges.clear();
+    labels.clear();
+    labelGarbage = 0;
     size = 0;
-    root->data = allocateShared<TData>();
-    root->children.clear();
 }
 
 template <typename TKey, typename TData>
@@ -517,7 +690,7 @@ bool CPrefixTrie<TKey, TData>::empty() const
 template <typename TKey, typename TData>
 std::size_t CPrefixTrie<TKey, TData>::height() const
 {
-    return size + (root->data->empty() ? 0 : 1);
+    return size + (at(root).data->empty() ? 0 : 1);
 }
 
 template <typename TKey, typename TData>
@@ -2,38 +2,50 @@
 #define BITCOIN_PREFIXTRIE_H
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <string>
 #include <type_traits>
 #include <vector>
 
-#include <boost/container/flat_map.hpp>
-
-namespace bc = boost::container;
-
 template <typename TKey, typename TData>
 class CPrefixTrie
 {
+    using TChar = typename TKey::value_type;
+
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    // a child link, its path segment lives in the label arena
+    struct Edge
+    {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t node;
+        TChar first; // siblings never share the first character of their segment
+    };
+
+    // nodes live in slabs and are addressed by index; their child edges are
+    // the range [edges, edges + count) of the edge pool, sorted by first
     class Node
     {
         template <bool>
         friend class Iterator;
         friend class CPrefixTrie<TKey, TData>;
-        bc::flat_map<TKey, std::shared_ptr<Node>> children;
+        uint32_t edges = 0;
+        uint32_t count = 0;
+        uint32_t capacity = 0;
+        uint32_t generation = 0; // bumped on release so stale iterators are detected
 
     public:
         Node() = default;
         Node(const Node&) = delete;
-        Node(Node&& o) noexcept = default;
-        Node& operator=(Node&&) noexcept = default;
         Node& operator=(const Node&) = delete;
         std::shared_ptr<TData> data;
     };
 
-    using TChildren = decltype(Node::children);
-
     template <bool IsConst>
     class Iterator
     {
@@ -47,16 +59,21 @@ class CPrefixTrie
         using ConstTPair = std::pair<TKeyRef, const TData>;
 
         TKey name;
-        std::weak_ptr<Node> node;
+        const CPrefixTrie* trie = nullptr;
+        uint32_t node = npos;
+        uint32_t generation = 0;
 
         struct Bookmark {
             TKey name;
-            typename TChildren::iterator it;
-            typename TChildren::iterator end;
+            uint32_t it;
+            uint32_t end;
         };
 
         std::vector<Bookmark> stack;
 
+        const Node* get() const;
+        void enter(uint32_t edge);
+
     public:
         // Iterator traits
         using value_type = TPair;
@@ -71,7 +88,7 @@ class CPrefixTrie
         Iterator() = default;
         Iterator(const Iterator&) = default;
         Iterator(Iterator&& o) noexcept = default;
-        Iterator(const TKey& name, const std::shared_ptr<Node>& node) noexcept;
+        Iterator(const TKey& name, const CPrefixTrie* trie, uint32_t node) noexcept;
         template <bool C>
         inline Iterator(const Iterator<C>& o) noexcept
         {
@@ -109,29 +126,73 @@ class CPrefixTrie
         std::vector<Iterator> children() const;
     };
 
+    static constexpr uint32_t root = 0;
+
     size_t size;
-    std::shared_ptr<Node> root;
 
-    template <typename TNode>
-    using callback = std::function<void(const TKey&, TNode)>;
+    std::vector<std::unique_ptr<Node[]>> slabs; // slab k > 0 holds nodes [64 << (k - 1), 64 << k)
+    uint32_t nodesUsed;
+    std::vector<uint32_t> freeNodes;
+
+    std::vector<Edge> edgePool;
+    std::vector<std::vector<uint32_t>> freeEdges; // released ranges by log2 of their capacity
+
+    TKey labels;
+    std::size_t labelGarbage; // bytes of labels no edge refers to any more
+
+    Node& at(uint32_t node);
+    const Node& at(uint32_t node) const;
+
+    uint32_t allocateNode();
+    void releaseNode(uint32_t node);
 
-    template <typename TIterator, typename TNode>
-    static TIterator find(const TKey& key, TNode node, TIterator end);
+    uint32_t allocateEdges(uint32_t capacity);
+    void releaseEdges(uint32_t edges, uint32_t capacity);
 
-    template <typename TNode>
-    static bool find(const TKey& key, TNode node, const callback<TNode>& cb);
+    uint32_t findEdge(uint32_t node, TChar first) const;
+    void addEdge(uint32_t node, const Edge& edge);
+    void removeEdge(uint32_t node, uint32_t edge);
 
-    template <typename TIterator, typename TNode>
-    static std::vector<TIterator> nodes(const TKey& key, TNode root);
+    std::size_t match(const TKey& key, std::size_t pos, const Edge& edge) const;
+    void compactLabels();
 
-    std::shared_ptr<Node>& insert(const TKey& key, std::shared_ptr<Node>& node);
-    void erase(const TKey& key, std::shared_ptr<Node>& node);
+    template <typename TCallback>
+    bool findPath(const TKey& key, uint32_t node, TCallback cb) const;
+
+    template <typename TIterator>
+    TIterator find(const TKey& key, uint32_t node, TIterator end) const;
+
+    template <typename TIterator>
+    std::vector<TIterator> nodes(const TKey& key, uint32_t node) const;
+
+    uint32_t insert(const TKey& key, uint32_t node);
+    void erase(const TKey& key, uint32_t node);
+
+protected:
+    // the trie in breadth-first order: node i's children are the nodes
+    // [edges + 1, edges + count + 1), reached through the edges of the same indices
+    struct FlatNode
+    {
+        uint32_t edges;
+        uint32_t count;
+    };
+
+    struct FlatEdge
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    void flatten(std::vector<FlatNode>& nodes, std::vector<FlatEdge>& edges, TKey& labels, std::vector<std::shared_ptr<TData>>& data) const;
+    bool unflatten(const std::vector<FlatNode>& nodes, const std::vector<FlatEdge>& edges, const TKey& labels, std::vector<std::shared_ptr<TData>>& data);
 
 public:
     using iterator = Iterator<false>;
     using const_iterator = Iterator<true>;
 
     CPrefixTrie();
+    CPrefixTrie(const CPrefixTrie&) = delete; // iterators point back at the trie
+    CPrefixTrie& operator=(const CPrefixTrie&) = delete;
 
     template <typename TDataUni>
     iterator insert(const TKey& key, TDataUni&& data);
@@ -207,19 +268,4 @@ inline bool operator!=(const std::reference_wrapper<std::unique_ptr<T>>& ref, co
     return !(ref == obj);
 }
 
-template <typename TKey>
-static std::size_t match(const TKey& a, const TKey& b)
-{
-    std::size_t count = 0;
-    auto ait = a.cbegin(), aend = a.cend();
-    auto bit = b.cbegin(), bend = b.cend();
-    while (ait != aend && bit != bend) {
-        if (*ait != *bit) break;
-        ++count;
-        ++ait;
-        ++bit;
-    }
-    return count;
-}
-
 #endif // BITCOIN_PREFIXTRIE_H
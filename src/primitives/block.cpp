@@ -16,12 +16,32 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+void CBlockHeader::SerializeTo(unsigned char* out) const
+{
+    WriteLE32(out, nVersion);
+    memcpy(out + 4, hashPrevBlock.begin(), 32);
+    memcpy(out + 36, hashMerkleRoot.begin(), 32);
+    memcpy(out + 68, hashClaimTrie.begin(), 32);
+    WriteLE32(out + 100, nTime);
+    WriteLE32(out + 104, nBits);
+    WriteLE32(out + 108, nNonce);
+}
+
 uint256 CBlockHeader::GetPoWHash() const
 {
-    CDataStream ds(SER_GETHASH, PROTOCOL_VERSION);
-    ds << *this;
-    std::vector<unsigned char> input(ds.begin(), ds.end());
-    return PoWHash(input);
+    unsigned char input[SERIALIZED_SIZE];
+    SerializeTo(input);
+    return PoWHash(input, sizeof(input));
+}
+
+std::vector<uint256> GetPoWHashes(const std::vector<CBlockHeader>& headers)
+{
+    std::vector<unsigned char> inputs(headers.size() * CBlockHeader::SERIALIZED_SIZE);
+    for (std::size_t i = 0; i < headers.size(); ++i)
+        headers[i].SerializeTo(inputs.data() + i * CBlockHeader::SERIALIZED_SIZE);
+    std::vector<uint256> hashes(headers.size());
+    PoWHashes(hashes.data(), inputs.data(), CBlockHeader::SERIALIZED_SIZE, headers.size());
+    return hashes;
 }
 
 std::string CBlock::ToString() const
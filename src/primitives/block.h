@@ -20,6 +20,9 @@
 class CBlockHeader
 {
 public:
+    /** Size of the serialization that GetHash and GetPoWHash hash, the nonce is its last 4 bytes */
+    static const size_t SERIALIZED_SIZE = 112;
+
     // header
     int32_t nVersion;
     uint256 hashPrevBlock;
@@ -67,6 +70,9 @@ public:
 
     uint256 GetPoWHash() const;
 
+    /** Write the serialization of the header to out, SERIALIZED_SIZE bytes, without a stream */
+    void SerializeTo(unsigned char* out) const;
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -125,6 +131,9 @@ public:
     std::string ToString() const;
 };
 
+/** The GetPoWHash of each header, several of them at a time (see PoWHashes) */
+std::vector<uint256> GetPoWHashes(const std::vector<CBlockHeader>& headers);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
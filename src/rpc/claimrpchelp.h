@@ -46,10 +46,27 @@
 #define T_SUPPORTSREMOVED               "supportsRemoved"
 #define T_ADDRESS                       "address"
 #define T_PENDINGAMOUNT                 "pendingAmount"
+#define T_URLS                          "urls"
+#define T_BLOCKS                        "blocks"
+#define T_SCRIPTS                       "scripts"
+#define T_QUEUES                        "queues"
+#define T_TAKEOVERS                     "takeovers"
+#define T_MERKLEHASH                    "merkleHash"
+#define T_FLUSH                         "flush"
+#define T_FLUSHBYTES                    "flushBytes"
+#define T_FILENAME                      "filename"
+#define T_ROWS                          "rows"
+#define T_PREFIX                        "prefix"
+#define T_CURSOR                        "cursor"
+#define T_LIMIT                         "limit"
+#define T_CONTROLLING                   "controlling"
+#define T_PENDING                       "pending"
+#define T_PROJECTED                     "projected"
 
 enum {
     GETCLAIMSINTRIE = 0,
     GETNAMESINTRIE,
+    LISTNAMES,
     GETVALUEFORNAME,
     GETCLAIMSFORNAME,
     GETCLAIMBYID,
@@ -57,13 +74,18 @@ enum {
     GETTOTALCLAIMS,
     GETTOTALVALUEOFCLAIMS,
     GETCLAIMSFORTX,
+    GETPENDINGCLAIMS,
     GETNAMEPROOF,
+    GETNAMEPROOFS,
     CHECKNORMALIZATION,
     GETCLAIMBYBID,
     GETCLAIMBYSEQ,
     GETCLAIMPROOFBYBID,
     GETCLAIMPROOFBYSEQ,
     GETCHANGESINBLOCK,
+    RESOLVE,
+    GETCLAIMTRIETIMINGS,
+    DUMPCLAIMTRIE,
 };
 
 #define S3_(pre, name, def) pre "\"" name "\"" def "\n"
@@ -76,7 +98,13 @@ enum {
 "                                                  by this block hash.\n" \
 "                                                  If none is given,\n" \
 "                                                  the latest active\n" \
-"                                                  block will be used."
+"                                                  block will be used.\n" \
+"                                                  Blocks from before the\n" \
+"                                                  claim trie history are\n" \
+"                                                  read by rolling back,\n" \
+"                                                  which holds the chain\n" \
+"                                                  lock and is limited to\n" \
+"                                                  the last 500 blocks."
 
 #define CLAIM_OUTPUT    \
 S3("    ", T_NORMALIZEDNAME, "         (string) the name of the claim (after normalization)") \
@@ -156,6 +184,30 @@ S1("Result: [")
 S3("    ", T_NAMES, "                  all names in the trie that have claims")
 "]",
 
+// LISTNAMES
+S1("listnames ( \"" T_PREFIX "\" \"" T_CURSOR "\" " T_LIMIT " " T_CONTROLLING R"( )
+Return the claim names in the trie that start with a prefix, a page at a time, in the order of the trie.
+Only the part of the trie under the prefix is visited.
+Arguments:)")
+S3("1. ", T_PREFIX, "                  (string, optional) the names start with it, all names if none is given")
+S3("2. ", T_CURSOR, "                  (string, optional) the cursor of the previous page, to go on after it")
+S3("3. ", T_LIMIT, "                   (numeric, optional, default=1000) the most names to return")
+S3("4. ", T_CONTROLLING, "             (boolean, optional, default=false) return the controlling claim of each name")
+S1("Result: {")
+S3("    ", T_NAMES, ": [               (array) the names, or if " T_CONTROLLING ", objects of")
+S3("        ", T_NORMALIZEDNAME, "     (string) the name")
+S3("        ", T_CLAIMID, "            (string) the claimId of the controlling claim")
+S3("        ", T_TXID, "               (string) the txid of the claim")
+S3("        ", T_N, "                  (numeric) the index of the claim in the transaction's list of outputs")
+S3("        ", T_HEIGHT, "             (numeric) the height of the block in which this transaction is located")
+S3("        ", T_VALIDATHEIGHT, "      (numeric) the height at which the claim became valid")
+S3("        ", T_AMOUNT, "             (numeric) the amount of the claim")
+S3("        ", T_EFFECTIVEAMOUNT, "    (numeric) the amount plus amount from all supports associated with the claim")
+S3("        ", T_LASTTAKEOVERHEIGHT, " (numeric) the last height at which ownership of the name changed")
+S1("    ]")
+S3("    ", T_CURSOR, "                 (string, if more names follow) pass it on to get the next page")
+"}",
+
 // GETVALUEFORNAME
 S1("getvalueforname \"" T_NAME "\" ( \"" T_BLOCKHASH "\" \"" T_CLAIMID R"(" )
 Return the winning or specified by claimId value associated with a name
@@ -262,6 +314,30 @@ S3("    ", T_INQUEUE, "                (boolean) whether the claim is in a queue
 S3("    ", T_BLOCKSTOVALID, "          (numeric) if in a queue, the number of blocks until it's inserted into the trie or support map")
 "]",
 
+// GETPENDINGCLAIMS
+S1("getpendingclaims \"" T_NAME "\" ( \"" T_CLAIMID "\" " T_PROJECTED R"( )
+Return the claims, updates and supports for a name or a claim id waiting in the mempool
+Arguments:)")
+S3("1. ", T_NAME, "                    (string) the name to look up, can be empty when a claimId is given")
+S3("2. ", T_CLAIMID, "                 (string, optional) only the activity for this claim, can be partial when a name is given")
+S3("3. ", T_PROJECTED, "               (boolean, optional, default=false) also return the controlling claims\n"
+"                                                  as they would be after a block with the whole mempool")
+S1("Result:")
+S3("    ", T_PENDING, ": [              (array of object) in the order they entered the mempool")
+S3("        ", T_NAME, "               (string) the name claimed or supported")
+S3("        ", T_CLAIMTYPE, "          (string) claim, update or support")
+S3("        ", T_CLAIMID, "            (string) the claimId of the claim, or the one supported")
+S3("        ", T_TXID, "               (string) the txid of the transaction")
+S3("        ", T_N, "                  (numeric) the index of the output in the transaction's list of outputs")
+S3("        ", T_AMOUNT, "             (numeric) the amount of the output")
+S3("        ", T_VALUE, "              (string, if exists) the value of the claim or the metadata of the support")
+S3("        ", T_ADDRESS, "            (string) the destination address of the output")
+S1("    ]")
+S3("    ", T_PROJECTED, ": [            (array of object, if projected) the controlling claim of each name above")
+CLAIM_OUTPUT
+S1("    ]")
+,
+
 // GETNAMEPROOF
 S1("getnameproof \"" T_NAME "\" ( \"" T_BLOCKHASH "\" \"" T_CLAIMID R"(" )
 Return the cryptographic proof that a name maps to a value or doesn't.
@@ -274,6 +350,18 @@ S1("Result: [")
 PROOF_OUTPUT
 "]",
 
+// GETNAMEPROOFS
+S1("getnameproofs [\"" T_NAME "\",...] ( \"" T_BLOCKHASH R"(" )
+Return the cryptographic proofs that names map to their values or don't, in the order of the names.
+The nodes the names have in common are only worked out once.
+Arguments:)")
+S3("1. ", T_NAMES, "                   (array of string) the names to prove")
+S3("2. ", T_BLOCKHASH, BLOCKHASH_TEXT)
+S1("Result: [")
+S3("    ", T_NAME, "                   (string) the name of the proof")
+PROOF_OUTPUT
+"]",
+
 // CHECKNORMALIZATION
 S1("checknormalization \"" T_NAME R"("
 Given an unnormalized name of a claim, return normalized version of it
@@ -340,6 +428,47 @@ S3("    ", T_SUPPORTSADDEDORUPDATED, " (array of string) IDs of supports added o
 S3("    ", T_SUPPORTSREMOVED, "        (array of string) IDs that were removed from the trie")
 "]",
 
+// RESOLVE
+S1("resolve [\"" T_URLS R"(",...]
+Resolve many names, URLs and claim ids in one call, all as of the same block
+Arguments:)")
+S3("1. ", T_URLS, ": [                 (array) what to resolve, at most 1000, each one of")
+S1("       \"name\"                     (string) the winning claim for a name, as getvalueforname")
+S1("       \"lbry://name#claimId\"      (string) the claim for name with this (partial) claimId; the lbry:// prefix is optional")
+S1("       \"lbry://name:sequence\"     (string) the claim for name by sequence, counting from 1")
+S1("       \"lbry://name$bid\"          (string) the claim for name by bid, counting from 1")
+S3("       {\"", T_CLAIMID, "\":\"id\"}          (object) the claim with this (partial) claimId, as getclaimbyid")
+S1("   ]")
+S1("Result: [                           (array of object) in the order of the urls, empty when not found")
+CLAIM_OUTPUT
+"]",
+
+// GETCLAIMTRIETIMINGS
+S1(R"(getclaimtrietimings
+Return the time spent on the claim trie by the blocks connected and disconnected since startup
+Arguments:)")
+S1("Result:")
+S3("    ", T_BLOCKS, "                 (numeric) the number of blocks connected and disconnected")
+S3("    ", T_SCRIPTS, "                (numeric) seconds spent on the claim scripts of transactions")
+S3("    ", T_QUEUES, "                 (numeric) seconds spent activating and expiring queued claims and supports")
+S3("    ", T_TAKEOVERS, "              (numeric) seconds spent on takeovers")
+S3("    ", T_MERKLEHASH, "             (numeric) seconds spent hashing the trie")
+S3("    ", T_FLUSH, "                  (numeric) seconds spent flushing the trie")
+S3("    ", T_FLUSHBYTES, "             (numeric) the size of the rows flushed")
+,
+
+// DUMPCLAIMTRIE
+S1("dumpclaimtrie \"" T_FILENAME R"("
+Write a snapshot of the claim trie as of the chain tip, to be loaded with -loadclaimtrie by a node at the same block
+Arguments:)")
+S3("1. ", T_FILENAME, "                 (string) the file to write, relative to the data directory; it must not exist")
+S1("Result:")
+S3("    ", T_BLOCKHASH, "              (string) the block of the snapshot")
+S3("    ", T_HEIGHT, "                 (numeric) the height of the block")
+S3("    ", T_ROWS, "                   (numeric) the number of rows written")
+S3("    ", T_FILENAME, "               (string) the file written")
+,
+
 };
 
 #endif // CLAIMRPCHELP_H
@@ -1,3 +1,4 @@
+#include <claimscriptop.h>
 #include <claimtrie.h>
 #include <coins.h>
 #include <core_io.h>
@@ -20,6 +21,8 @@
 #include <cmath>
 
 static constexpr size_t claimIdHexLength = 40;
+static constexpr int DEFAULT_LISTNAMES_LIMIT = 1000;
+static constexpr size_t MAX_RESOLVE_URLS = 1000;
 
 uint160 uint160S(const std::string& str)
 {
@@ -126,48 +129,13 @@ static bool extractValue(const CScript& scriptPubKey, std::string& sValue)
 
 bool getClaimById(const uint160& claimId, std::string& name, CClaimValue* claim = nullptr)
 {
-    if (claimId.IsNull())
-        return false;
-
-    CClaimIndexElement element;
-    if (!pclaimTrie->db->Read(std::make_pair(CLAIM_BY_ID, claimId), element))
-        return false;
-    if (element.claim.claimId == claimId) {
-        name = element.name;
-        if (claim)
-            *claim = element.claim;
-        return true;
-    }
-    return false;
+    return pclaimTrie->getReadView()->getClaimById(claimId, name, claim);
 }
 
 // name can be setted explicitly
 bool getClaimById(const std::string& partialId, std::string& name, CClaimValue* claim = nullptr)
 {
-    if (partialId.empty())
-        return false;
-
-    std::unique_ptr<CDBIterator> pcursor(pclaimTrie->db->NewIterator());
-
-    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
-        std::pair<uint8_t, uint160> key;
-        if (!pcursor->GetKey(key) || key.first != CLAIM_BY_ID)
-            continue;
-
-        if (key.second.GetHex().find(partialId) != 0)
-            continue;
-
-        CClaimIndexElement element;
-        if (pcursor->GetValue(element)) {
-            if (!name.empty() && name != element.name)
-                continue;
-            name = element.name;
-            if (claim)
-                *claim = element.claim;
-            return true;
-        }
-    }
-    return false;
+    return pclaimTrie->getReadView()->getClaimById(partialId, name, claim);
 }
 
 std::vector<CClaimNsupports> seqSort(const std::vector<CClaimNsupports>& source)
@@ -274,6 +242,167 @@ UniValue claimAndSupportsToJSON(const CCoinsViewCache& coinsCache, const CClaimN
     return result;
 }
 
+// the outputs behind the claims and supports, with the heights of the blocks that made them
+static std::vector<std::pair<COutPoint, int>> outPointsOf(const CClaimSupportToName& csToName)
+{
+    std::vector<std::pair<COutPoint, int>> outPoints;
+    for (auto& claimNsupports : csToName.claimsNsupports) {
+        outPoints.emplace_back(claimNsupports.claim.outPoint, claimNsupports.claim.nHeight);
+        for (auto& support : claimNsupports.supports)
+            outPoints.emplace_back(support.outPoint, support.nHeight);
+    }
+    for (auto& support : csToName.unmatchedSupports)
+        outPoints.emplace_back(support.outPoint, support.nHeight);
+    return outPoints;
+}
+
+// copies the outputs from view, so that coinsCache works without cs_main
+static void fillCoins(CCoinsViewCache& coinsCache, const CCoinsViewCache& view, const std::vector<std::pair<COutPoint, int>>& outPoints)
+{
+    for (auto& outPoint : outPoints) {
+        auto& coin = view.AccessCoin(outPoint.first);
+        if (!coin.IsSpent())
+            coinsCache.AddCoin(outPoint.first, Coin(coin), true);
+    }
+}
+
+static void checkInterrupted()
+{
+    if (ShutdownRequested())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Shutdown requested");
+
+    boost::this_thread::interruption_point();
+}
+
+// as fillCoins from the tip, the outputs spent since an older block come from the claim trie
+// history (see CClaimTrieReadView::getSpentOutput) or, spent before it, from the blocks that made them
+static void fillHistoricalCoins(CCoinsViewCache& coinsCache, const std::vector<std::pair<COutPoint, int>>& outPoints)
+{
+    std::shared_ptr<const CClaimTrieReadView> view;
+    {
+        LOCK(cs_main);
+        fillCoins(coinsCache, *pcoinsTip, outPoints);
+        view = pclaimTrie->getReadView();
+    }
+
+    std::map<int, std::vector<COutPoint>> spent;
+    for (auto& outPoint : outPoints) {
+        if (coinsCache.HaveCoinInCache(outPoint.first))
+            continue;
+        CTxOut txout;
+        if (view->getSpentOutput(outPoint.first, txout))
+            coinsCache.AddCoin(outPoint.first, Coin(std::move(txout), outPoint.second, false), true);
+        else
+            spent[outPoint.second].push_back(outPoint.first);
+    }
+
+    // one block at a time, in the order of the chain
+    for (auto& heightOutPoints : spent) {
+        checkInterrupted();
+        const CBlockIndex* blockIndex;
+        {
+            LOCK(cs_main);
+            blockIndex = chainActive[heightOutPoints.first];
+        }
+        if (!blockIndex)
+            continue;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, blockIndex, Params().GetConsensus()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Failed to read %s", blockIndex->ToString()));
+        for (auto& tx : block.vtx)
+            for (auto& outPoint : heightOutPoints.second)
+                if (tx->GetHash() == outPoint.hash && outPoint.n < tx->vout.size())
+                    coinsCache.AddCoin(outPoint, Coin(tx->vout[outPoint.n], blockIndex->nHeight, tx->IsCoinBase()), true);
+    }
+}
+
+static int BlockHashHeight(const UniValue& blockHash, const std::string& strName)
+{
+    LOCK(cs_main);
+    return BlockHashIndex(ParseHashV(blockHash, strName))->nHeight;
+}
+
+
+/**
+ * Calls callback with the names that had something at the block at nHeight and their state then,
+ * shorter names first, from the read view and without cs_main. That's where results written in
+ * parts (see JSONRPCArrayWriter) come from: the writer waits for a slow client, which must not hold
+ * up the blocks. False, before any call, when the block is before the claim trie history.
+ */
+static bool iterateNamesAt(const CClaimTrieReadView& view, int nHeight, const std::function<void(const std::string&, const CClaimNameState&)>& callback)
+{
+    bool fStarted = false;
+    if (view.iterateNamesAt(nHeight, [&fStarted, &callback](const std::string& name, const CClaimNameState& state) {
+        checkInterrupted();
+        fStarted = true;
+        callback(name, state);
+    }))
+        return true;
+    if (fStarted)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Error reading the claim trie history, see the log for details");
+    return false;
+}
+
+/**
+ * The claims for name as of the block in blockHash (the last flushed one when it's null) and
+ * coinsCache filled with their outputs. The tip is read from the published read view and blocks
+ * covered by the claim trie history from there, both without keeping cs_main; the blocks before
+ * the history still go through RollBackTo.
+ */
+static CClaimSupportToName getClaimsForNameAt(const std::string& name, const UniValue& blockHash, const std::string& strName, CCoinsViewCache& coinsCache)
+{
+    if (blockHash.isNull()) {
+        auto csToName = pclaimTrie->getReadView()->getClaimsForName(name);
+        fillHistoricalCoins(coinsCache, outPointsOf(csToName));
+        return csToName;
+    }
+
+    int nHeight;
+    std::string normalized;
+    {
+        LOCK(cs_main);
+        CClaimTrieCache trieCache(pclaimTrie);
+        nHeight = BlockHashIndex(ParseHashV(blockHash, strName))->nHeight;
+        // as the cache rolled back to that block would see it
+        normalized = nHeight + 1 > Params().GetConsensus().nNormalizedNameForkHeight ? trieCache.normalizeClaimName(name, true) : name;
+    }
+
+    CClaimNameState state;
+    if (pclaimTrie->getReadView()->getNameStateAt(normalized, nHeight, state)) {
+        auto csToName = state.getClaimsForName(normalized, nHeight + 1);
+        fillHistoricalCoins(coinsCache, outPointsOf(csToName));
+        return csToName;
+    }
+
+    LOCK(cs_main);
+    CCoinsViewCache rolledBack(pcoinsTip.get());
+    CClaimTrieCache trieCache(pclaimTrie);
+    RollBackTo(BlockHashIndex(ParseHashV(blockHash, strName)), rolledBack, trieCache);
+    auto csToName = trieCache.getClaimsForName(name);
+    fillCoins(coinsCache, rolledBack, outPointsOf(csToName));
+    return csToName;
+}
+
+// a claim the way getvalueforname and getclaimbyid show it: with its name, bid and sequence
+UniValue claimForNameToJSON(const CCoinsViewCache& coinsCache, const CClaimSupportToName& csToName, const CClaimNsupports& claimNsupports)
+{
+    std::size_t seq = 0, bid = 0;
+    if (csToName.claimsNsupports.size() > 1) {
+        auto& claimId = claimNsupports.claim.claimId;
+        auto seqOrder = seqSort(csToName.claimsNsupports);
+        seq = indexOf(seqOrder, claimId);
+        bid = indexOf(csToName.claimsNsupports, claimId);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
+    ret.pushKVs(claimAndSupportsToJSON(coinsCache, claimNsupports));
+    ret.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
+    ret.pushKV(T_BID, (int)bid);
+    ret.pushKV(T_SEQUENCE, (int)seq);
+    return ret;
+}
+
 bool validParams(const UniValue& params, uint8_t required, uint8_t optional)
 {
     auto count = params.size();
@@ -297,35 +426,57 @@ static UniValue getclaimsintrie(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_METHOD_DEPRECATED, msg);
     }
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
-
-    if (!request.params.empty()) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[0], T_BLOCKHASH " (optional parameter 1)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
+    auto view = pclaimTrie->getReadView();
+    const int nHeight = request.params.empty() ? view->nNextHeight - 1 : BlockHashHeight(request.params[0], T_BLOCKHASH " (optional parameter 1)");
+    {
+        // the outputs of a name's claims are looked up as it's written out, one name at a time
+        JSONRPCArrayWriter ret(request);
+        if (iterateNamesAt(*view, nHeight, [&ret](const std::string& name, const CClaimNameState& state) {
+            if (state.claims.empty())
+                return;
+            std::vector<std::pair<COutPoint, int>> outPoints;
+            for (auto& claim : state.claims)
+                outPoints.emplace_back(claim.outPoint, claim.nHeight);
+            CCoinsView viewDummy;
+            CCoinsViewCache coinsCache(&viewDummy);
+            fillHistoricalCoins(coinsCache, outPoints);
+
+            UniValue claims(UniValue::VARR);
+            for (auto& claim : state.claims)
+                claims.push_back(claimToJSON(coinsCache, claim));
+
+            UniValue nodeObj(UniValue::VOBJ);
+            nodeObj.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(name));
+            nodeObj.pushKV(T_CLAIMS, claims);
+            ret.push_back(nodeObj);
+        }))
+            return ret.finish();
     }
 
-    UniValue ret(UniValue::VARR);
-    trieCache.iterate([&ret, &trieCache, &coinsCache] (const std::string& name, const CClaimTrieData& data) {
-        if (ShutdownRequested())
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Shutdown requested");
-
-        boost::this_thread::interruption_point();
-
-        if (data.empty())
-            return;
-
-        UniValue claims(UniValue::VARR);
-        for (auto& claim : data.claims)
-            claims.push_back(claimToJSON(coinsCache, claim));
-
-        UniValue nodeObj(UniValue::VOBJ);
-        nodeObj.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(name));
-        nodeObj.pushKV(T_CLAIMS, claims);
-        ret.push_back(nodeObj);
+    return JSONRPCWriteSpilled(request, [](const JSONRPCRequest& request) {
+        LOCK(cs_main);
+        CCoinsViewCache coinsCache(pcoinsTip.get());
+        CClaimTrieCache trieCache(pclaimTrie);
+        RollBackTo(BlockHashIndex(ParseHashV(request.params[0], T_BLOCKHASH " (optional parameter 1)")), coinsCache, trieCache);
+
+        JSONRPCArrayWriter ret(request);
+        trieCache.iterate([&ret, &coinsCache] (const std::string& name, const CClaimTrieData& data) {
+            checkInterrupted();
+
+            if (data.empty())
+                return;
+
+            UniValue claims(UniValue::VARR);
+            for (auto& claim : data.claims)
+                claims.push_back(claimToJSON(coinsCache, claim));
+
+            UniValue nodeObj(UniValue::VOBJ);
+            nodeObj.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(name));
+            nodeObj.pushKV(T_CLAIMS, claims);
+            ret.push_back(nodeObj);
+        });
+        return ret.finish();
     });
-    return ret;
 }
 
 static UniValue getclaimtrie(const JSONRPCRequest& request)
@@ -338,25 +489,88 @@ static UniValue getnamesintrie(const JSONRPCRequest& request)
 {
     validateRequest(request, GETNAMESINTRIE, 0, 1);
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
+    auto view = pclaimTrie->getReadView();
+    const int nHeight = request.params.empty() ? view->nNextHeight - 1 : BlockHashHeight(request.params[0], T_BLOCKHASH " (optional parameter 1)");
+    {
+        JSONRPCArrayWriter ret(request);
+        if (iterateNamesAt(*view, nHeight, [&ret](const std::string& name, const CClaimNameState& state) {
+            if (!state.claims.empty())
+                ret.push_back(escapeNonUtf8(name));
+        }))
+            return ret.finish();
+    }
+
+    return JSONRPCWriteSpilled(request, [](const JSONRPCRequest& request) {
+        LOCK(cs_main);
+        CCoinsViewCache coinsCache(pcoinsTip.get());
+        CClaimTrieCache trieCache(pclaimTrie);
+        RollBackTo(BlockHashIndex(ParseHashV(request.params[0], T_BLOCKHASH " (optional parameter 1)")), coinsCache, trieCache);
+
+        JSONRPCArrayWriter ret(request);
+        trieCache.iterate([&ret](const std::string &name, const CClaimTrieData &data) {
+            if (!data.empty())
+                ret.push_back(escapeNonUtf8(name));
+            checkInterrupted();
+        });
+        return ret.finish();
+    });
+}
 
-    if (!request.params.empty()) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[0], T_BLOCKHASH " (optional parameter 1)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
+static UniValue listnames(const JSONRPCRequest& request)
+{
+    validateRequest(request, LISTNAMES, 0, 4);
+
+    std::string prefix;
+    if (request.params.size() > 0)
+        prefix = request.params[0].get_str();
+
+    // the cursor is the hex of the last name handed out, names that aren't UTF-8 are escaped in the list
+    std::string after;
+    const bool fAfter = request.params.size() > 1 && !request.params[1].isNull();
+    if (fAfter) {
+        auto cursor = ParseHexV(request.params[1], T_CURSOR " (optional parameter 2)");
+        after.assign(cursor.begin(), cursor.end());
     }
 
-    UniValue ret(UniValue::VARR);
-    trieCache.iterate([&ret](const std::string &name, const CClaimTrieData &data) {
-        if (!data.empty())
-            ret.push_back(escapeNonUtf8(name));
-        if (ShutdownRequested())
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Shutdown requested");
+    int limit = DEFAULT_LISTNAMES_LIMIT;
+    if (request.params.size() > 2)
+        limit = request.params[2].get_int();
+    if (limit <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, T_LIMIT " (optional parameter 3) should be a positive value");
 
-        boost::this_thread::interruption_point();
+    bool fControlling = false;
+    if (request.params.size() > 3)
+        fControlling = request.params[3].get_bool();
+
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+
+    UniValue names(UniValue::VARR);
+    std::string last;
+    bool fMore = false;
+    pclaimTrie->iterateNames(prefix, fAfter ? &after : nullptr, fControlling, [&](const std::string& name, const CClaimTrieData& data) {
+        if (names.size() == std::size_t(limit)) {
+            fMore = true;
+            return false;
+        }
+        checkInterrupted();
+        last = name;
+        if (!fControlling) {
+            names.push_back(escapeNonUtf8(name));
+            return true;
+        }
+        auto claim = claimToJSON(coinsCache, data.claims.front());
+        claim.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(name));
+        claim.pushKV(T_EFFECTIVEAMOUNT, data.claims.front().nEffectiveAmount);
+        claim.pushKV(T_LASTTAKEOVERHEIGHT, data.nHeightOfLastTakeover);
+        names.push_back(claim);
+        return true;
     });
 
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV(T_NAMES, names);
+    if (fMore)
+        ret.pushKV(T_CURSOR, HexStr(last));
     return ret;
 }
 
@@ -364,15 +578,6 @@ static UniValue getvalueforname(const JSONRPCRequest& request)
 {
     validateRequest(request, GETVALUEFORNAME, 1, 2);
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
-
-    if (request.params.size() > 1) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[1], T_BLOCKHASH " (optional parameter 2)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
-
     std::string claimId;
     if (request.params.size() > 2)
         ParseClaimtrieId(request.params[2], claimId, T_CLAIMID " (optional parameter 3)");
@@ -380,7 +585,9 @@ static UniValue getvalueforname(const JSONRPCRequest& request)
     const auto name = request.params[0].get_str();
     UniValue ret(UniValue::VOBJ);
 
-    auto csToName = trieCache.getClaimsForName(name);
+    CCoinsView viewDummy;
+    CCoinsViewCache coinsCache(&viewDummy);
+    auto csToName = getClaimsForNameAt(name, request.params[1], T_BLOCKHASH " (optional parameter 2)", coinsCache);
     if (csToName.claimsNsupports.empty())
         return ret;
 
@@ -391,38 +598,17 @@ static UniValue getvalueforname(const JSONRPCRequest& request)
     if (claimNsupports.IsNull())
         return ret;
 
-    std::size_t seq = 0, bid = 0;
-    if (csToName.claimsNsupports.size() > 1) {
-        auto& claimId = claimNsupports.claim.claimId;
-        auto seqOrder = seqSort(csToName.claimsNsupports);
-        seq = indexOf(seqOrder, claimId);
-        bid = indexOf(csToName.claimsNsupports, claimId);
-    }
-
-    ret.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
-    ret.pushKVs(claimAndSupportsToJSON(coinsCache, claimNsupports));
-    ret.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
-    ret.pushKV(T_BID, (int)bid);
-    ret.pushKV(T_SEQUENCE, (int)seq);
-
-    return ret;
+    return claimForNameToJSON(coinsCache, csToName, claimNsupports);
 }
 
 UniValue getclaimsforname(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMSFORNAME, 1, 1);
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
-
-    if (request.params.size() > 1) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[1], T_BLOCKHASH " (optional parameter 2)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
-
     std::string name = request.params[0].get_str();
-    auto csToName = trieCache.getClaimsForName(name);
+    CCoinsView viewDummy;
+    CCoinsViewCache coinsCache(&viewDummy);
+    auto csToName = getClaimsForNameAt(name, request.params[1], T_BLOCKHASH " (optional parameter 2)", coinsCache);
 
     UniValue result(UniValue::VOBJ);
     result.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
@@ -452,10 +638,6 @@ UniValue getclaimbybid(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMBYBID, 1, 2);
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
-
     int bid = 0;
     if (request.params.size() > 1)
         bid = request.params[1].get_int();
@@ -463,13 +645,10 @@ UniValue getclaimbybid(const JSONRPCRequest& request)
     if (bid < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, T_BID " (parameter 2) should not be a negative value");
 
-    if (request.params.size() > 2) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[2], T_BLOCKHASH " (optional parameter 3)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
-
     std::string name = request.params[0].get_str();
-    auto csToName = trieCache.getClaimsForName(name);
+    CCoinsView viewDummy;
+    CCoinsViewCache coinsCache(&viewDummy);
+    auto csToName = getClaimsForNameAt(name, request.params[2], T_BLOCKHASH " (optional parameter 3)", coinsCache);
 
     UniValue result(UniValue::VOBJ);
 
@@ -495,10 +674,6 @@ UniValue getclaimbyseq(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMBYSEQ, 1, 2);
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
-
     int seq = 0;
     if (request.params.size() > 1)
         seq = request.params[1].get_int();
@@ -506,13 +681,10 @@ UniValue getclaimbyseq(const JSONRPCRequest& request)
     if (seq < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, T_SEQUENCE " (parameter 2) should not be a negative value");
 
-    if (request.params.size() > 2) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[2], T_BLOCKHASH " (optional parameter 3)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
-
     std::string name = request.params[0].get_str();
-    auto csToName = trieCache.getClaimsForName(name);
+    CCoinsView viewDummy;
+    CCoinsViewCache coinsCache(&viewDummy);
+    auto csToName = getClaimsForNameAt(name, request.params[2], T_BLOCKHASH " (optional parameter 3)", coinsCache);
 
     UniValue result(UniValue::VOBJ);
 
@@ -540,10 +712,6 @@ UniValue getclaimbyid(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMBYID, 1, 0);
 
-    LOCK(cs_main);
-    CClaimTrieCache trieCache(pclaimTrie);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-
     std::string claimId;
     ParseClaimtrieId(request.params[0], claimId, T_CLAIMID " (parameter 1)");
 
@@ -553,22 +721,16 @@ UniValue getclaimbyid(const JSONRPCRequest& request)
     std::string name;
     CClaimValue claim;
     UniValue ret(UniValue::VOBJ);
-    bool found = claimId.length() == claimIdHexLength && getClaimById(uint160S(claimId), name, &claim);
-    if (found || getClaimById(claimId, name, &claim)) {
-        auto csToName = trieCache.getClaimsForName(name);
+    auto view = pclaimTrie->getReadView();
+    bool found = claimId.length() == claimIdHexLength && view->getClaimById(uint160S(claimId), name, &claim);
+    if (found || view->getClaimById(claimId, name, &claim)) {
+        auto csToName = view->getClaimsForName(name);
         auto& claimNsupports = csToName.find(claim.claimId);
         if (!claimNsupports.IsNull()) {
-            std::size_t seq = 0, bid = 0;
-            if (csToName.claimsNsupports.size() > 1) {
-                auto seqOrder = seqSort(csToName.claimsNsupports);
-                seq = indexOf(seqOrder, claim.claimId);
-                bid = indexOf(csToName.claimsNsupports, claim.claimId);
-            }
-            ret.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
-            ret.pushKVs(claimAndSupportsToJSON(coinsCache, claimNsupports));
-            ret.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
-            ret.pushKV(T_BID, (int)bid);
-            ret.pushKV(T_SEQUENCE, (int)seq);
+            CCoinsView viewDummy;
+            CCoinsViewCache coinsCache(&viewDummy);
+            fillHistoricalCoins(coinsCache, outPointsOf(csToName));
+            ret = claimForNameToJSON(coinsCache, csToName, claimNsupports);
         }
     }
     return ret;
@@ -578,8 +740,7 @@ UniValue gettotalclaimednames(const JSONRPCRequest& request)
 {
     validateRequest(request, GETTOTALCLAIMEDNAMES, 0, 0);
 
-    LOCK(cs_main);
-    auto num_names = pclaimTrie->getTotalNamesInTrie();
+    auto num_names = pclaimTrie->getReadView()->getTotals().nNames;
     return int(num_names);
 }
 
@@ -587,8 +748,7 @@ UniValue gettotalclaims(const JSONRPCRequest& request)
 {
     validateRequest(request, GETTOTALCLAIMS, 0, 0);
 
-    LOCK(cs_main);
-    auto num_claims = pclaimTrie->getTotalClaimsInTrie();
+    auto num_claims = pclaimTrie->getReadView()->getTotals().nClaims;
     return int(num_claims);
 }
 
@@ -596,11 +756,11 @@ UniValue gettotalvalueofclaims(const JSONRPCRequest& request)
 {
     validateRequest(request, GETTOTALVALUEOFCLAIMS, 0, 1);
 
-    LOCK(cs_main);
     bool controlling_only = false;
     if (request.params.size() == 1)
         controlling_only = request.params[0].get_bool();
-    auto total_amount = pclaimTrie->getTotalValueOfClaimsInTrie(controlling_only);
+    auto totals = pclaimTrie->getReadView()->getTotals();
+    auto total_amount = controlling_only ? totals.nControllingValue : totals.nValue;
     return ValueFromAmount(total_amount);
 }
 
@@ -685,6 +845,105 @@ UniValue getclaimsfortx(const JSONRPCRequest& request)
     return ret;
 }
 
+// the claim trie after a block made of every transaction in the mempool, parents first
+static void mempoolToCache(CClaimTrieCache& trieCache) EXCLUSIVE_LOCKS_REQUIRED(cs_main, mempool.cs)
+{
+    std::vector<CTxMemPool::txiter> entries;
+    entries.reserve(mempool.mapTx.size());
+    for (auto it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+        entries.push_back(it);
+    std::sort(entries.begin(), entries.end(), [](CTxMemPool::txiter lhs, CTxMemPool::txiter rhs) {
+        return lhs->GetCountWithAncestors() < rhs->GetCountWithAncestors();
+    });
+
+    CUpdateCacheCallbacks callbacks;
+    callbacks.findScriptKey = [](const COutPoint& point) {
+        auto tx = mempool.get(point.hash);
+        return tx && point.n < tx->vout.size() ? tx->vout[point.n].scriptPubKey : CScript{};
+    };
+
+    insertUndoType dummyInsertUndo, dummyInsertSupportUndo;
+    claimQueueRowType dummyExpireUndo;
+    supportQueueRowType dummyExpireSupportUndo;
+    std::vector<std::pair<std::string, int>> dummyTakeoverHeightUndo;
+
+    trieCache.initializeIncrement();
+    CCoinsViewCache view(pcoinsTip.get());
+    for (auto it : entries)
+        UpdateCache(it->GetTx(), trieCache, view, chainActive.Height() + 1, callbacks);
+    trieCache.incrementBlock(dummyInsertUndo, dummyExpireUndo, dummyInsertSupportUndo, dummyExpireSupportUndo, dummyTakeoverHeightUndo);
+}
+
+UniValue getpendingclaims(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETPENDINGCLAIMS, 1, 2);
+
+    const auto name = request.params[0].get_str();
+    std::string claimId;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        ParseClaimtrieId(request.params[1], claimId, T_CLAIMID " (optional parameter 2)");
+    if (name.empty() && claimId.length() != claimIdHexLength)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, T_CLAIMID " must be a full one when " T_NAME " is empty");
+    const bool fProjected = request.params.size() > 2 && !request.params[2].isNull() && request.params[2].get_bool();
+
+    auto outPoints = name.empty() ? mempool.GetClaimsById(uint160S(claimId)) : mempool.GetClaimsForName(name);
+
+    UniValue pending(UniValue::VARR);
+    std::vector<std::string> names;
+    for (auto& outPoint : outPoints) {
+        auto tx = mempool.get(outPoint.hash);
+        if (!tx)
+            continue; // mined or evicted since
+        auto& txout = tx->vout[outPoint.n];
+        int op;
+        std::vector<std::vector<unsigned char>> vvchParams;
+        if (!DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
+            continue;
+        auto pendingId = op == OP_CLAIM_NAME ? ClaimIdHash(outPoint.hash, outPoint.n) : uint160(vvchParams[1]);
+        if (!claimId.empty() && pendingId.GetHex().find(claimId) != 0)
+            continue;
+
+        std::string sName(vvchParams[0].begin(), vvchParams[0].end());
+        UniValue o(UniValue::VOBJ);
+        o.pushKV(T_NAME, escapeNonUtf8(sName));
+        o.pushKV(T_CLAIMTYPE, op == OP_CLAIM_NAME ? "claim" : op == OP_UPDATE_CLAIM ? "update" : "support");
+        o.pushKV(T_CLAIMID, pendingId.GetHex());
+        o.pushKV(T_TXID, outPoint.hash.GetHex());
+        o.pushKV(T_N, (int)outPoint.n);
+        o.pushKV(T_AMOUNT, txout.nValue);
+        std::string value;
+        if (extractValue(txout.scriptPubKey, value))
+            o.pushKV(T_VALUE, value);
+        CTxDestination address;
+        if (ExtractDestination(txout.scriptPubKey, address))
+            o.pushKV(T_ADDRESS, EncodeDestination(address));
+        pending.push_back(o);
+        names.push_back(std::move(sName));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV(T_PENDING, pending);
+    if (!fProjected)
+        return result;
+
+    UniValue projected(UniValue::VARR);
+    LOCK2(cs_main, mempool.cs);
+    CClaimTrieCache trieCache(pclaimTrie);
+    mempoolToCache(trieCache);
+    CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+    CCoinsViewCache coinsCache(&viewMemPool);
+    std::set<std::string> normalized;
+    for (auto& sName : names) {
+        if (!normalized.insert(trieCache.normalizeClaimName(sName)).second)
+            continue;
+        auto csToName = trieCache.getClaimsForName(sName);
+        if (!csToName.claimsNsupports.empty())
+            projected.push_back(claimForNameToJSON(coinsCache, csToName, csToName.claimsNsupports[0]));
+    }
+    result.pushKV(T_PROJECTED, projected);
+    return result;
+}
+
 UniValue proofToJSON(const CClaimTrieProof& proof)
 {
     UniValue result(UniValue::VOBJ);
@@ -748,26 +1007,63 @@ UniValue getnameproof(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         ParseClaimtrieId(request.params[2], claimId, T_CLAIMID " (optional parameter 3)");
 
-    std::function<bool(const CClaimValue&)> comp;
+    CClaimTrieProof proof;
+    std::string name = request.params[0].get_str();
+    bool fProof;
     if (claimId.length() == claimIdHexLength) {
-        auto claimIdx = uint160S(claimId);
-        comp = [claimIdx](const CClaimValue& claim) {
-            return claim.claimId == claimIdx;
-        };
+        fProof = trieCache.getProofForName(name, uint160S(claimId), proof);
     } else if (!claimId.empty()) {
-        comp = [&claimId](const CClaimValue& claim) {
-            return claim.claimId.GetHex().find(claimId) == 0;
-        };
+        // proofs are kept by full claim id, so a partial one is looked up first
+        auto csToName = trieCache.getClaimsForName(name);
+        auto& claimNsupports = csToName.find(claimId);
+        if (!claimNsupports.IsNull()) {
+            fProof = trieCache.getProofForName(name, claimNsupports.claim.claimId, proof);
+        } else {
+            fProof = trieCache.getProofForName(name, proof, [](const CClaimValue&) {
+                return false;
+            });
+        }
+    } else {
+        fProof = trieCache.getProofForName(name, uint160(), proof);
     }
-
-    CClaimTrieProof proof;
-    std::string name = request.params[0].get_str();
-    if (!trieCache.getProofForName(name, proof, comp))
+    if (!fProof)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to generate proof");
 
     return proofToJSON(proof);
 }
 
+UniValue getnameproofs(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETNAMEPROOFS, 1, 1);
+
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+    CClaimTrieCache trieCache(pclaimTrie);
+
+    if (request.params.size() > 1) {
+        CBlockIndex* pblockIndex = BlockHashIndex(ParseHashV(request.params[1], T_BLOCKHASH " (optional parameter 2)"));
+        RollBackTo(pblockIndex, coinsCache, trieCache);
+    }
+
+    const auto& names = request.params[0].get_array();
+    std::vector<std::pair<std::string, uint160>> namesToProve;
+    namesToProve.reserve(names.size());
+    for (std::size_t i = 0; i < names.size(); ++i)
+        namesToProve.emplace_back(names[i].get_str(), uint160());
+
+    std::vector<CClaimTrieProof> proofs;
+    if (!trieCache.getProofsForNames(namesToProve, proofs))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to generate proof");
+
+    UniValue ret(UniValue::VARR);
+    for (std::size_t i = 0; i < proofs.size(); ++i) {
+        auto proof = proofToJSON(proofs[i]);
+        proof.pushKV(T_NAME, escapeNonUtf8(namesToProve[i].first));
+        ret.push_back(proof);
+    }
+    return ret;
+}
+
 UniValue getclaimproofbybid(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMPROOFBYBID, 1, 2);
@@ -790,19 +1086,16 @@ UniValue getclaimproofbybid(const JSONRPCRequest& request)
 
     std::string name = request.params[0].get_str();
 
-    std::function<bool(const CClaimValue&)> comp;
+    uint160 claimId;
     if (bid) {
         auto csToName = trieCache.getClaimsForName(name);
         if (uint32_t(bid) >= csToName.claimsNsupports.size())
             return {UniValue::VARR};
-        auto claimId = csToName.claimsNsupports[bid].claim.claimId;
-        comp = [claimId](const CClaimValue& claim) {
-            return claim.claimId == claimId;
-        };
+        claimId = csToName.claimsNsupports[bid].claim.claimId;
     }
 
     CClaimTrieProof proof;
-    if (!trieCache.getProofForName(name, proof, comp))
+    if (!trieCache.getProofForName(name, claimId, proof))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to generate proof");
 
     return proofToJSON(proof);
@@ -833,15 +1126,11 @@ UniValue getclaimproofbyseq(const JSONRPCRequest& request)
     if (uint32_t(seq) >= csToName.claimsNsupports.size())
         return {UniValue::VARR};
 
-    std::function<bool(const CClaimValue&)> comp;
     auto claimId = (csToName.claimsNsupports.size() == 1 ?
         csToName.claimsNsupports[0] : seqSort(csToName.claimsNsupports)[seq]).claim.claimId;
-    comp = [&claimId](const CClaimValue& claim) {
-        return claim.claimId == claimId;
-    };
 
     CClaimTrieProof proof;
-    if (!trieCache.getProofForName(name, proof, comp))
+    if (!trieCache.getProofForName(name, claimId, proof))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to generate proof");
 
     return proofToJSON(proof);
@@ -891,6 +1180,107 @@ UniValue getchangesinblock(const JSONRPCRequest& request)
     return result;
 }
 
+// lbry://name, name#claimId, name:sequence or name$bid with sequence and bid counting from 1 as in LBRY URLs
+static void parseClaimUrl(const std::string& url, std::string& name, std::string& claimId, int& seq, int& bid)
+{
+    static const std::string scheme = "lbry://";
+    name = url.compare(0, scheme.size(), scheme) == 0 ? url.substr(scheme.size()) : url;
+    claimId.clear();
+    seq = bid = -1;
+
+    auto pos = name.find_first_of("#:$");
+    if (pos == std::string::npos)
+        return;
+    auto modifier = name.substr(pos + 1);
+    auto type = name[pos];
+    name.resize(pos);
+    if (type == '#') {
+        ParseClaimtrieId(UniValue(modifier), claimId, T_CLAIMID " in " + url);
+        return;
+    }
+    int32_t n;
+    if (!ParseInt32(modifier, &n) || n < 1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid " + std::string(type == ':' ? T_SEQUENCE : T_BID) + " in " + url);
+    (type == ':' ? seq : bid) = n - 1;
+}
+
+static UniValue resolve(const JSONRPCRequest& request)
+{
+    validateRequest(request, RESOLVE, 1, 0);
+
+    const auto& urls = request.params[0].get_array();
+    if (urls.size() > MAX_RESOLVE_URLS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf(T_URLS " should have at most %u entries", MAX_RESOLVE_URLS));
+    auto view = pclaimTrie->getReadView();
+
+    // the urls for the same name share its lookup, and all of them one pass over the coins
+    std::map<std::string, std::unique_ptr<CClaimSupportToName>> names;
+    std::vector<std::pair<const CClaimSupportToName*, const CClaimNsupports*>> resolved;
+    std::vector<std::pair<COutPoint, int>> outPoints;
+
+    auto claimsForName = [&view, &names](const std::string& name) -> const CClaimSupportToName& {
+        auto normalized = view->normalizeClaimName(name);
+        auto it = names.find(normalized);
+        if (it == names.end())
+            it = names.emplace(normalized, MakeUnique<CClaimSupportToName>(view->getClaimsForName(normalized))).first;
+        return *it->second;
+    };
+
+    for (std::size_t i = 0; i < urls.size(); ++i) {
+        boost::this_thread::interruption_point();
+
+        const CClaimSupportToName* csToName = nullptr;
+        const CClaimNsupports* claimNsupports = &invalid;
+        auto& url = urls[i];
+        if (url.isObject()) {
+            std::string claimId, name;
+            ParseClaimtrieId(find_value(url.get_obj(), T_CLAIMID), claimId, T_CLAIMID " in " T_URLS);
+            if (claimId.length() < 3)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, T_CLAIMID " in " T_URLS " should be at least 3 chars");
+            CClaimValue claim;
+            bool found = claimId.length() == claimIdHexLength && view->getClaimById(uint160S(claimId), name, &claim);
+            if (found || view->getClaimById(claimId, name, &claim)) {
+                csToName = &claimsForName(name);
+                claimNsupports = &csToName->find(claim.claimId);
+            }
+        } else if (url.isStr()) {
+            std::string name, claimId;
+            int seq, bid;
+            parseClaimUrl(url.get_str(), name, claimId, seq, bid);
+            csToName = &claimsForName(name);
+            auto& claims = csToName->claimsNsupports;
+            if (!claimId.empty())
+                claimNsupports = claimId.length() == claimIdHexLength ? &csToName->find(uint160S(claimId)) : &csToName->find(claimId);
+            else if (seq >= 0 && std::size_t(seq) < claims.size())
+                claimNsupports = &csToName->find(seqSort(claims)[seq].claim.claimId);
+            else if (bid < 0 && seq < 0 && !claims.empty())
+                claimNsupports = &claims[0];
+            else if (bid >= 0 && std::size_t(bid) < claims.size())
+                claimNsupports = &claims[bid];
+        } else {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, T_URLS " should only contain strings and objects");
+        }
+
+        if (claimNsupports->IsNull()) {
+            resolved.emplace_back(nullptr, nullptr);
+            continue;
+        }
+        resolved.emplace_back(csToName, claimNsupports);
+        outPoints.emplace_back(claimNsupports->claim.outPoint, claimNsupports->claim.nHeight);
+        for (auto& support : claimNsupports->supports)
+            outPoints.emplace_back(support.outPoint, support.nHeight);
+    }
+
+    CCoinsView viewDummy;
+    CCoinsViewCache coinsCache(&viewDummy);
+    fillHistoricalCoins(coinsCache, outPoints);
+
+    UniValue ret(UniValue::VARR);
+    for (auto& result : resolved)
+        ret.push_back(result.first ? claimForNameToJSON(coinsCache, *result.first, *result.second) : UniValue(UniValue::VOBJ));
+    return ret;
+}
+
 UniValue checknormalization(const JSONRPCRequest& request)
 {
     validateRequest(request, CHECKNORMALIZATION, 1, 0);
@@ -902,19 +1292,61 @@ UniValue checknormalization(const JSONRPCRequest& request)
     return triecache.normalizeClaimName(name, force);
 }
 
+static UniValue getclaimtrietimings(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETCLAIMTRIETIMINGS, 0, 0);
+
+    auto timings = GetClaimTrieTimings();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV(T_BLOCKS, timings.nBlocks);
+    ret.pushKV(T_SCRIPTS, timings.nTimeScripts * 0.000001);
+    ret.pushKV(T_QUEUES, timings.nTimeQueues * 0.000001);
+    ret.pushKV(T_TAKEOVERS, timings.nTimeTakeovers * 0.000001);
+    ret.pushKV(T_MERKLEHASH, timings.nTimeMerkle * 0.000001);
+    ret.pushKV(T_FLUSH, timings.nTimeFlush * 0.000001);
+    ret.pushKV(T_FLUSHBYTES, timings.nFlushBytes);
+    return ret;
+}
+
+static UniValue dumpclaimtrie(const JSONRPCRequest& request)
+{
+    validateRequest(request, DUMPCLAIMTRIE, 1, 0);
+
+    auto path = AbsPathForConfigVal(request.params[0].get_str());
+    // as dumpwallet, so that no file is overwritten by mistake
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists. If you are sure this is what you want, move it out of the way first");
+
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nRows;
+    if (!DumpClaimTrieSnapshot(path, hashBlock, nHeight, nRows))
+        throw JSONRPCError(RPC_MISC_ERROR, "Error writing the claim trie snapshot, see the log for details");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV(T_BLOCKHASH, hashBlock.GetHex());
+    ret.pushKV(T_HEIGHT, nHeight);
+    ret.pushKV(T_ROWS, nRows);
+    ret.pushKV(T_FILENAME, path.string());
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                            actor (function)            argNames
   //  --------------------- ------------------------        -----------------------     ----------
     { "Claimtrie",          "getclaimsintrie",              &getclaimsintrie,           { T_BLOCKHASH } },
     { "Claimtrie",          "getnamesintrie",               &getnamesintrie,            { T_BLOCKHASH } },
     { "hidden",             "getclaimtrie",                 &getclaimtrie,              { } },
+    { "Claimtrie",          "listnames",                    &listnames,                 { T_PREFIX,T_CURSOR,T_LIMIT,T_CONTROLLING } },
     { "Claimtrie",          "getvalueforname",              &getvalueforname,           { T_NAME,T_BLOCKHASH,T_CLAIMID } },
     { "Claimtrie",          "getclaimsforname",             &getclaimsforname,          { T_NAME,T_BLOCKHASH } },
     { "Claimtrie",          "gettotalclaimednames",         &gettotalclaimednames,      { } },
     { "Claimtrie",          "gettotalclaims",               &gettotalclaims,            { } },
     { "Claimtrie",          "gettotalvalueofclaims",        &gettotalvalueofclaims,     { T_CONTROLLINGONLY } },
     { "Claimtrie",          "getclaimsfortx",               &getclaimsfortx,            { T_TXID } },
+    { "Claimtrie",          "getpendingclaims",             &getpendingclaims,          { T_NAME,T_CLAIMID,T_PROJECTED } },
     { "Claimtrie",          "getnameproof",                 &getnameproof,              { T_NAME,T_BLOCKHASH,T_CLAIMID } },
+    { "Claimtrie",          "getnameproofs",                &getnameproofs,             { T_NAMES,T_BLOCKHASH } },
     { "Claimtrie",          "getclaimproofbybid",           &getclaimproofbybid,        { T_NAME,T_BID,T_BLOCKHASH } },
     { "Claimtrie",          "getclaimproofbyseq",           &getclaimproofbyseq,        { T_NAME,T_SEQUENCE,T_BLOCKHASH } },
     { "Claimtrie",          "getclaimbyid",                 &getclaimbyid,              { T_CLAIMID } },
@@ -922,6 +1354,9 @@ static const CRPCCommand commands[] =
     { "Claimtrie",          "getclaimbyseq",                &getclaimbyseq,             { T_NAME,T_SEQUENCE,T_BLOCKHASH } },
     { "Claimtrie",          "getchangesinblock",            &getchangesinblock,         { T_BLOCKHASH } },
     { "Claimtrie",          "checknormalization",           &checknormalization,        { T_NAME } },
+    { "Claimtrie",          "resolve",                      &resolve,                   { T_URLS } },
+    { "Claimtrie",          "getclaimtrietimings",          &getclaimtrietimings,       { } },
+    { "Claimtrie",          "dumpclaimtrie",                &dumpclaimtrie,             { T_FILENAME } },
 };
 
 void RegisterClaimTrieRPCCommands(CRPCTable &tableRPC)
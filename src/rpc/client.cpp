@@ -175,12 +175,17 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listnameclaims", 0, "includesupports"},
     { "listnameclaims", 1, "activeonly"},
     { "listnameclaims", 2, "minconf"},
+    { "listnames", 2, "limit"},
+    { "listnames", 3, "controlling"},
     { "getclaimbybid", 1, "bid"},
     { "getclaimbyseq", 1, "sequence"},
+    { "getnameproofs", 0, "names"},
+    { "getpendingclaims", 2, "projected"},
     { "getclaimproofbybid", 1, "bid"},
     { "getclaimproofbyseq", 1, "sequence"},
     { "supportclaim", 4, "isTip"},
     { "gettotalvalueofclaims", 0, "controlling_only"},
+    { "resolve", 0, "urls"},
 };
 
 class CRPCConvertTable
@@ -10,6 +10,8 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/common.h>
+#include <hash.h>
 #include <validation.h>
 #include <key_io.h>
 #include <miner.h>
@@ -111,6 +113,7 @@ static UniValue getnetworkhashps(const JSONRPCRequest& request)
 UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript)
 {
     static const int nInnerLoopCount = 0x10000;
+    static const uint64_t nMaxNonceBatch = 8;
     int nHeightEnd = 0;
     int nHeight = 0;
 
@@ -131,9 +134,28 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetPoWHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
+        // the nonces are tried a batch at a time, the batches doubling up to what PoWHashes hashes side by side
+        unsigned char headers[nMaxNonceBatch * CBlockHeader::SERIALIZED_SIZE];
+        uint256 hashes[nMaxNonceBatch];
+        pblock->SerializeTo(headers);
+        uint64_t nBatch = 1;
+        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount) {
+            auto n = std::min({nBatch, nMaxTries, uint64_t(nInnerLoopCount - pblock->nNonce)});
+            for (uint64_t i = 0; i < n; ++i) {
+                auto header = headers + i * CBlockHeader::SERIALIZED_SIZE;
+                if (i > 0)
+                    memcpy(header, headers, CBlockHeader::SERIALIZED_SIZE);
+                WriteLE32(header + CBlockHeader::SERIALIZED_SIZE - 4, pblock->nNonce + i);
+            }
+            PoWHashes(hashes, headers, CBlockHeader::SERIALIZED_SIZE, n);
+            uint64_t i = 0;
+            while (i < n && !CheckProofOfWork(hashes[i], pblock->nBits, Params().GetConsensus()))
+                ++i;
+            pblock->nNonce += i;
+            nMaxTries -= i;
+            if (i < n)
+                break;
+            nBatch = std::min(2 * nBatch, nMaxNonceBatch);
         }
         if (nMaxTries == 0) {
             break;
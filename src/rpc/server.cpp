@@ -412,6 +412,78 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
+/** Bytes of JSON text collected before they are written out */
+static const std::size_t JSON_ARRAY_WRITE_SIZE = 1 << 16;
+
+JSONRPCArrayWriter::JSONRPCArrayWriter(const JSONRPCRequest& request) : request(request), array(UniValue::VARR), fEmpty(true)
+{
+}
+
+void JSONRPCArrayWriter::push_back(const UniValue& value)
+{
+    if (!request.writeResult) {
+        array.push_back(value);
+        return;
+    }
+    text += fEmpty ? '[' : ',';
+    text += value.write();
+    fEmpty = false;
+    if (text.size() >= JSON_ARRAY_WRITE_SIZE) {
+        request.writeResult(text);
+        text.clear();
+    }
+}
+
+UniValue JSONRPCArrayWriter::finish()
+{
+    if (!request.writeResult)
+        return std::move(array);
+    text += fEmpty ? "[]" : "]";
+    request.writeResult(text);
+    text.clear();
+    return NullUniValue;
+}
+
+UniValue JSONRPCWriteSpilled(const JSONRPCRequest& request, const std::function<UniValue(const JSONRPCRequest&)>& write)
+{
+    if (!request.writeResult)
+        return write(request);
+
+    // the file goes however the call ends
+    struct CSpillFile {
+        fs::path path;
+        FILE* file;
+        ~CSpillFile()
+        {
+            if (file)
+                fclose(file);
+            boost::system::error_code ec;
+            fs::remove(path, ec);
+        }
+    } spill{GetDataDir() / fs::unique_path("rpc-%%%%-%%%%-%%%%-%%%%.json"), nullptr};
+    spill.file = fsbridge::fopen(spill.path, "w+b");
+    if (!spill.file)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to create a file for the result");
+
+    JSONRPCRequest spilled(request);
+    FILE* file = spill.file;
+    spilled.writeResult = [file](const std::string& text) {
+        if (fwrite(text.data(), 1, text.size(), file) != text.size())
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Error writing the result to a file");
+    };
+    auto ret = write(spilled);
+    if (!ret.isNull())
+        return ret;
+
+    rewind(file);
+    std::vector<char> buffer(JSON_ARRAY_WRITE_SIZE);
+    while (std::size_t nRead = fread(buffer.data(), 1, buffer.size(), file))
+        request.writeResult(std::string(buffer.data(), nRead));
+    if (ferror(file))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Error reading the result back from a file");
+    return NullUniValue;
+}
+
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
     UniValue ret(UniValue::VARR);
@@ -10,6 +10,7 @@
 #include <rpc/protocol.h>
 #include <uint256.h>
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -46,11 +47,41 @@ public:
     std::string URI;
     std::string authUser;
     std::string peerAddr;
+    /** Set when the caller can take the result as JSON text in parts, see JSONRPCArrayWriter */
+    std::function<void(const std::string&)> writeResult;
 
     JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
     void parse(const UniValue& valRequest);
 };
 
+/**
+ * Result of an RPC call that is an array of many elements. When the request takes its result
+ * in parts, the elements are written out a batch at a time as they come, so the whole array
+ * is never held in memory; otherwise they are collected as usual.
+ */
+class JSONRPCArrayWriter
+{
+public:
+    explicit JSONRPCArrayWriter(const JSONRPCRequest& request);
+
+    void push_back(const UniValue& value);
+    /** The array, or null if it was written out already. Call it once, at the end. */
+    UniValue finish();
+
+private:
+    const JSONRPCRequest& request;
+    UniValue array;
+    std::string text;
+    bool fEmpty;
+};
+
+/**
+ * Result of an RPC call made while holding a lock. When the request takes its result in parts,
+ * write gets one whose parts go to a temporary file, and they are passed on from there once write
+ * is done, so a slow client doesn't keep the lock held; otherwise write gets the request itself.
+ */
+UniValue JSONRPCWriteSpilled(const JSONRPCRequest& request, const std::function<UniValue(const JSONRPCRequest&)>& write);
+
 /** Query whether RPC is running */
 bool IsRPCRunning();
 
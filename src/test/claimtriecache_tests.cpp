@@ -7,6 +7,7 @@
 #include <test/test_bitcoin.h>
 #include <boost/test/unit_test.hpp>
 #include <boost/scope_exit.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -21,6 +22,8 @@ public:
     using CClaimTrieCacheBase::removeSupportFromMap;
     using CClaimTrieCacheBase::insertClaimIntoTrie;
     using CClaimTrieCacheBase::removeClaimFromTrie;
+    using CClaimTrieCacheBase::getQueueCacheRow;
+    using CClaimTrieCacheBase::getExpirationQueueCacheRow;
 
     void insert(const std::string& key, CClaimTrieData&& data)
     {
@@ -314,6 +317,719 @@ BOOST_AUTO_TEST_CASE(trie_stays_consistent_test)
     BOOST_CHECK(trie.empty());
 }
 
+BOOST_AUTO_TEST_CASE(paged_trie_matches_resident_trie_test)
+{
+    std::vector<std::string> names {
+        "goodness", "goodnight", "goodnatured", "goods", "go", "goody", "goo"
+    };
+
+    CClaimTrie resident(true, false, 1);
+    CClaimTrie paged(true, false, 1, 200, 1); // everything goes over a one byte budget
+    CClaimTrieCacheTest residentCache(&resident);
+    CClaimTrieCacheTest pagedCache(&paged);
+
+    std::vector<CClaimValue> values;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        values.emplace_back(COutPoint(uint256S("01"), i), ClaimIdHash(uint256S("01"), i), CAmount(i + 1), 0, 0);
+        BOOST_CHECK(residentCache.insertClaimIntoTrie(names[i], values.back(), false));
+        BOOST_CHECK(pagedCache.insertClaimIntoTrie(names[i], values.back(), false));
+    }
+    BOOST_CHECK(residentCache.flush());
+    BOOST_CHECK(pagedCache.flush());
+
+    for (auto& name : names)
+        BOOST_CHECK(paged.find(name)->fPagedOut);
+    BOOST_CHECK_EQUAL(residentCache.getMerkleHash(), pagedCache.getMerkleHash());
+    BOOST_CHECK(pagedCache.checkConsistency());
+    BOOST_CHECK_EQUAL(resident.getTotalClaimsInTrie(), paged.getTotalClaimsInTrie());
+
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        CClaimValue claim;
+        BOOST_CHECK(pagedCache.getInfoForName(names[i], claim));
+        BOOST_CHECK(claim == values[i]);
+        BOOST_CHECK(!paged.find(names[i])->fPagedOut);
+    }
+
+    for (std::size_t i = 0; i < names.size(); i += 2) {
+        CClaimValue claim;
+        BOOST_CHECK(residentCache.removeClaimFromTrie(names[i], values[i].outPoint, claim, false));
+        BOOST_CHECK(pagedCache.removeClaimFromTrie(names[i], values[i].outPoint, claim, false));
+    }
+    BOOST_CHECK(residentCache.flush());
+    BOOST_CHECK(pagedCache.flush());
+    BOOST_CHECK_EQUAL(residentCache.getMerkleHash(), pagedCache.getMerkleHash());
+    BOOST_CHECK(pagedCache.checkConsistency());
+
+    // a lazy load from disk leaves every node paged out
+    BOOST_CHECK(pagedCache.ReadFromDisk(nullptr));
+    BOOST_CHECK(paged.find("goodnight")->fPagedOut);
+    BOOST_CHECK_EQUAL(residentCache.getMerkleHash(), pagedCache.getMerkleHash());
+    CClaimValue claim;
+    BOOST_CHECK(!pagedCache.getInfoForName("goodness", claim));
+    BOOST_CHECK(pagedCache.getInfoForName("goodnight", claim));
+    BOOST_CHECK(claim == values[1]);
+
+    // so does one at a tip, which leaves the consistency check to the caller
+    CBlockIndex tip;
+    tip.nHeight = 0;
+    tip.hashClaimTrie = residentCache.getMerkleHash();
+    bool fDeferred = false;
+    BOOST_CHECK(pagedCache.ReadFromDisk(&tip, &fDeferred));
+    BOOST_CHECK(fDeferred);
+    BOOST_CHECK(paged.find("goodnight")->fPagedOut);
+    BOOST_CHECK(pagedCache.checkConsistency());
+}
+
+class CClaimTrieTest : public CClaimTrie
+{
+public:
+    using CClaimTrie::CClaimTrie;
+
+    bool eraseNode(const std::string& name)
+    {
+        return db->Erase(std::make_pair(TRIE_NODE, name));
+    }
+
+    // a flush of rows (erasing those of an empty row) that takes the trie to nNewNextHeight
+    void flushQueueRows(const std::map<std::pair<uint8_t, int>, expirationQueueRowType>& queueRows, int nNewNextHeight)
+    {
+        CPendingBatch batch;
+        for (auto& row : queueRows) {
+            const auto key = std::make_pair(row.first.first, CQueueHeight(row.first.second));
+            if (row.second.empty())
+                batch.Erase(key);
+            else
+                batch.Write(key, row.second);
+        }
+        applyPending(std::move(batch.rows), nNewNextHeight);
+    }
+
+    // a row as written before CQueueHeight
+    bool writeOldQueueRow(uint8_t dbkey, int nHeight, const expirationQueueRowType& row)
+    {
+        return db->Write(std::make_pair(dbkey, nHeight), row);
+    }
+
+    bool hasOldQueueRow(uint8_t dbkey, int nHeight) const
+    {
+        return db->Exists(std::make_pair(dbkey, nHeight));
+    }
+
+    // a row as written before CNameHistoryRow
+    bool writeOldHistoryRow(const std::string& name, int nHeight, const CClaimNameState& state)
+    {
+        return db->Write(std::make_pair(TRIE_NAME_HISTORY_V1, std::make_pair(name, CHistoryHeight(nHeight))), state);
+    }
+
+    bool hasOldHistoryRow(const std::string& name, int nHeight) const
+    {
+        return db->Exists(std::make_pair(TRIE_NAME_HISTORY_V1, std::make_pair(name, CHistoryHeight(nHeight))));
+    }
+
+    using CClaimTrie::getNameStateAt;
+};
+
+BOOST_AUTO_TEST_CASE(paged_trie_read_error_test)
+{
+    CClaimTrieTest paged(true, false, 1, 200, 1);
+    CClaimTrieCacheTest cache(&paged);
+    CClaimValue value(COutPoint(uint256S("01"), 0), ClaimIdHash(uint256S("01"), 0), 1, 0, 0);
+    BOOST_CHECK(cache.insertClaimIntoTrie("test", value, false));
+    BOOST_CHECK(cache.flush());
+    BOOST_CHECK(paged.WritePending(uint256S("01")));
+    BOOST_CHECK(paged.find("test")->fPagedOut);
+
+    // the node can't be read back, so the flush fails rather than the totals being counted without it
+    BOOST_CHECK(paged.eraseNode("test"));
+    CClaimValue other(COutPoint(uint256S("02"), 0), ClaimIdHash(uint256S("02"), 0), 2, 0, 0);
+    BOOST_CHECK(cache.insertClaimIntoTrie("test", other, false));
+    BOOST_CHECK(!cache.flush());
+}
+
+BOOST_AUTO_TEST_CASE(queue_rows_read_ahead_test)
+{
+    CClaimTrieTest trie(true, false, 1);
+    const auto row = [](const std::string& name) {
+        return expirationQueueRowType{CNameOutPointType(name, COutPoint(uint256S("01"), 0))};
+    };
+    // the name of the one entry of the row of dbkey at nHeight, empty if there is no row
+    const auto read = [&trie](uint8_t dbkey, int nHeight) {
+        expirationQueueRowType queueRow;
+        if (!trie.ReadQueueRow(dbkey, nHeight, queueRow))
+            return std::string();
+        BOOST_CHECK_EQUAL(queueRow.size(), 1U);
+        return queueRow.front().name;
+    };
+
+    // rows below, within and past the window of the next QUEUE_WINDOW_HEIGHTS heights
+    trie.flushQueueRows({{{CLAIM_EXP_QUEUE_ROW, 9}, row("a")}, {{CLAIM_EXP_QUEUE_ROW, 10}, row("b")},
+        {{CLAIM_EXP_QUEUE_ROW, 11}, row("c")}, {{CLAIM_EXP_QUEUE_ROW, 10 + QUEUE_WINDOW_HEIGHTS}, row("d")},
+        {{SUPPORT_EXP_QUEUE_ROW, 11}, row("e")}}, 10);
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 11), "c");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 10), "b");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 12), "");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 9), "a");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 10 + QUEUE_WINDOW_HEIGHTS), "d");
+    BOOST_CHECK_EQUAL(read(SUPPORT_EXP_QUEUE_ROW, 11), "e");
+    BOOST_CHECK_EQUAL(read(SUPPORT_QUEUE_ROW, 11), "");
+
+    // the rows read ahead follow the flushes, whether they are written to db or still pending
+    trie.flushQueueRows({{{CLAIM_EXP_QUEUE_ROW, 11}, row("f")}, {{CLAIM_EXP_QUEUE_ROW, 12}, row("g")}}, 11);
+    BOOST_CHECK(trie.WritePending(uint256()));
+    trie.flushQueueRows({{{CLAIM_EXP_QUEUE_ROW, 10}, {}}, {{CLAIM_EXP_QUEUE_ROW, 13}, row("h")}}, 11);
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 11), "f");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 12), "g");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 13), "h");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 10), "");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 9), "a");
+
+    // moving past the rows read ahead reads the next ones
+    trie.flushQueueRows({}, 12 + QUEUE_WINDOW_HEIGHTS / 2);
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 10 + QUEUE_WINDOW_HEIGHTS), "d");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 13), "h");
+
+    // rows keyed by a little endian height are moved to their keys on load, those of 255 and 256
+    // being in the wrong order before
+    BOOST_CHECK(trie.WritePending(uint256()));
+    BOOST_CHECK(trie.writeOldQueueRow(CLAIM_QUEUE_ROW_LE, 255, row("i")));
+    BOOST_CHECK(trie.writeOldQueueRow(CLAIM_QUEUE_ROW_LE, 256, row("j")));
+    BOOST_CHECK(trie.writeOldQueueRow(SUPPORT_EXP_QUEUE_ROW_LE, 70000, row("k")));
+    BOOST_CHECK(CClaimTrieCache(&trie).ReadFromDisk(nullptr));
+    BOOST_CHECK(!trie.hasOldQueueRow(CLAIM_QUEUE_ROW_LE, 255));
+    BOOST_CHECK(!trie.hasOldQueueRow(CLAIM_QUEUE_ROW_LE, 256));
+    BOOST_CHECK(!trie.hasOldQueueRow(SUPPORT_EXP_QUEUE_ROW_LE, 70000));
+    trie.flushQueueRows({}, 200);
+    BOOST_CHECK_EQUAL(read(CLAIM_QUEUE_ROW, 256), "j");
+    BOOST_CHECK_EQUAL(read(CLAIM_QUEUE_ROW, 255), "i");
+    BOOST_CHECK_EQUAL(read(SUPPORT_EXP_QUEUE_ROW, 70000), "k");
+    BOOST_CHECK_EQUAL(read(CLAIM_EXP_QUEUE_ROW, 9), "a");
+}
+
+BOOST_AUTO_TEST_CASE(name_history_upgrade_test)
+{
+    CClaimTrieTest trie(true, false, 1);
+    CClaimNameState state;
+    state.claims.emplace_back(COutPoint(uint256S("01"), 0), ClaimIdHash(uint256S("01"), 0), 1, 0, 0);
+    state.nHeightOfLastTakeover = 3;
+    BOOST_CHECK(trie.writeOldHistoryRow("test", 3, state));
+    BOOST_CHECK(trie.writeOldHistoryRow("test", 1, CClaimNameState()));
+
+    // the rows are kept as full rows
+    BOOST_CHECK(CClaimTrieCache(&trie).ReadFromDisk(nullptr));
+    BOOST_CHECK(!trie.hasOldHistoryRow("test", 3));
+    BOOST_CHECK(!trie.hasOldHistoryRow("test", 1));
+    CClaimNameState stateAt;
+    BOOST_CHECK(trie.getNameStateAt("test", 4, stateAt));
+    BOOST_CHECK(stateAt == state);
+    BOOST_CHECK(trie.getNameStateAt("test", 2, stateAt));
+    BOOST_CHECK(stateAt.empty());
+}
+
+BOOST_AUTO_TEST_CASE(iterate_names_in_pages_test)
+{
+    std::vector<std::string> names {
+        "goodness", "goodnight", "goodnatured", "goods", "go", "goody", "goo", "gold", "a", "h\xe9", "good"
+    };
+
+    CClaimTrie trie(true, false, 1, 200, 1); // paged out, claims are read back only when asked for
+    trie.iterateNames("", nullptr, true, [](const std::string&, const CClaimTrieData&) {
+        BOOST_ERROR("an empty trie has no names");
+        return true;
+    });
+
+    CClaimTrieCacheTest cache(&trie);
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        CClaimValue value(COutPoint(uint256S("01"), i), ClaimIdHash(uint256S("01"), i), CAmount(i + 1), 0, 0);
+        BOOST_CHECK(cache.insertClaimIntoTrie(names[i], value, false));
+    }
+    BOOST_CHECK(cache.flush());
+
+    const auto list = [&trie](const std::string& prefix, const std::string* after, std::size_t limit, bool fClaims) {
+        std::vector<std::string> ret;
+        trie.iterateNames(prefix, after, fClaims, [&](const std::string& name, const CClaimTrieData& data) {
+            if (ret.size() == limit)
+                return false;
+            BOOST_CHECK_EQUAL(!data.claims.empty(), fClaims);
+            ret.push_back(name);
+            return true;
+        });
+        return ret;
+    };
+
+    // everything, in order, and by pages that pick up after the last name
+    auto sorted = names;
+    std::sort(sorted.begin(), sorted.end());
+    BOOST_CHECK(list("", nullptr, names.size(), false) == sorted);
+    std::vector<std::string> pages;
+    for (auto page = list("", nullptr, 3, true); !page.empty(); page = list("", &pages.back(), 3, true))
+        pages.insert(pages.end(), page.begin(), page.end());
+    BOOST_CHECK(pages == sorted);
+    BOOST_CHECK(trie.find("goodness")->fPagedOut);
+
+    // a prefix ending within an edge, and a cursor that isn't a name
+    BOOST_CHECK(list("goodn", nullptr, 10, false) == std::vector<std::string>({"goodnatured", "goodness", "goodnight"}));
+    const std::string after = "goodm";
+    BOOST_CHECK(list("goo", &after, 2, false) == std::vector<std::string>({"goodnatured", "goodness"}));
+    const std::string last = "goody";
+    BOOST_CHECK(list("go", &last, 10, false).empty());
+    BOOST_CHECK(list("gx", nullptr, 10, false).empty());
+    BOOST_CHECK(list("good", nullptr, 1, false) == std::vector<std::string>({"good"}));
+}
+
+static void checkParallelMerkleHash(const std::string& prefix)
+{
+    CClaimTrie serial(true, false, 1);
+    CClaimTrie parallel(true, false, 1);
+    CClaimTrieCacheTest serialCache(&serial);
+    CClaimTrieCacheTest parallelCache(&parallel);
+
+    for (int i = 0; i < 200; ++i) {
+        auto name = strprintf("%s%c%d", prefix, 'a' + i % 7, i);
+        CClaimValue value(COutPoint(uint256S("02"), i), ClaimIdHash(uint256S("02"), i), CAmount(i + 1), 0, 0);
+        BOOST_CHECK(serialCache.insertClaimIntoTrie(name, value, false));
+        BOOST_CHECK(parallelCache.insertClaimIntoTrie(name, value, false));
+    }
+
+    boost::thread_group threads;
+    for (int i = 0; i < 3; ++i)
+        threads.create_thread(&ThreadClaimTrieHash);
+    auto nOldThreads = nClaimTrieHashThreads;
+    nClaimTrieHashThreads = 4;
+    auto hash = parallelCache.getMerkleHash();
+    nClaimTrieHashThreads = nOldThreads;
+    threads.interrupt_all();
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(serialCache.getMerkleHash(), hash);
+    BOOST_CHECK(serialCache.flush());
+    BOOST_CHECK(parallelCache.flush());
+    BOOST_CHECK(parallelCache.checkConsistency());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_merkle_hash_matches_serial_test)
+{
+    checkParallelMerkleHash("");
+    // all under one child of the root, which is split between the threads
+    checkParallelMerkleHash("x");
+    checkParallelMerkleHash("xyz");
+}
+
+BOOST_AUTO_TEST_CASE(clean_shutdown_defers_consistency_check_test)
+{
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheTest cache(&trie);
+    CClaimValue value;
+    BOOST_CHECK(cache.insertClaimIntoTrie("test", value, false));
+    BOOST_CHECK(cache.insertClaimIntoTrie("tester", value, false));
+    BOOST_CHECK(cache.flush());
+
+    CBlockIndex tip;
+    tip.nHeight = 0;
+    tip.hashClaimTrie = cache.getMerkleHash();
+
+    // nothing may be recorded before the trie has been checked
+    BOOST_CHECK(!trie.WriteCleanShutdown());
+    bool fDeferred = true;
+    BOOST_CHECK(cache.ReadFromDisk(&tip, &fDeferred));
+    BOOST_CHECK(!fDeferred);
+    BOOST_CHECK(trie.WriteCleanShutdown());
+
+    // the marker lets exactly one load skip the check
+    BOOST_CHECK(cache.ReadFromDisk(&tip, &fDeferred));
+    BOOST_CHECK(fDeferred);
+    BOOST_CHECK(!trie.WriteCleanShutdown());
+    BOOST_CHECK(cache.checkConsistency("test"));
+    BOOST_CHECK(cache.checkConsistency(std::string(), false));
+    trie.SetVerified();
+    BOOST_CHECK(trie.WriteCleanShutdown());
+
+    // a marker from another tip is ignored (and dropped)
+    tip.nHeight = 1;
+    BOOST_CHECK(cache.ReadFromDisk(&tip, &fDeferred));
+    BOOST_CHECK(!fDeferred);
+    tip.nHeight = 0;
+    BOOST_CHECK(cache.ReadFromDisk(&tip, &fDeferred));
+    BOOST_CHECK(!fDeferred);
+    BOOST_CHECK_EQUAL(cache.getMerkleHash(), tip.hashClaimTrie);
+}
+
+BOOST_AUTO_TEST_CASE(trie_image_test)
+{
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheTest cache(&trie);
+    std::vector<std::string> names {"test", "tester", "testing", "toast", "a"};
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        CClaimValue value(COutPoint(uint256S("03"), i), ClaimIdHash(uint256S("03"), i), CAmount(i + 1), 0, 0);
+        BOOST_CHECK(cache.insertClaimIntoTrie(names[i], value, false));
+    }
+    BOOST_CHECK(cache.flush());
+
+    CBlockIndex tip;
+    tip.nHeight = 0;
+    tip.hashClaimTrie = cache.getMerkleHash();
+    BOOST_CHECK(cache.ReadFromDisk(&tip));
+    BOOST_CHECK(trie.WriteCleanShutdown());
+    auto imagePath = GetDataDir() / "claimtrie.img";
+    BOOST_CHECK(fs::exists(imagePath));
+
+    // the image brings back the layout and the hashes, the claims stay on disk until needed
+    bool fDeferred = false;
+    BOOST_CHECK(cache.ReadFromDisk(&tip, &fDeferred));
+    BOOST_CHECK(fDeferred);
+    BOOST_CHECK(!fs::exists(imagePath));
+    BOOST_CHECK(trie.find("tester")->fPagedOut);
+    BOOST_CHECK(!trie.find("test")->empty());
+    BOOST_CHECK_EQUAL(cache.getMerkleHash(), tip.hashClaimTrie);
+    CClaimValue claim;
+    BOOST_CHECK(cache.getInfoForName("tester", claim));
+    BOOST_CHECK(claim.outPoint == COutPoint(uint256S("03"), 1));
+    BOOST_CHECK(cache.checkConsistency());
+
+    // a damaged image is dropped in favor of the database
+    trie.SetVerified();
+    BOOST_CHECK(trie.WriteCleanShutdown());
+    {
+        FILE* file = fsbridge::fopen(imagePath, "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, -1, SEEK_END);
+        fputc('x', file);
+        fclose(file);
+    }
+    BOOST_CHECK(cache.ReadFromDisk(&tip, &fDeferred));
+    BOOST_CHECK(!fs::exists(imagePath));
+    BOOST_CHECK(!trie.find("tester")->fPagedOut);
+    BOOST_CHECK_EQUAL(cache.getMerkleHash(), tip.hashClaimTrie);
+}
+
+BOOST_AUTO_TEST_CASE(pending_rows_test)
+{
+    CDBWrapper db(GetDataDir() / "pending_rows", 1 << 20, true, false, false);
+    for (int i : {1, 3, 5})
+        BOOST_CHECK(db.Write(std::make_pair('k', i), i));
+
+    CPendingBatch batch;
+    batch.Write(std::make_pair('k', 2), 2);
+    batch.Erase(std::make_pair('k', 3));
+    batch.Write(std::make_pair('k', 4), 4);
+    batch.Write(std::make_pair('k', 5), 50);
+    batch.Erase(std::make_pair('k', 7));
+    CPendingLayer pending;
+    pending.rows = std::move(batch.rows);
+    CPendingRows<CDBWrapper> rows(db, pending);
+
+    int value;
+    BOOST_CHECK(rows.Read(std::make_pair('k', 1), value) && value == 1);
+    BOOST_CHECK(!rows.Read(std::make_pair('k', 3), value));
+    BOOST_CHECK(rows.Read(std::make_pair('k', 5), value) && value == 50);
+    BOOST_CHECK(!rows.Exists(std::make_pair('k', 7)));
+
+    auto iterate = [](const CPendingRows<CDBWrapper>& rows) {
+        std::vector<std::pair<int, int>> seen;
+        std::unique_ptr<CPendingRowsIterator> pcursor(rows.NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            std::pair<char, int> key;
+            int value;
+            BOOST_CHECK(pcursor->GetKey(key) && pcursor->GetValue(value));
+            seen.emplace_back(key.second, value);
+        }
+        return seen;
+    };
+    std::vector<std::pair<int, int>> expected {{1, 1}, {2, 2}, {4, 4}, {5, 50}};
+    BOOST_CHECK(iterate(rows) == expected);
+
+    std::unique_ptr<CPendingRowsIterator> pcursor(rows.NewIterator());
+    pcursor->Seek(std::make_pair('k', 3));
+    std::pair<char, int> key;
+    BOOST_CHECK(pcursor->Valid() && pcursor->GetKey(key) && key.second == 4);
+
+    // a newer layer hides the rows of the older ones and of db
+    CPendingBatch newer;
+    newer.Erase(std::make_pair('k', 1));
+    newer.Write(std::make_pair('k', 3), 30);
+    newer.Erase(std::make_pair('k', 4));
+    newer.Write(std::make_pair('k', 5), 500);
+    newer.Write(std::make_pair('k', 6), 6);
+    CPendingLayer top;
+    top.rows = std::move(newer.rows);
+    top.below = std::make_shared<CPendingLayer>(pending);
+    CPendingRows<CDBWrapper> layered(db, top);
+    BOOST_CHECK(!layered.Exists(std::make_pair('k', 1)));
+    BOOST_CHECK(layered.Read(std::make_pair('k', 2), value) && value == 2);
+    BOOST_CHECK(layered.Read(std::make_pair('k', 3), value) && value == 30);
+    BOOST_CHECK(!layered.Read(std::make_pair('k', 4), value));
+    BOOST_CHECK(!layered.Exists(std::make_pair('k', 7)));
+    expected = {{2, 2}, {3, 30}, {5, 500}, {6, 6}};
+    BOOST_CHECK(iterate(layered) == expected);
+
+    pcursor.reset(layered.NewIterator());
+    pcursor->Seek(std::make_pair('k', 4));
+    BOOST_CHECK(pcursor->Valid() && pcursor->GetKey(key) && key.second == 5);
+}
+
+BOOST_AUTO_TEST_CASE(pending_layers_test)
+{
+    CClaimTrie trie(true, false, 1);
+    auto flush = [&trie](const std::string& name, int n) {
+        CClaimTrieCacheTest cache(&trie);
+        CClaimValue value(COutPoint(uint256S("04"), n), ClaimIdHash(uint256S("04"), n), 1, 0, 0);
+        BOOST_CHECK(cache.insertClaimIntoTrie(name, value, false));
+        BOOST_CHECK(cache.flush());
+    };
+    flush("test", 0);
+
+    // a view keeps the rows of its time while the flushes after it go on top of them
+    auto view = trie.getReadView();
+    std::vector<std::shared_ptr<const CClaimTrieReadView>> views;
+    for (int i = 1; i < 40; ++i) {
+        flush("test" + std::to_string(i), i);
+        if (i % 5 == 0)
+            views.push_back(trie.getReadView());
+    }
+    BOOST_CHECK(view->getNameState("test1").empty());
+    BOOST_CHECK_EQUAL(view->getNameState("test").claims.size(), 1U);
+    for (std::size_t k = 0; k < views.size(); ++k) {
+        const int nLast = (k + 1) * 5;
+        for (int i = 1; i < 40; ++i)
+            BOOST_CHECK_EQUAL(views[k]->getNameState("test" + std::to_string(i)).claims.size(), i <= nLast ? 1U : 0U);
+    }
+    auto latest = trie.getReadView();
+    for (int i = 0; i < 40; ++i)
+        BOOST_CHECK_EQUAL(latest->getNameState(i ? "test" + std::to_string(i) : "test").claims.size(), 1U);
+
+    // and all of them get to db
+    view.reset();
+    views.clear();
+    latest.reset();
+    BOOST_CHECK(trie.WritePending(uint256S("05")));
+    BOOST_CHECK_EQUAL(trie.PendingMemoryUsage(), 0U);
+    for (int i = 0; i < 40; ++i)
+        BOOST_CHECK_EQUAL(trie.getReadView()->getNameState(i ? "test" + std::to_string(i) : "test").claims.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(pending_rows_written_with_coins_test)
+{
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheTest cache(&trie);
+    CClaimValue value(COutPoint(uint256S("04"), 0), ClaimIdHash(uint256S("04"), 0), 1, 0, 0);
+    BOOST_CHECK(cache.insertClaimIntoTrie("test", value, false));
+    BOOST_CHECK(cache.flush());
+
+    // a flush only goes as far as memory, where the trie and its read views find it
+    BOOST_CHECK(trie.PendingMemoryUsage() > 0);
+    BOOST_CHECK_EQUAL(trie.getReadView()->getNameState("test").claims.size(), 1U);
+    uint256 hashBlock;
+    BOOST_CHECK(!trie.GetBestBlock(hashBlock));
+
+    BOOST_CHECK(trie.WritePending(uint256S("05")));
+    BOOST_CHECK_EQUAL(trie.PendingMemoryUsage(), 0U);
+    BOOST_CHECK(trie.GetBestBlock(hashBlock));
+    BOOST_CHECK_EQUAL(hashBlock, uint256S("05"));
+    BOOST_CHECK_EQUAL(trie.getReadView()->getNameState("test").claims.size(), 1U);
+
+    CBlockIndex tip;
+    tip.nHeight = 0;
+    tip.hashClaimTrie = cache.getMerkleHash();
+    BOOST_CHECK(cache.ReadFromDisk(&tip));
+    BOOST_CHECK(trie.find("test"));
+}
+
+BOOST_AUTO_TEST_CASE(queue_rows_pending_test)
+{
+    CClaimTrie trie(true, false, 1);
+    CClaimValue value(COutPoint(uint256S("04"), 0), ClaimIdHash(uint256S("04"), 0), 1, 0, 5);
+    {
+        CClaimTrieCacheTest cache(&trie);
+        cache.getQueueCacheRow<CClaimValue>(5, true)->emplace_back("test", value);
+        cache.getQueueCacheRow<CClaimValue>(7, true)->emplace_back("test", value);
+        cache.getExpirationQueueCacheRow<CClaimValue>(300, true)->emplace_back("test", value.outPoint);
+        BOOST_CHECK(cache.flush());
+    }
+
+    // the rows keyed by height are read from the pending rows, then from db once they're written
+    BOOST_CHECK(!CClaimTrieCacheTest(&trie).getQueueCacheRow<CClaimValue>(6));
+    BOOST_CHECK(CClaimTrieCacheTest(&trie).getQueueCacheRow<CClaimValue>(5));
+    BOOST_CHECK(trie.WritePending(uint256S("05")));
+    {
+        CClaimTrieCacheTest cache(&trie);
+        auto row = cache.getQueueCacheRow<CClaimValue>(5);
+        BOOST_CHECK(row && row->size() == 1 && row->front().second.outPoint == value.outPoint);
+        auto expirationRow = cache.getExpirationQueueCacheRow<CClaimValue>(300, false);
+        BOOST_CHECK(expirationRow && expirationRow->size() == 1 && expirationRow->front().outPoint == value.outPoint);
+
+        cache.getQueueCacheRow<CClaimValue>(5, false)->clear();
+        BOOST_CHECK(cache.flush());
+    }
+    BOOST_CHECK(trie.WritePending(uint256S("06")));
+    BOOST_CHECK(!CClaimTrieCacheTest(&trie).getQueueCacheRow<CClaimValue>(5));
+    BOOST_CHECK(CClaimTrieCacheTest(&trie).getQueueCacheRow<CClaimValue>(7));
+
+    // and go with the rows of a wiped trie
+    BOOST_CHECK(trie.Wipe());
+    BOOST_CHECK(!CClaimTrieCacheTest(&trie).getQueueCacheRow<CClaimValue>(7));
+}
+
+BOOST_AUTO_TEST_CASE(trie_rolled_back_to_coins_tip_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.IncrementBlocks(1);
+    CBlockIndex* pindexCoins = chainActive.Tip();
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 1);
+    fixture.IncrementBlocks(1);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    fixture.IncrementBlocks(1);
+    CBlockIndex* pindexTrie = chainActive.Tip();
+
+    LOCK(cs_main);
+    // the trie made it to disk, then the node went down before the coins did
+    BOOST_CHECK(pclaimTrie->WritePending(pindexTrie->GetBlockHash()));
+    {
+        CCoinsViewCache coins(pcoinsTip.get());
+        CClaimTrieCache scratch(pclaimTrie);
+        for (auto pindex = pindexTrie; pindex != pindexCoins; pindex = pindex->pprev) {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+            BOOST_CHECK(g_chainstate.DisconnectBlock(block, pindex, coins, scratch) == DISCONNECT_OK);
+            coins.SetBestBlock(pindex->pprev->GetBlockHash());
+        }
+        BOOST_CHECK(coins.Flush());
+    }
+    chainActive.SetTip(pindexCoins);
+
+    bool fDeferred;
+    BOOST_CHECK(LoadClaimTrie(Params(), &fDeferred));
+    uint256 hashBlock;
+    BOOST_CHECK(pclaimTrie->GetBestBlock(hashBlock));
+    BOOST_CHECK_EQUAL(hashBlock, pindexCoins->GetBlockHash());
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), pindexCoins->hashClaimTrie);
+    BOOST_CHECK(pclaimTrie->getReadView()->getNameState("test").empty());
+
+    // a trie from off the chain can't be taken back
+    BOOST_CHECK(pclaimTrie->WritePending(uint256S("06")));
+    BOOST_CHECK(!LoadClaimTrie(Params(), &fDeferred));
+    BOOST_CHECK(pclaimTrie->WritePending(pindexCoins->GetBlockHash()));
+    BOOST_CHECK(LoadClaimTrie(Params(), &fDeferred));
+}
+
+BOOST_AUTO_TEST_CASE(trie_snapshot_test)
+{
+    ClaimTrieChainFixture fixture;
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 1);
+    fixture.MakeClaim(fixture.GetCoinbase(), "tester", "two", 2);
+    fixture.IncrementBlocks(1);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    fixture.MakeClaim(fixture.GetCoinbase(), "test", "tre", 3);
+    fixture.IncrementBlocks(1);
+
+    const auto path = GetDataDir() / "claimtrie.snap";
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nRows;
+    BOOST_CHECK(DumpClaimTrieSnapshot(path, hashBlock, nHeight, nRows));
+    BOOST_CHECK_EQUAL(hashBlock, chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(nHeight, chainActive.Height());
+    BOOST_CHECK(nRows > 0);
+    const auto hashTrie = chainActive.Tip()->hashClaimTrie;
+    const auto state = pclaimTrie->getReadView()->getNameState("test");
+    BOOST_CHECK(!state.empty());
+
+    // a byte off anywhere is caught by the checksum
+    std::string bytes;
+    {
+        fs::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    BOOST_REQUIRE(bytes.size() > 100);
+    bytes[bytes.size() / 2] ^= 1;
+    const auto badPath = GetDataDir() / "claimtrie.bad";
+    {
+        fs::ofstream file(badPath, std::ios::binary);
+        file.write(bytes.data(), bytes.size());
+    }
+    BOOST_CHECK(!pclaimTrie->LoadSnapshot(badPath, hashBlock));
+    // and so is a snapshot of another block, both before the trie is touched
+    BOOST_CHECK(!pclaimTrie->LoadSnapshot(path, uint256S("06")));
+    BOOST_CHECK(!fixture.queueEmpty());
+    // a snapshot is never written over
+    BOOST_CHECK(!DumpClaimTrieSnapshot(path, hashBlock, nHeight, nRows));
+
+    bool fDeferred;
+    BOOST_CHECK(pclaimTrie->LoadSnapshot(path, hashBlock));
+    BOOST_CHECK(LoadClaimTrie(Params(), &fDeferred));
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), hashTrie);
+    BOOST_CHECK(pclaimTrie->getReadView()->getNameState("test") == state);
+    BOOST_CHECK(!fixture.queueEmpty());
+
+    // the loaded trie carries on with the chain
+    fixture.IncrementBlocks(1);
+    // and -loadclaimtrie, still set on the next start, leaves it be
+    BOOST_CHECK(LoadClaimTrieSnapshot(path));
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), chainActive.Tip()->hashClaimTrie);
+    fixture.DecrementBlocks(1);
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), hashTrie);
+
+    // a snapshot of an earlier block is connected up to the tip
+    fixture.MakeClaim(fixture.GetCoinbase(), "toast", "for", 4);
+    fixture.IncrementBlocks(2);
+    const auto stateAhead = pclaimTrie->getReadView()->getNameState("toast");
+    BOOST_CHECK(!stateAhead.empty());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(pclaimTrie->Wipe());
+        BOOST_CHECK(LoadClaimTrieSnapshot(path));
+        BOOST_CHECK(LoadClaimTrie(Params(), &fDeferred));
+        uint256 hashTrieBlock;
+        BOOST_CHECK(pclaimTrie->GetBestBlock(hashTrieBlock));
+        BOOST_CHECK_EQUAL(hashTrieBlock, chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), chainActive.Tip()->hashClaimTrie);
+        BOOST_CHECK(pclaimTrie->getReadView()->getNameState("toast") == stateAhead);
+    }
+
+    // one of a block that is no longer on the chain is refused
+    const auto pathOff = GetDataDir() / "claimtrie.off";
+    BOOST_CHECK(DumpClaimTrieSnapshot(pathOff, hashBlock, nHeight, nRows));
+    fixture.DecrementBlocks(1);
+    BOOST_CHECK(!LoadClaimTrieSnapshot(pathOff));
+    BOOST_CHECK(LoadClaimTrieSnapshot(path));
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), chainActive.Tip()->hashClaimTrie);
+}
+
+BOOST_AUTO_TEST_CASE(trie_rebuilt_from_blocks_test)
+{
+    ClaimTrieChainFixture fixture;
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 3);
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "tester", "two", 2);
+    fixture.IncrementBlocks(1);
+    CMutableTransaction tx3 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "tre", 5);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 3);
+    fixture.IncrementBlocks(1);
+    fixture.MakeUpdate(tx2, "tester", "for", ClaimIdHash(tx2.GetHash(), 0), 2);
+    fixture.Spend(tx3);
+    fixture.IncrementBlocks(2);
+    const auto hashTrie = chainActive.Tip()->hashClaimTrie;
+    const auto state1 = pclaimTrie->getReadView()->getNameState("test");
+    const auto state2 = pclaimTrie->getReadView()->getNameState("tester");
+    BOOST_CHECK(!state1.empty() && !state2.empty());
+
+    {
+        LOCK(cs_main);
+        bool fDeferred;
+        BOOST_CHECK(pclaimTrie->Wipe());
+        BOOST_CHECK(!LoadClaimTrie(Params(), &fDeferred));
+        BOOST_CHECK(RebuildClaimTrie(Params()));
+        uint256 hashBlock;
+        BOOST_CHECK(pclaimTrie->GetBestBlock(hashBlock));
+        BOOST_CHECK_EQUAL(hashBlock, chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), hashTrie);
+        BOOST_CHECK(pclaimTrie->getReadView()->getNameState("test") == state1);
+        BOOST_CHECK(pclaimTrie->getReadView()->getNameState("tester") == state2);
+        BOOST_CHECK(LoadClaimTrie(Params(), &fDeferred));
+    }
+
+    fixture.IncrementBlocks(1);
+    fixture.DecrementBlocks(1);
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), hashTrie);
+}
+
 BOOST_AUTO_TEST_CASE(takeover_workaround_triggers)
 {
     auto& consensus = const_cast<Consensus::Params&>(Params().GetConsensus());
@@ -426,6 +1142,47 @@ BOOST_AUTO_TEST_CASE(claimtrienode_serialize_unserialize)
     BOOST_CHECK_EQUAL(n1, n2);
 }
 
+BOOST_AUTO_TEST_CASE(claimtrienode_bid_order)
+{
+    const uint160 id1 = ClaimIdHash(uint256S("01"), 0), id2 = ClaimIdHash(uint256S("02"), 0), id3 = ClaimIdHash(uint256S("03"), 0);
+    CClaimValue v1(COutPoint(uint256S("01"), 0), id1, 50, 0, 0);
+    CClaimValue v2(COutPoint(uint256S("02"), 0), id2, 40, 0, 0);
+    CClaimValue v3(COutPoint(uint256S("03"), 0), id3, 30, 1, 1);
+    supportEntryType supports{CSupportValue(COutPoint(uint256S("04"), 0), id3, 15, 1, 1)};
+
+    CClaimTrieData data;
+    data.insertClaim(v1, supports);
+    data.insertClaim(v2, supports);
+    data.insertClaim(v3, supports);
+    auto claimIds = [&data]() {
+        std::vector<uint160> ids;
+        for (auto& claim : data.claims)
+            ids.push_back(claim.claimId);
+        return ids;
+    };
+    BOOST_CHECK(claimIds() == std::vector<uint160>({id1, id3, id2}));
+    BOOST_CHECK_EQUAL(data.claims[1].nEffectiveAmount, 45);
+
+    // a support moves its claim alone, as reordering all of them would
+    supports.emplace_back(COutPoint(uint256S("05"), 0), id2, 20, 1, 1);
+    data.addSupportAmount(id2, 20);
+    BOOST_CHECK(claimIds() == std::vector<uint160>({id2, id1, id3}));
+    auto reordered = data;
+    reordered.reorderClaims(supports);
+    BOOST_CHECK(reordered.claims == data.claims);
+
+    supports.erase(supports.begin());
+    data.addSupportAmount(id3, -15);
+    BOOST_CHECK(claimIds() == std::vector<uint160>({id2, id1, id3}));
+    BOOST_CHECK_EQUAL(data.claims[2].nEffectiveAmount, 30);
+    reordered.reorderClaims(supports);
+    BOOST_CHECK(reordered.claims == data.claims);
+
+    // an equal bid goes to the older claim
+    data.addSupportAmount(id1, 10);
+    BOOST_CHECK(claimIds() == std::vector<uint160>({id1, id2, id3}));
+}
+
 BOOST_AUTO_TEST_CASE(claimtrienode_remove_invalid_claim)
 {
     uint160 hash160;
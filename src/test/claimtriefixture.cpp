@@ -312,7 +312,7 @@ void ClaimTrieChainFixture::DecrementBlocks()
 template <typename K>
 bool ClaimTrieChainFixture::keyTypeEmpty(uint8_t keyType)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(base->db->NewIterator());
+    boost::scoped_ptr<CPendingRowsIterator> pcursor(base->rows().NewIterator());
     pcursor->SeekToFirst();
 
     while (pcursor->Valid()) {
@@ -330,7 +330,7 @@ bool ClaimTrieChainFixture::queueEmpty()
     for (const auto& claimQueue: claimQueueCache)
         if (!claimQueue.second.empty())
             return false;
-    return keyTypeEmpty<int>(CLAIM_QUEUE_ROW);
+    return keyTypeEmpty<CQueueHeight>(CLAIM_QUEUE_ROW);
 }
 
 bool ClaimTrieChainFixture::expirationQueueEmpty()
@@ -338,7 +338,7 @@ bool ClaimTrieChainFixture::expirationQueueEmpty()
     for (const auto& expirationQueue: expirationQueueCache)
         if (!expirationQueue.second.empty())
             return false;
-    return keyTypeEmpty<int>(CLAIM_EXP_QUEUE_ROW);
+    return keyTypeEmpty<CQueueHeight>(CLAIM_EXP_QUEUE_ROW);
 }
 
 bool ClaimTrieChainFixture::supportEmpty()
@@ -354,7 +354,7 @@ bool ClaimTrieChainFixture::supportQueueEmpty()
     for (const auto& support: supportQueueCache)
         if (!support.second.empty())
             return false;
-    return keyTypeEmpty<int>(SUPPORT_QUEUE_ROW);
+    return keyTypeEmpty<CQueueHeight>(SUPPORT_QUEUE_ROW);
 }
 
 int ClaimTrieChainFixture::proportionalDelayFactor()
@@ -417,3 +417,22 @@ std::size_t ClaimTrieChainFixture::getTotalNamesInTrie() const
 {
     return base->getTotalNamesInTrie();
 }
+
+std::size_t ClaimTrieChainFixture::proofsKept() const
+{
+    LOCK(base->cs_proofs);
+    return base->proofs.size();
+}
+
+std::size_t ClaimTrieChainFixture::nameHistoryRows(const std::string& name) const
+{
+    std::size_t nRows = 0;
+    boost::scoped_ptr<CPendingRowsIterator> pcursor(base->rows().NewIterator());
+    for (pcursor->Seek(std::make_pair(TRIE_NAME_HISTORY, std::make_pair(name, CHistoryHeight(-1)))); pcursor->Valid(); pcursor->Next()) {
+        std::pair<uint8_t, std::pair<std::string, CHistoryHeight>> key;
+        if (!pcursor->GetKey(key) || key.first != TRIE_NAME_HISTORY || key.second.first != name)
+            break;
+        ++nRows;
+    }
+    return nRows;
+}
@@ -116,6 +116,12 @@ struct ClaimTrieChainFixture: public CClaimTrieCache
 
     std::size_t getTotalNamesInTrie() const;
 
+    // the proofs the trie keeps for its root
+    std::size_t proofsKept() const;
+
+    // the name history rows of name
+    std::size_t nameHistoryRows(const std::string& name) const;
+
 private:
     template <typename K>
     bool keyTypeEmpty(uint8_t keyType);
@@ -156,6 +156,74 @@ BOOST_AUTO_TEST_CASE(hash_claims_children_fuzzer_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(hash_proofs_kept_and_batched_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.setHashForkHeight(2);
+    fixture.IncrementBlocks(4);
+
+    std::vector<std::pair<std::string, uint160>> names{{"test", {}}, {"tester", {}}, {"toast", {}}, {"toad", {}}};
+    for (const auto& name : names)
+        fixture.MakeClaim(fixture.GetCoinbase(), name.first, "one", 1);
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "two", 2);
+    fixture.IncrementBlocks(1);
+
+    // by claim id, the same proof as by comparison, again when it's kept
+    uint160 claimId = ClaimIdHash(tx1.GetHash(), 0);
+    CClaimTrieProof proof, kept;
+    BOOST_CHECK(fixture.getProofForName("test", proof, [&claimId](const CClaimValue& claim) {
+        return claim.claimId == claimId;
+    }));
+    for (int i = 0; i < 2; ++i) {
+        BOOST_CHECK(fixture.getProofForName("test", claimId, kept));
+        BOOST_CHECK(kept.pairs == proof.pairs);
+        BOOST_CHECK_EQUAL(kept.outPoint, proof.outPoint);
+    }
+    const auto before = kept;
+
+    // a batch shares the start of the paths but proves each name like alone
+    std::vector<CClaimTrieProof> proofs;
+    BOOST_CHECK(fixture.getProofsForNames(names, proofs));
+    BOOST_REQUIRE_EQUAL(proofs.size(), names.size());
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        BOOST_CHECK(fixture.getProofForName(names[i].first, proof));
+        BOOST_CHECK(proofs[i].pairs == proof.pairs);
+        BOOST_CHECK(proofs[i].hasValue);
+        ValidatePairs(fixture, proofs[i].pairs, getValueHash(proofs[i].outPoint, proofs[i].nHeightOfLastTakeover));
+    }
+
+    // a claim on another name changes every proof
+    fixture.MakeClaim(fixture.GetCoinbase(), "tot", "one", 1);
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK(fixture.getProofForName("test", claimId, kept));
+    BOOST_CHECK(kept.pairs != before.pairs);
+    ValidatePairs(fixture, kept.pairs, getValueHash(kept.outPoint, kept.nHeightOfLastTakeover));
+}
+
+BOOST_AUTO_TEST_CASE(hash_proofs_kept_by_normalized_name_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.setNormalizationForkHeight(2);
+    fixture.setHashForkHeight(2);
+    fixture.IncrementBlocks(4);
+
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 1);
+    fixture.IncrementBlocks(1);
+
+    // another spelling of the name is the same proof and the same entry
+    uint160 claimId = ClaimIdHash(tx1.GetHash(), 0);
+    CClaimTrieProof proof, other;
+    BOOST_CHECK(fixture.getProofForName("test", claimId, proof));
+    BOOST_CHECK(proof.hasValue);
+    BOOST_CHECK(fixture.getProofForName("TeSt", claimId, other));
+    BOOST_CHECK(other.pairs == proof.pairs);
+    BOOST_CHECK_EQUAL(other.outPoint, proof.outPoint);
+    BOOST_CHECK_EQUAL(fixture.proofsKept(), 1U);
+
+    BOOST_CHECK(fixture.getProofForName("TEST", other, nullptr));
+    BOOST_CHECK(other.pairs == proof.pairs);
+}
+
 bool verify_proof(const CClaimTrieProof proof, uint256 rootHash, const std::string& name)
 {
     uint256 previousComputedHash;
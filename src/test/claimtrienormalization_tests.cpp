@@ -50,6 +50,17 @@ BOOST_AUTO_TEST_CASE(normalization_only)
     // source: http://unicode.org/L2/L2009/09052-tr47.html
     BOOST_CHECK_EQUAL("\xE1\x84\x81\xE1\x85\xAA\xE1\x86\xB0",
                           ccache.normalizeClaimName("\xEA\xBD\x91", true));
+
+    // ASCII of any length is only lowered, whatever else it holds
+    BOOST_CHECK_EQUAL(std::string("a-z0[@`{\x7F\t\0b", 13), ccache.normalizeClaimName(std::string("A-Z0[@`{\x7F\t\0B", 13), true));
+    BOOST_CHECK_EQUAL("", ccache.normalizeClaimName("", true));
+
+    // a single byte past ASCII, in the words or in the tail, goes the long way (twice, the second time remembered)
+    for (int i = 0; i < 2; ++i) {
+        BOOST_CHECK_EQUAL("abcdefgha\xCC\x88", ccache.normalizeClaimName("ABCDEFGH\xC3\x84", true));
+        BOOST_CHECK_EQUAL("a\xCC\x88" "bcdefghi", ccache.normalizeClaimName("\xC3\x84" "BCDEFGHI", true));
+        BOOST_CHECK_EQUAL("abcdefgh\xFF", ccache.normalizeClaimName("abcdefgh\xFF", true));
+    }
 }
 
 /*
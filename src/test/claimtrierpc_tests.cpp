@@ -7,6 +7,7 @@
 using namespace std;
 
 extern void ValidatePairs(CClaimTrieCache& cache, const std::vector<std::pair<bool, uint256>>& pairs, uint256 claimHash);
+extern uint160 uint160S(const std::string& str);
 
 BOOST_FIXTURE_TEST_SUITE(claimtrierpc_tests, RegTestingSetup)
 
@@ -190,6 +191,324 @@ BOOST_AUTO_TEST_CASE(claim_rpcs_rollback3_test)
     BOOST_CHECK_EQUAL(valueResults[T_AMOUNT].get_int(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(claim_history_test)
+{
+    ClaimTrieChainFixture fixture;
+    std::string sName1("testN");
+    std::string sValue1("test1");
+
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, sValue1, 3);
+    fixture.IncrementBlocks(1);
+    int height = chainActive.Height();
+    uint256 blockHash = chainActive.Tip()->GetBlockHash();
+
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, sName1, 2);
+    fixture.IncrementBlocks(1);
+    fixture.Spend(tx1);
+    fixture.IncrementBlocks(1);
+
+    CClaimNameState state;
+    BOOST_CHECK(pclaimTrie->getReadView()->getNameStateAt(sName1, height - 1, state));
+    BOOST_CHECK(state.empty());
+    BOOST_CHECK(pclaimTrie->getReadView()->getNameStateAt(sName1, height, state));
+    BOOST_CHECK_EQUAL(state.claims.size(), 1U);
+    BOOST_CHECK_EQUAL(state.supports.size(), 0U);
+    BOOST_CHECK(pclaimTrie->getReadView()->getNameStateAt(sName1, height + 1, state));
+    BOOST_CHECK_EQUAL(state.claims.size(), 1U);
+    BOOST_CHECK_EQUAL(state.supports.size(), 1U);
+    BOOST_CHECK(pclaimTrie->getReadView()->getNameStateAt(sName1, height + 2, state));
+    BOOST_CHECK_EQUAL(state.claims.size(), 0U);
+    BOOST_CHECK_EQUAL(state.supports.size(), 1U);
+
+    // the spent claim is still served as of the block before
+    rpcfn_type getvalueforname = tableRPC["getvalueforname"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(UniValue(sName1));
+    req.params.push_back(chainActive.Tip()->pprev->GetBlockHash().GetHex());
+
+    UniValue results = getvalueforname(req);
+    BOOST_CHECK_EQUAL(results[T_VALUE].get_str(), HexStr(sValue1));
+    BOOST_CHECK_EQUAL(results[T_EFFECTIVEAMOUNT].get_int(), 5);
+    // its output is kept with the history rather than read from the block
+    CTxOut txout;
+    BOOST_CHECK(pclaimTrie->getReadView()->getSpentOutput(COutPoint(tx1.GetHash(), 0), txout));
+    BOOST_CHECK(txout == tx1.vout[0]);
+
+    // the rows of a disconnected block go with it
+    fixture.DecrementBlocks(1);
+    BOOST_CHECK(pclaimTrie->getReadView()->getNameStateAt(sName1, height + 2, state));
+    BOOST_CHECK_EQUAL(state.claims.size(), 1U);
+    BOOST_CHECK(!pclaimTrie->getReadView()->getSpentOutput(COutPoint(tx1.GetHash(), 0), txout));
+
+    rpcfn_type getnamesintrie = tableRPC["getnamesintrie"]->actor;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(blockHash.GetHex());
+    results = getnamesintrie(req);
+    BOOST_CHECK_EQUAL(results.size(), 1U);
+    BOOST_CHECK_EQUAL(results[0].get_str(), sName1);
+}
+
+BOOST_AUTO_TEST_CASE(claim_history_deltas_test)
+{
+    ClaimTrieChainFixture fixture;
+    std::string sName1("testN");
+
+    // a change to the name every block, more of them than there are deltas between full rows
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, "test1", 3);
+    fixture.IncrementBlocks(1);
+    std::map<int, CClaimNameState> states;
+    for (int i = 0; i < 24; ++i) {
+        if (i % 10 == 5)
+            fixture.MakeClaim(fixture.GetCoinbase(), sName1, "test" + std::to_string(i), i);
+        else
+            fixture.MakeSupport(fixture.GetCoinbase(), tx1, sName1, i + 1);
+        fixture.IncrementBlocks(1);
+        states[chainActive.Height()] = pclaimTrie->getReadView()->getNameState(sName1);
+    }
+    auto view = pclaimTrie->getReadView();
+    for (auto& state : states) {
+        CClaimNameState stateAt;
+        BOOST_CHECK(view->getNameStateAt(sName1, state.first, stateAt));
+        BOOST_CHECK(stateAt == state.second);
+    }
+
+    // with -claimtriehistory the rows of the older blocks go, the one in effect at the start stays
+    const int nHistoryBlocks = 10;
+    nClaimTrieHistoryBlocks = nHistoryBlocks;
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, sName1, 1);
+    fixture.IncrementBlocks(1);
+    states[chainActive.Height()] = pclaimTrie->getReadView()->getNameState(sName1);
+    fixture.IncrementBlocks(3);
+    nClaimTrieHistoryBlocks = DEFAULT_CLAIMTRIE_HISTORY;
+
+    const int nStart = chainActive.Height() - nHistoryBlocks + 1;
+    view = pclaimTrie->getReadView();
+    CClaimNameState stateAt;
+    BOOST_CHECK(!view->getNameStateAt(sName1, nStart - 2, stateAt));
+    for (int nHeight = nStart - 1; nHeight <= chainActive.Height(); ++nHeight) {
+        BOOST_CHECK(view->getNameStateAt(sName1, nHeight, stateAt));
+        BOOST_CHECK(stateAt == std::prev(states.upper_bound(nHeight))->second);
+    }
+    BOOST_CHECK_EQUAL(fixture.nameHistoryRows(sName1), std::size_t(states.rbegin()->first - (nStart - 1) + 1));
+
+    // the blocks pruned from the history aren't back after a disconnect
+    fixture.DecrementBlocks(1);
+    view = pclaimTrie->getReadView();
+    BOOST_CHECK(!view->getNameStateAt(sName1, nStart - 2, stateAt));
+    BOOST_CHECK(view->getNameStateAt(sName1, nStart - 1, stateAt));
+    BOOST_CHECK(stateAt == std::prev(states.upper_bound(nStart - 1))->second);
+}
+
+BOOST_AUTO_TEST_CASE(claim_read_view_test)
+{
+    ClaimTrieChainFixture fixture;
+    std::string sName1("testN");
+    std::string sValue1("test1");
+
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, sValue1, 3);
+    fixture.IncrementBlocks(1);
+
+    auto view = pclaimTrie->getReadView();
+    BOOST_CHECK_EQUAL(view->nNextHeight, chainActive.Height() + 1);
+    BOOST_CHECK_EQUAL(view->getClaimsForName(sName1).claimsNsupports.size(), 1U);
+
+    fixture.MakeClaim(fixture.GetCoinbase(), sName1, sValue1, 2);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, sName1, 2);
+    fixture.IncrementBlocks(1);
+
+    // the view held on to doesn't change with the blocks after it
+    auto csToName = view->getClaimsForName(sName1);
+    BOOST_CHECK_EQUAL(csToName.claimsNsupports.size(), 1U);
+    BOOST_CHECK_EQUAL(csToName.claimsNsupports[0].effectiveAmount, 3);
+
+    auto csToNameNow = pclaimTrie->getReadView()->getClaimsForName(sName1);
+    BOOST_CHECK_EQUAL(csToNameNow.claimsNsupports.size(), 2U);
+    BOOST_CHECK_EQUAL(csToNameNow.claimsNsupports[0].effectiveAmount, 5);
+
+    std::string name;
+    BOOST_CHECK(view->getClaimById(ClaimIdHash(tx1.GetHash(), 0), name));
+    BOOST_CHECK_EQUAL(name, sName1);
+}
+
+BOOST_AUTO_TEST_CASE(resolve_test)
+{
+    ClaimTrieChainFixture fixture;
+    std::string sName1("testN");
+    std::string sValue1("test1");
+    std::string sValue2("test2");
+
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, sValue1, 1);
+    fixture.IncrementBlocks(1);
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, sValue2, 3);
+    fixture.IncrementBlocks(2);
+
+    auto claimId1 = ClaimIdHash(tx1.GetHash(), 0).GetHex();
+    auto claimId2 = ClaimIdHash(tx2.GetHash(), 0).GetHex();
+
+    UniValue byId(UniValue::VOBJ);
+    byId.pushKV(T_CLAIMID, claimId2);
+
+    UniValue urls(UniValue::VARR);
+    urls.push_back("testN");
+    urls.push_back("lbry://testN:1");
+    urls.push_back("testN$2");
+    urls.push_back("testN#" + claimId1.substr(0, 5));
+    urls.push_back(byId);
+    urls.push_back("testN$3");
+    urls.push_back("other");
+
+    rpcfn_type resolve = tableRPC["resolve"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(urls);
+
+    UniValue results = resolve(req);
+    BOOST_REQUIRE_EQUAL(results.size(), urls.size());
+    BOOST_CHECK_EQUAL(results[0][T_CLAIMID].get_str(), claimId2);
+    BOOST_CHECK_EQUAL(results[0][T_BID].get_int(), 0);
+    BOOST_CHECK_EQUAL(results[1][T_CLAIMID].get_str(), claimId1);
+    BOOST_CHECK_EQUAL(results[1][T_SEQUENCE].get_int(), 0);
+    BOOST_CHECK_EQUAL(results[2][T_CLAIMID].get_str(), claimId1);
+    BOOST_CHECK_EQUAL(results[2][T_VALUE].get_str(), HexStr(sValue1));
+    BOOST_CHECK_EQUAL(results[3][T_CLAIMID].get_str(), claimId1);
+    BOOST_CHECK_EQUAL(results[4][T_CLAIMID].get_str(), claimId2);
+    BOOST_CHECK_EQUAL(results[4][T_NORMALIZEDNAME].get_str(), sName1);
+    BOOST_CHECK(results[5].empty());
+    BOOST_CHECK(results[6].empty());
+
+    urls.push_back(5);
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(urls);
+    BOOST_CHECK_THROW(resolve(req), UniValue);
+
+    // a batch is limited
+    UniValue many(UniValue::VARR);
+    for (int i = 0; i < 1000; ++i)
+        many.push_back("testN");
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(many);
+    BOOST_CHECK_EQUAL(resolve(req).size(), 1000U);
+    many.push_back("testN");
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(many);
+    BOOST_CHECK_THROW(resolve(req), UniValue);
+}
+
+BOOST_AUTO_TEST_CASE(getpendingclaims_test)
+{
+    ClaimTrieChainFixture fixture;
+    std::string sName1("testN");
+
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, "test1", 2);
+    fixture.IncrementBlocks(1);
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "TestN", "test2", 5);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, sName1, 1);
+
+    auto claimId1 = ClaimIdHash(tx1.GetHash(), 0).GetHex();
+    auto claimId2 = ClaimIdHash(tx2.GetHash(), 0).GetHex();
+
+    rpcfn_type getpendingclaims = tableRPC["getpendingclaims"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(sName1);
+
+    UniValue pending = getpendingclaims(req)[T_PENDING];
+    BOOST_REQUIRE_EQUAL(pending.size(), 2U);
+    BOOST_CHECK_EQUAL(pending[0][T_CLAIMTYPE].get_str(), "claim");
+    BOOST_CHECK_EQUAL(pending[0][T_CLAIMID].get_str(), claimId2);
+    BOOST_CHECK_EQUAL(pending[0][T_VALUE].get_str(), HexStr(std::string("test2")));
+    BOOST_CHECK_EQUAL(pending[1][T_CLAIMTYPE].get_str(), "support");
+    BOOST_CHECK_EQUAL(pending[1][T_CLAIMID].get_str(), claimId1);
+    BOOST_CHECK_EQUAL(pending[1][T_AMOUNT].get_int(), 1);
+
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back("");
+    req.params.push_back(claimId1);
+    req.params.push_back(UniValue(true));
+    UniValue results = getpendingclaims(req);
+    BOOST_REQUIRE_EQUAL(results[T_PENDING].size(), 1U);
+    BOOST_CHECK_EQUAL(results[T_PENDING][0][T_CLAIMTYPE].get_str(), "support");
+    BOOST_REQUIRE_EQUAL(results[T_PROJECTED].size(), 1U);
+    auto projected = results[T_PROJECTED][0][T_CLAIMID].get_str();
+
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back("");
+    req.params.push_back(claimId1.substr(0, 5));
+    BOOST_CHECK_THROW(getpendingclaims(req), UniValue);
+
+    // the projection is what the next block makes of the name
+    fixture.IncrementBlocks(1);
+    rpcfn_type getvalueforname = tableRPC["getvalueforname"]->actor;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(sName1);
+    BOOST_CHECK_EQUAL(getvalueforname(req)[T_CLAIMID].get_str(), projected);
+    BOOST_CHECK(getpendingclaims(req)[T_PENDING].empty());
+}
+
+BOOST_AUTO_TEST_CASE(claim_totals_test)
+{
+    ClaimTrieChainFixture fixture;
+    rpcfn_type gettotalclaimednames = tableRPC["gettotalclaimednames"]->actor;
+    rpcfn_type gettotalclaims = tableRPC["gettotalclaims"]->actor;
+    rpcfn_type gettotalvalueofclaims = tableRPC["gettotalvalueofclaims"]->actor;
+
+    auto checkTotals = [&](int names, int claims, CAmount value, CAmount controllingValue) {
+        JSONRPCRequest req;
+        req.params = UniValue(UniValue::VARR);
+        BOOST_CHECK_EQUAL(gettotalclaimednames(req).get_int(), names);
+        BOOST_CHECK_EQUAL(gettotalclaims(req).get_int(), claims);
+        BOOST_CHECK_EQUAL(AmountFromValue(gettotalvalueofclaims(req)), value);
+        req.params.push_back(UniValue(true));
+        BOOST_CHECK_EQUAL(AmountFromValue(gettotalvalueofclaims(req)), controllingValue);
+
+        // the trie itself counts the same
+        BOOST_CHECK_EQUAL(pclaimTrie->getTotalNamesInTrie(), std::size_t(names));
+        BOOST_CHECK_EQUAL(pclaimTrie->getTotalClaimsInTrie(), std::size_t(claims));
+        BOOST_CHECK_EQUAL(pclaimTrie->getTotalValueOfClaimsInTrie(false), value);
+        BOOST_CHECK_EQUAL(pclaimTrie->getTotalValueOfClaimsInTrie(true), controllingValue);
+    };
+    checkTotals(0, 0, 0, 0);
+
+    fixture.MakeClaim(fixture.GetCoinbase(), "a", "one", 3);
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "b", "two", 2);
+    fixture.IncrementBlocks(1);
+    checkTotals(2, 2, 5, 5);
+
+    fixture.MakeClaim(fixture.GetCoinbase(), "a", "three", 4);
+    fixture.IncrementBlocks(3);
+    checkTotals(2, 3, 9, 6);
+
+    fixture.Spend(tx2);
+    fixture.IncrementBlocks(1);
+    checkTotals(1, 2, 7, 4);
+
+    // disconnecting blocks takes their changes back off the totals
+    fixture.DecrementBlocks(1);
+    checkTotals(2, 3, 9, 6);
+    fixture.DecrementBlocks(3);
+    checkTotals(2, 2, 5, 5);
+}
+
+BOOST_AUTO_TEST_CASE(claimtrie_timings_test)
+{
+    ClaimTrieChainFixture fixture;
+    rpcfn_type getclaimtrietimings = tableRPC["getclaimtrietimings"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+
+    auto before = getclaimtrietimings(req);
+    fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 1);
+    fixture.IncrementBlocks(2);
+    fixture.DecrementBlocks(1);
+    auto after = getclaimtrietimings(req);
+
+    BOOST_CHECK_EQUAL(after[T_BLOCKS].get_int() - before[T_BLOCKS].get_int(), 3);
+    BOOST_CHECK(after[T_FLUSHBYTES].get_int64() > before[T_FLUSHBYTES].get_int64());
+    for (auto key : {T_SCRIPTS, T_QUEUES, T_TAKEOVERS, T_MERKLEHASH, T_FLUSH})
+        BOOST_CHECK(after[key].get_real() >= before[key].get_real());
+}
+
 std::vector<std::pair<bool, uint256>> jsonToPairs(const UniValue& jsonPair)
 {
     std::vector<std::pair<bool, uint256>> pairs;
@@ -313,6 +632,13 @@ BOOST_AUTO_TEST_CASE(hash_bid_seq_claim_changes_test)
     BOOST_CHECK_EQUAL(result[T_SEQUENCE].get_int(), claim3seq);
     BOOST_CHECK_EQUAL(result[T_CLAIMID].get_str(), claimId3.GetHex());
 
+    // the prefix index is ordered like the hex form, so odd lengths work too
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(UniValue(claimId2.GetHex().substr(0, 5)));
+
+    result = getclaimbyid(req);
+    BOOST_CHECK_EQUAL(result[T_CLAIMID].get_str(), claimId2.GetHex());
+
     auto blockhash = chainActive.Tip()->GetBlockHash();
 
     auto getnameproof = tableRPC["getnameproof"]->actor;
@@ -404,4 +730,96 @@ BOOST_AUTO_TEST_CASE(claim_rpc_pending_amount_test)
     BOOST_CHECK(!claims[1].exists(T_PENDINGAMOUNT));
 }
 
+class CClaimTrieHexIndexTest : public CClaimTrie
+{
+public:
+    using CClaimTrie::CClaimTrie;
+
+    bool hasHexRow(const uint160& claimId) const
+    {
+        return rows().Exists(std::make_pair(CLAIM_BY_ID_HEX, claimIdHexKey(claimId)));
+    }
+
+    // leaves db as one written before the index: no CLAIM_BY_ID_HEX rows, the marker included
+    void eraseHexIndex()
+    {
+        BOOST_REQUIRE(WritePending(uint256()));
+        CDBBatch batch(*db);
+        std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+        for (pcursor->Seek(std::make_pair(CLAIM_BY_ID_HEX, uint160())); pcursor->Valid(); pcursor->Next()) {
+            std::pair<uint8_t, uint160> key;
+            if (!pcursor->GetKey(key) || key.first != CLAIM_BY_ID_HEX)
+                break;
+            batch.Erase(key);
+        }
+        BOOST_REQUIRE(db->WriteBatch(batch, true));
+        publishReadView();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(claim_id_hex_index_test)
+{
+    CClaimTrieHexIndexTest trie(true, false, 1);
+    // ids at both ends of the key range and sharing prefixes of odd and even length
+    const std::vector<std::string> ids {
+        "0000000000000000000000000000000000000001",
+        "abcde00000000000000000000000000000000000",
+        "abcdeffffffffffffffffffffffffffffffffff0",
+        "abcdf00000000000000000000000000000000000",
+        "fffffffffffffffffffffffffffffffffffffffe",
+        "ffffffffffffffffffffffffffffffffffffffff",
+    };
+    const auto outPoint = [](std::size_t i) { return COutPoint(uint256S("01"), i); };
+    {
+        CClaimTrieCache cache(&trie);
+        for (std::size_t i = 0; i < ids.size(); ++i)
+            BOOST_CHECK(cache.addClaim("name" + std::to_string(i), outPoint(i), uint160S(ids[i]), 1, 0));
+        BOOST_CHECK(cache.flush());
+    }
+
+    // the name of the claim found for partialId, empty if there is none
+    const auto lookup = [&trie](const std::string& partialId) {
+        std::string name;
+        return trie.getReadView()->getClaimById(partialId, name) ? name : std::string();
+    };
+    BOOST_CHECK_EQUAL(lookup("0"), "name0");
+    BOOST_CHECK_EQUAL(lookup("000"), "name0");
+    BOOST_CHECK_EQUAL(lookup(ids[0]), "name0");
+    BOOST_CHECK_EQUAL(lookup("abcd"), "name1");
+    BOOST_CHECK_EQUAL(lookup("abcde"), "name1");
+    BOOST_CHECK_EQUAL(lookup("abcdef"), "name2");
+    BOOST_CHECK_EQUAL(lookup("abcdf"), "name3");
+    BOOST_CHECK_EQUAL(lookup("abcdf1"), "");
+    BOOST_CHECK_EQUAL(lookup("f"), "name4");
+    BOOST_CHECK_EQUAL(lookup("fffffffffffffffffffffffffffffffffffffff"), "name4");
+    BOOST_CHECK_EQUAL(lookup(ids[5]), "name5");
+    BOOST_CHECK_EQUAL(lookup("fffffffffffffffffffffffffffffffffffffffd"), "");
+    BOOST_CHECK_EQUAL(lookup("fffffffffffffffffffffffffffffffffffffffff"), "");
+    BOOST_CHECK_EQUAL(lookup("xyz"), "");
+
+    // a database from before the index gets it built on load
+    trie.eraseHexIndex();
+    BOOST_CHECK(!trie.hasHexRow(uint160()));
+    BOOST_CHECK(!trie.hasHexRow(uint160S(ids[3])));
+    BOOST_CHECK_EQUAL(lookup("abcdf"), "");
+    BOOST_CHECK(CClaimTrieCache(&trie).ReadFromDisk(nullptr));
+    BOOST_CHECK(trie.hasHexRow(uint160()));
+    for (auto& id : ids)
+        BOOST_CHECK(trie.hasHexRow(uint160S(id)));
+    BOOST_CHECK_EQUAL(lookup("abcdf"), "name3");
+    BOOST_CHECK_EQUAL(lookup(ids[5]), "name5");
+
+    // a spent (or abandoned) claim takes its row with it
+    {
+        CClaimTrieCache cache(&trie);
+        int nValidAtHeight;
+        BOOST_CHECK(cache.spendClaim("name3", outPoint(3), 0, nValidAtHeight));
+        BOOST_CHECK(cache.flush());
+    }
+    BOOST_CHECK(!trie.hasHexRow(uint160S(ids[3])));
+    BOOST_CHECK(trie.hasHexRow(uint160S(ids[2])));
+    BOOST_CHECK_EQUAL(lookup("abcdf"), "");
+    BOOST_CHECK_EQUAL(lookup("abcde"), "name1");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -562,4 +562,36 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha512_32)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[32 * 32];
+        unsigned char out1[64 * 32], out2[64 * 32];
+        for (int j = 0; j < 32 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CSHA512().Write(in + 32 * j, 32).Finalize(out1 + 64 * j);
+        }
+        SHA512_32(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 64 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ripemd160_32)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[32 * 32];
+        unsigned char out1[20 * 32], out2[20 * 32];
+        for (int j = 0; j < 32 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CRIPEMD160().Write(in + 32 * j, 32).Finalize(out1 + 20 * j);
+        }
+        RIPEMD160_32(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 20 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <nameclaim.h>
 #include <policy/policy.h>
 #include <txmempool.h>
 #include <util.h>
@@ -749,4 +750,56 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolClaimIndexTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+    LOCK(pool.cs);
+
+    auto vchName = [](const std::string& name) { return std::vector<unsigned char>(name.begin(), name.end()); };
+    const std::vector<unsigned char> vchValue{'v'};
+
+    // a claim and a support for it in a child transaction, the child also claims another name
+    CMutableTransaction txClaim;
+    txClaim.vin.resize(1);
+    txClaim.vout.resize(2);
+    txClaim.vout[0].scriptPubKey = CScript() << OP_CLAIM_NAME << vchName("Test") << vchValue << OP_2DROP << OP_DROP << OP_TRUE;
+    txClaim.vout[0].nValue = 10;
+    txClaim.vout[1].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txClaim.vout[1].nValue = 20;
+    const auto claimId = ClaimIdHash(txClaim.GetHash(), 0);
+    const std::vector<unsigned char> vchClaimId(claimId.begin(), claimId.end());
+
+    CMutableTransaction txSupport;
+    txSupport.vin.resize(1);
+    txSupport.vin[0].prevout = COutPoint(txClaim.GetHash(), 1);
+    txSupport.vout.resize(2);
+    txSupport.vout[0].scriptPubKey = CScript() << OP_SUPPORT_CLAIM << vchName("test") << vchClaimId << OP_2DROP << OP_DROP << OP_TRUE;
+    txSupport.vout[0].nValue = 5;
+    txSupport.vout[1].scriptPubKey = CScript() << OP_CLAIM_NAME << vchName("other") << vchValue << OP_2DROP << OP_DROP << OP_TRUE;
+    txSupport.vout[1].nValue = 5;
+
+    pool.addUnchecked(txClaim.GetHash(), entry.FromTx(txClaim));
+    pool.addUnchecked(txSupport.GetHash(), entry.FromTx(txSupport));
+
+    // names are matched normalized, in the order the outputs entered the pool
+    std::vector<COutPoint> expected{COutPoint(txClaim.GetHash(), 0), COutPoint(txSupport.GetHash(), 0)};
+    BOOST_CHECK(pool.GetClaimsForName("TEST") == expected);
+    BOOST_CHECK(pool.GetClaimsById(claimId) == expected);
+    BOOST_CHECK(pool.GetClaimsById(ClaimIdHash(txSupport.GetHash(), 1)) == std::vector<COutPoint>{COutPoint(txSupport.GetHash(), 1)});
+    BOOST_CHECK(pool.GetClaimsForName("tes").empty());
+
+    pool.removeRecursive(txSupport);
+    expected.pop_back();
+    BOOST_CHECK(pool.GetClaimsForName("test") == expected);
+    BOOST_CHECK(pool.GetClaimsById(claimId) == expected);
+    BOOST_CHECK(pool.GetClaimsForName("other").empty());
+
+    pool.addUnchecked(txSupport.GetHash(), entry.FromTx(txSupport));
+    pool.removeRecursive(txClaim);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK(pool.GetClaimsForName("test").empty());
+    BOOST_CHECK(pool.GetClaimsById(claimId).empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,7 +4,10 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <crypto/sha512.h>
+#include <hash.h>
 #include <pow.h>
+#include <streams.h>
 #include <random.h>
 #include <util.h>
 #include <test/test_bitcoin.h>
@@ -83,4 +86,79 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+// PoWHash step by step: SHA256d, SHA512, RIPEMD160 of either half, SHA256d
+static uint256 PoWHashReference(const std::vector<unsigned char>& input)
+{
+    unsigned char digest256[CHash256::OUTPUT_SIZE], digest512[CSHA512::OUTPUT_SIZE], digests160[2 * CRIPEMD160::OUTPUT_SIZE];
+    CHash256().Write(input.data(), input.size()).Finalize(digest256);
+    CSHA512().Write(digest256, sizeof(digest256)).Finalize(digest512);
+    CRIPEMD160().Write(digest512, 32).Finalize(digests160);
+    CRIPEMD160().Write(digest512 + 32, 32).Finalize(digests160 + CRIPEMD160::OUTPUT_SIZE);
+    uint256 result;
+    CHash256().Write(digests160, sizeof(digests160)).Finalize(result.begin());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(pow_hashes)
+{
+    std::vector<CBlockHeader> headers(11);
+    for (auto& header : headers) {
+        header.nVersion = InsecureRand32();
+        header.hashPrevBlock = InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.hashClaimTrie = InsecureRand256();
+        header.nTime = InsecureRand32();
+        header.nBits = InsecureRand32();
+        header.nNonce = InsecureRand32();
+    }
+
+    auto hashes = GetPoWHashes(headers);
+    BOOST_REQUIRE_EQUAL(hashes.size(), headers.size());
+    for (std::size_t i = 0; i < headers.size(); ++i) {
+        CDataStream ds(SER_GETHASH, PROTOCOL_VERSION);
+        ds << headers[i];
+        std::vector<unsigned char> input(ds.begin(), ds.end());
+        BOOST_REQUIRE(input.size() == CBlockHeader::SERIALIZED_SIZE);
+        unsigned char serialized[CBlockHeader::SERIALIZED_SIZE];
+        headers[i].SerializeTo(serialized);
+        BOOST_CHECK(memcmp(serialized, input.data(), input.size()) == 0);
+
+        auto expected = PoWHashReference(input);
+        BOOST_CHECK_EQUAL(headers[i].GetPoWHash(), expected);
+        BOOST_CHECK_EQUAL(PoWHash(input), expected);
+        BOOST_CHECK_EQUAL(hashes[i], expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(check_proof_of_work_headers)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const auto& params = chainParams->GetConsensus();
+    const unsigned int nBits = UintToArith256(params.powLimit).GetCompact();
+
+    // enough headers for several threads, each with a nonce meeting the regtest limit
+    std::vector<CBlockHeader> headers(1000);
+    for (auto& header : headers) {
+        header.hashMerkleRoot = InsecureRand256();
+        header.nBits = nBits;
+        while (!CheckProofOfWork(header.GetPoWHash(), header.nBits, params))
+            ++header.nNonce;
+    }
+    for (int nThreads : {1, 2, 4}) {
+        size_t nInvalid = 0;
+        BOOST_CHECK(CheckProofOfWork(headers, params, nThreads, &nInvalid));
+        BOOST_CHECK_EQUAL(nInvalid, 0U);
+    }
+    BOOST_CHECK(CheckProofOfWork(std::vector<CBlockHeader>(), params, 4));
+
+    // a zero target fails any hash; the first of the failing headers is reported
+    headers[700].nBits = 0;
+    headers[300].nBits = 0;
+    for (int nThreads : {1, 2, 4}) {
+        size_t nInvalid = 0;
+        BOOST_CHECK(!CheckProofOfWork(headers, params, nThreads, &nInvalid));
+        BOOST_CHECK_EQUAL(nInvalid, 300U);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
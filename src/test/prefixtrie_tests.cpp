@@ -240,6 +240,58 @@ BOOST_AUTO_TEST_CASE(erase_cleanup_test)
     BOOST_CHECK_EQUAL(root.height(), 2);
 }
 
+BOOST_AUTO_TEST_CASE(stale_iterator_test)
+{
+    CPrefixTrie<std::string, CClaimTrieData> trie;
+
+    CClaimTrieData data;
+    data.insertClaim(CClaimValue{});
+    auto it = trie.insert("abc", data);
+    BOOST_CHECK(trie.insert("abd", data) != trie.end());
+    BOOST_CHECK(it && it == trie.find("abc"));
+
+    // the released node is handed out again, but not to the old iterator
+    BOOST_CHECK(trie.erase("abc"));
+    BOOST_CHECK(!it);
+    BOOST_CHECK(it == trie.end());
+    BOOST_CHECK(trie.insert("abe", data) != trie.end());
+    BOOST_CHECK(!it);
+
+    auto abd = trie.find("abd");
+    BOOST_CHECK(abd);
+    trie.clear();
+    BOOST_CHECK(!abd);
+    BOOST_CHECK(trie.empty());
+}
+
+BOOST_AUTO_TEST_CASE(erase_keeps_remaining_keys_test)
+{
+    CPrefixTrie<std::string, CClaimTrieData> trie;
+    auto strings = random_strings(10000);
+
+    for (std::size_t i = 0; i < strings.size(); i++) {
+        CClaimTrieData d; d.nHeightOfLastTakeover = i;
+        d.insertClaim(CClaimValue{});
+        trie.insert(strings[i], std::move(d));
+    }
+
+    // merging segments on erase leaves garbage in the label arena until it is compacted
+    for (std::size_t i = 0; i < strings.size(); i += 2)
+        trie.erase(strings[i]);
+
+    std::size_t count = 0;
+    for (auto it = trie.begin(); it != trie.end(); ++it)
+        if (!it->empty())
+            ++count;
+    BOOST_CHECK_EQUAL(count, strings.size() / 2);
+
+    for (std::size_t i = 1; i < strings.size(); i += 2) {
+        auto it = trie.find(strings[i]);
+        BOOST_CHECK(it && it.key() == strings[i]);
+        BOOST_CHECK_EQUAL(it->nHeightOfLastTakeover, i);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(add_many_nodes) {
     // this if for testing performance and making sure erasure goes all the way to zero
     CPrefixTrie<std::string, CClaimTrieData> trie;
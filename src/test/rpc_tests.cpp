@@ -353,6 +353,70 @@ BOOST_AUTO_TEST_CASE(rpc_claimtrie_validation)
     BOOST_CHECK_NO_THROW(CallRPC("getclaimbyid aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"));
 }
 
+BOOST_AUTO_TEST_CASE(rpc_array_writer)
+{
+    UniValue elements(UniValue::VARR);
+    for (int i = 0; i < 20000; ++i) {
+        UniValue element(UniValue::VOBJ);
+        element.pushKV("name", "name\"" + std::to_string(i));
+        element.pushKV("n", i);
+        elements.push_back(element);
+    }
+
+    JSONRPCRequest request;
+    for (int count : {0, 1, 20000}) {
+        JSONRPCArrayWriter collected(request);
+        for (int i = 0; i < count; ++i)
+            collected.push_back(elements[i]);
+        auto array = collected.finish();
+        BOOST_CHECK_EQUAL(array.size(), count);
+
+        // the same text, in more than one part when it's long
+        JSONRPCRequest streamed;
+        std::vector<std::string> parts;
+        streamed.writeResult = [&parts](const std::string& part) {
+            parts.push_back(part);
+        };
+        JSONRPCArrayWriter written(streamed);
+        for (int i = 0; i < count; ++i)
+            written.push_back(elements[i]);
+        BOOST_CHECK(written.finish().isNull());
+        BOOST_CHECK_EQUAL(parts.size() > 1, count == 20000);
+        std::string text;
+        for (auto& part : parts)
+            text += part;
+        BOOST_CHECK_EQUAL(text, array.write());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_spilled_writer)
+{
+    auto write = [](const JSONRPCRequest& request) {
+        JSONRPCArrayWriter ret(request);
+        for (int i = 0; i < 20000; ++i)
+            ret.push_back("name" + std::to_string(i));
+        return ret.finish();
+    };
+    JSONRPCRequest request;
+    auto array = JSONRPCWriteSpilled(request, write);
+    BOOST_CHECK_EQUAL(array.size(), 20000U);
+
+    // passed on in parts from the file, which is gone after
+    JSONRPCRequest streamed;
+    std::vector<std::string> parts;
+    streamed.writeResult = [&parts](const std::string& part) {
+        parts.push_back(part);
+    };
+    BOOST_CHECK(JSONRPCWriteSpilled(streamed, write).isNull());
+    BOOST_CHECK(parts.size() > 1);
+    std::string text;
+    for (auto& part : parts)
+        text += part;
+    BOOST_CHECK_EQUAL(text, array.write());
+    for (fs::directory_iterator it(GetDataDir()); it != fs::directory_iterator(); ++it)
+        BOOST_CHECK(it->path().extension() != ".json");
+}
+
 BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
 {
     int64_t total_weight = 200;
@@ -7,7 +7,9 @@
 #include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <crypto/ripemd160.h>
 #include <crypto/sha256.h>
+#include <crypto/sha512.h>
 #include <validation.h>
 #include <miner.h>
 #include <net_processing.h>
@@ -100,6 +102,8 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     }
 
     SHA256AutoDetect();
+    SHA512AutoDetect();
+    RIPEMD160AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -181,4 +181,44 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, chainActive.Tip()->GetBlockHash());
 }
 
+BOOST_AUTO_TEST_CASE(processnewblockheaders_pow)
+{
+    // a chain of headers long enough to be split between threads, one of them without enough work
+    const size_t nInvalid = 450;
+    std::vector<CBlockHeader> headers(600);
+    uint256 hashPrev = Params().GenesisBlock().GetHash();
+    for (size_t i = 0; i < headers.size(); ++i) {
+        auto& header = headers[i];
+        header.nVersion = 4;
+        header.hashPrevBlock = hashPrev;
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = Params().GenesisBlock().nTime + i + 1;
+        header.nBits = Params().GenesisBlock().nBits;
+        while (CheckProofOfWork(header.GetPoWHash(), header.nBits, Params().GetConsensus()) == (i == nInvalid))
+            ++header.nNonce;
+        hashPrev = header.GetHash();
+    }
+
+    const int nScriptCheckThreadsSaved = nScriptCheckThreads;
+    for (int nThreads : {0, 4}) {
+        nScriptCheckThreads = nThreads;
+        CValidationState state;
+        CBlockHeader first_invalid;
+        BOOST_CHECK(!ProcessNewBlockHeaders(headers, state, Params(), nullptr, &first_invalid));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+        BOOST_CHECK_EQUAL(first_invalid.GetHash(), headers[nInvalid].GetHash());
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(LookupBlockIndex(headers[nInvalid - 1].GetHash()));
+            BOOST_CHECK(!LookupBlockIndex(headers[nInvalid].GetHash()));
+        }
+
+        const CBlockIndex* pindex = nullptr;
+        std::vector<CBlockHeader> valid(headers.begin(), headers.begin() + nInvalid);
+        BOOST_CHECK(ProcessNewBlockHeaders(valid, state, Params(), &pindex));
+        BOOST_CHECK_EQUAL(pindex->GetBlockHash(), headers[nInvalid - 1].GetHash());
+    }
+    nScriptCheckThreads = nScriptCheckThreadsSaved;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -259,12 +259,37 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+//! Block index entries whose proof of work is checked together while loading
+static const size_t LOAD_POW_CHECK_WINDOW = 4096;
+
+static bool CheckBlockIndexProofOfWork(std::vector<CBlockIndex*>& vIndex, std::vector<CBlockHeader>& vHeaders, const Consensus::Params& consensusParams, int nThreads)
+{
+    size_t nInvalid;
+    if (!CheckProofOfWork(vHeaders, consensusParams, nThreads, &nInvalid))
+    {
+        const CBlockIndex* pindex = vIndex[nInvalid];
+        LogPrintf("%s: CheckProofOfWorkFailed: %s\n", __func__, pindex->ToString());
+        LogPrintf("%s: CheckProofOfWorkFailed: %s (hash %s, nBits=%x, nTime=%d)\n", __func__, pindex->GetBlockPoWHash().GetHex(), pindex->GetBlockHash().GetHex(), pindex->nBits, pindex->nTime);
+        return error("%s: CheckProofOfWork failed: %s", __func__, pindex->ToString());
+    }
+    vIndex.clear();
+    vHeaders.clear();
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
+    // The proof of work of the entries is checked a window at a time, spread over the threads
+    const size_t nWindow = LOAD_POW_CHECK_WINDOW * std::max(nThreads, 1);
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<CBlockHeader> vHeaders;
+    vIndex.reserve(nWindow);
+    vHeaders.reserve(nWindow);
+
     // Load mapBlockIndex
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
@@ -288,12 +313,10 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
 
-                if (!CheckProofOfWork(pindexNew->GetBlockPoWHash(), pindexNew->nBits, consensusParams))
-                {
-                    LogPrintf("%s: CheckProofOfWorkFailed: %s\n", __func__, pindexNew->ToString());
-                    LogPrintf("%s: CheckProofOfWorkFailed: %s (hash %s, nBits=%x, nTime=%d)\n", __func__, pindexNew->GetBlockPoWHash().GetHex(), pindexNew->GetBlockHash().GetHex(), pindexNew->nBits, pindexNew->nTime);
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-                }
+                vIndex.push_back(pindexNew);
+                vHeaders.push_back(pindexNew->GetBlockHeader());
+                if (vIndex.size() == nWindow && !CheckBlockIndexProofOfWork(vIndex, vHeaders, consensusParams, nThreads))
+                    return false;
 
                 pcursor->Next();
             } else {
@@ -304,7 +327,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
         }
     }
 
-    return true;
+    return CheckBlockIndexProofOfWork(vIndex, vHeaders, consensusParams, nThreads);
 }
 
 namespace {
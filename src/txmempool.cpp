@@ -5,9 +5,11 @@
 
 #include <txmempool.h>
 
+#include <claimtrie.h>
 #include <consensus/consensus.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <nameclaim.h>
 #include <validation.h>
 #include <policy/policy.h>
 #include <policy/fees.h>
@@ -355,6 +357,42 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+// calls f with the normalized name, claim id and output of each claim, update and support in tx
+template <typename F>
+static void ForEachClaimOutput(const CTransaction& tx, F f)
+{
+    for (uint32_t i = 0; i < tx.vout.size(); ++i) {
+        int op;
+        std::vector<std::vector<unsigned char>> vvchParams;
+        if (!DecodeClaimScript(tx.vout[i].scriptPubKey, op, vvchParams))
+            continue;
+        auto name = CClaimTrieCacheNormalizationFork::normalizeName(std::string(vvchParams[0].begin(), vvchParams[0].end()));
+        auto claimId = op == OP_CLAIM_NAME ? ClaimIdHash(tx.GetHash(), i) : uint160(vvchParams[1]);
+        f(name, claimId, COutPoint(tx.GetHash(), i));
+    }
+}
+
+template <typename K>
+static void EraseClaimOutput(std::multimap<K, COutPoint>& claims, const K& key, const COutPoint& outPoint)
+{
+    auto range = claims.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == outPoint) {
+            claims.erase(it);
+            return;
+        }
+    }
+}
+
+template <typename K>
+static bool HaveClaimOutput(const std::multimap<K, COutPoint>& claims, const K& key, const COutPoint& outPoint)
+{
+    auto range = claims.equal_range(key);
+    return std::find_if(range.first, range.second, [&outPoint](const std::pair<const K, COutPoint>& claim) {
+        return claim.second == outPoint;
+    }) != range.second;
+}
+
 void CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
     NotifyEntryAdded(entry.GetSharedTx());
@@ -409,6 +447,11 @@ void CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
+
+    ForEachClaimOutput(tx, [this](const std::string& name, const uint160& claimId, const COutPoint& outPoint) {
+        mapClaimsByName.emplace(name, outPoint);
+        mapClaimsById.emplace(claimId, outPoint);
+    });
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
@@ -418,6 +461,11 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
+    ForEachClaimOutput(it->GetTx(), [this](const std::string& name, const uint160& claimId, const COutPoint& outPoint) {
+        EraseClaimOutput(mapClaimsByName, name, outPoint);
+        EraseClaimOutput(mapClaimsById, claimId, outPoint);
+    });
+
     if (vTxHashes.size() > 1) {
         vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
         vTxHashes[it->vTxHashesIdx].second->vTxHashesIdx = it->vTxHashesIdx;
@@ -588,6 +636,8 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapClaimsByName.clear();
+    mapClaimsById.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -624,6 +674,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
+    std::size_t claimsTotal = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
     const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
@@ -701,6 +752,12 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= child_sizes + it->GetTxSize());
 
+        ForEachClaimOutput(tx, [this, &claimsTotal](const std::string& name, const uint160& claimId, const COutPoint& outPoint) {
+            assert(HaveClaimOutput(mapClaimsByName, name, outPoint));
+            assert(HaveClaimOutput(mapClaimsById, claimId, outPoint));
+            ++claimsTotal;
+        });
+
         if (fDependsWait)
             waitingOnDependants.push_back(&(*it));
         else {
@@ -730,6 +787,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    assert(mapClaimsByName.size() == claimsTotal);
+    assert(mapClaimsById.size() == claimsTotal);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -817,6 +876,29 @@ CTransactionRef CTxMemPool::get(const uint256& hash) const
     return i->GetSharedTx();
 }
 
+template <typename K>
+static std::vector<COutPoint> ClaimOutputs(const std::multimap<K, COutPoint>& claims, const K& key)
+{
+    std::vector<COutPoint> outPoints;
+    auto range = claims.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it)
+        outPoints.push_back(it->second);
+    return outPoints;
+}
+
+std::vector<COutPoint> CTxMemPool::GetClaimsForName(const std::string& name) const
+{
+    auto normalized = CClaimTrieCacheNormalizationFork::normalizeName(name);
+    LOCK(cs);
+    return ClaimOutputs(mapClaimsByName, normalized);
+}
+
+std::vector<COutPoint> CTxMemPool::GetClaimsById(const uint160& claimId) const
+{
+    LOCK(cs);
+    return ClaimOutputs(mapClaimsById, claimId);
+}
+
 TxMempoolInfo CTxMemPool::info(const uint256& hash) const
 {
     LOCK(cs);
@@ -901,7 +983,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapClaimsByName) + memusage::DynamicUsage(mapClaimsById) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
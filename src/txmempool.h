@@ -519,6 +519,10 @@ public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
 
+    /** The claim, update and support outputs in the pool, by normalized name and by claim id */
+    std::multimap<std::string, COutPoint> mapClaimsByName GUARDED_BY(cs);
+    std::multimap<uint160, COutPoint> mapClaimsById GUARDED_BY(cs);
+
     /** Create a new CTxMemPool.
      */
     explicit CTxMemPool(CBlockPolicyEstimator* estimator = nullptr);
@@ -645,6 +649,11 @@ public:
     }
 
     CTransactionRef get(const uint256& hash) const;
+
+    /** The claim, update and support outputs in the pool for a name (compared normalized) or a
+     *  claim id, in the order they entered the pool. */
+    std::vector<COutPoint> GetClaimsForName(const std::string& name) const;
+    std::vector<COutPoint> GetClaimsById(const uint160& claimId) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
@@ -44,8 +44,10 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <atomic>
 #include <future>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -1527,6 +1529,7 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         }
 
         // remove any claims
+        int64_t nTimeScript = GetTimeMicros();
         for (size_t j = 0; j < tx.vout.size(); j++)
         {
             const CTxOut& txout = tx.vout[j];
@@ -1536,6 +1539,7 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 ProcessClaim(undoAdd, trieCache, txout.scriptPubKey);
             }
         }
+        trieCache.timings.nTimeScripts += GetTimeMicros() - nTimeScript;
 
         // restore inputs
         if (i > 0) { // not coinbases
@@ -1736,6 +1740,26 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
+static CClaimTrieTimings claimTrieTimings; // guarded by cs_main
+
+static void AddClaimTrieTimings(const CClaimTrieTimings& timings)
+{
+    claimTrieTimings += timings;
+    claimTrieTimings.nBlocks++;
+    const auto& total = claimTrieTimings;
+    LogPrint(BCLog::BENCH, "    - Claim scripts: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * timings.nTimeScripts, total.nTimeScripts * MICRO, total.nTimeScripts * MILLI / total.nBlocks);
+    LogPrint(BCLog::BENCH, "    - Claim queues: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * timings.nTimeQueues, total.nTimeQueues * MICRO, total.nTimeQueues * MILLI / total.nBlocks);
+    LogPrint(BCLog::BENCH, "    - Claim takeovers: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * timings.nTimeTakeovers, total.nTimeTakeovers * MICRO, total.nTimeTakeovers * MILLI / total.nBlocks);
+    LogPrint(BCLog::BENCH, "    - Claim trie hash: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * timings.nTimeMerkle, total.nTimeMerkle * MICRO, total.nTimeMerkle * MILLI / total.nBlocks);
+    LogPrint(BCLog::BENCH, "    - Claim trie flush: %.2fms, %u bytes [%.2fs (%.2fms/blk), %.2fkB/blk]\n", MILLI * timings.nTimeFlush, timings.nFlushBytes,
+        total.nTimeFlush * MICRO, total.nTimeFlush * MILLI / total.nBlocks, total.nFlushBytes * 0.001 / total.nBlocks);
+}
+
+CClaimTrieTimings GetClaimTrieTimings()
+{
+    LOCK(cs_main);
+    return claimTrieTimings;
+}
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
@@ -2001,7 +2025,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                     mClaimUndoHeights.emplace(index, nValidAtHeight);
                 }
             };
+            int64_t nTimeScript = GetTimeMicros();
             UpdateCache(tx, trieCache, view, pindex->nHeight, callbacks);
+            trieCache.timings.nTimeScripts += GetTimeMicros() - nTimeScript;
         }
 
         CTxUndo undoDummy;
@@ -2133,7 +2159,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastFlush = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pclaimTrie->PendingMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FlushStateMode::PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2184,8 +2210,10 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            if (mode == FlushStateMode::ALWAYS && !pclaimTrie->SyncToDisk())
-                return state.Error("Failed to write to claim trie database");
+            // The claim trie goes first: if the coins don't make it, LoadClaimTrie takes the
+            // trie back to their tip on the next start.
+            if (!pclaimTrie->WritePending(pcoinsTip->GetBestBlock(), mode == FlushStateMode::ALWAYS))
+                return AbortNode(state, "Failed to write to claim trie database");
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
@@ -2332,6 +2360,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         assert(flushed);
         assert(trieCache.flush());
         assert(pindexDelete->pprev->hashClaimTrie == trieCache.getMerkleHash());
+        AddClaimTrieTimings(trieCache.timings);
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2454,7 +2483,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
-    int64_t nTime3;
+    int64_t nTime3, nTime4;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
@@ -2472,9 +2501,10 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         assert(flushed);
         flushed = trieCache.flush();
         assert(flushed);
+        nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
+        LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
+        AddClaimTrieTimings(trieCache.timings);
     }
-    int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
-    LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
         return false;
@@ -3373,7 +3403,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3391,7 +3421,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3438,11 +3468,43 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    // Hash the proof of work of the headers that aren't known yet on the -par threads, between
+    // a short cs_main to find them and the one that accepts the batch. Headers up to the first
+    // one that fails skip the check under the lock; that one and the ones after it are checked
+    // there again, so the errors are reported as before.
+    std::vector<uint256> hashes;
+    hashes.reserve(headers.size());
+    for (const CBlockHeader& header : headers)
+        hashes.push_back(header.GetHash());
+    std::vector<bool> vKnown(headers.size());
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); ++i)
+            vKnown[i] = LookupBlockIndex(hashes[i]) != nullptr;
+    }
+    // a headers message has no more than MAX_HEADERS_RESULTS; the headers of a longer batch are
+    // checked under the lock past that
+    std::vector<CBlockHeader> unknown;
+    std::vector<size_t> vUnknownIndex;
+    for (size_t i = 0; i < headers.size() && unknown.size() < MAX_HEADERS_RESULTS; ++i) {
+        if (!vKnown[i]) {
+            unknown.push_back(headers[i]);
+            vUnknownIndex.push_back(i);
+        }
+    }
+    size_t nInvalid = unknown.size();
+    CheckProofOfWork(unknown, chainparams.GetConsensus(), std::max(nScriptCheckThreads, 1), &nInvalid);
+    // a header known before is checked under the lock too, in case it is gone by then
+    std::vector<bool> vCheckPOW(headers.size(), true);
+    for (size_t i = 0; i < nInvalid; ++i)
+        vCheckPOW[vUnknownIndex[i]] = false;
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); ++i) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex, vCheckPOW[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3848,7 +3910,7 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }, std::max(nScriptCheckThreads, 1)))
         return false;
 
     boost::this_thread::interruption_point();
@@ -4181,6 +4243,217 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view) {
     return g_chainstate.ReplayBlocks(params, view);
 }
 
+bool CChainState::LoadClaimTrie(const CChainParams& params, bool* pfCheckDeferred)
+{
+    LOCK(cs_main);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const CBlockIndex* pindexTrie = pindexTip;
+    uint256 hashTrieBlock;
+    if (pindexTip && pclaimTrie->GetBestBlock(hashTrieBlock) && hashTrieBlock != pindexTip->GetBlockHash()) {
+        // the trie was written but the coins were not (see FlushStateToDisk), or it was loaded
+        // from a snapshot of an earlier block (see LoadClaimTrieSnapshot)
+        pindexTrie = LookupBlockIndex(hashTrieBlock);
+        if (!pindexTrie || (pindexTrie->GetAncestor(pindexTip->nHeight) != pindexTip && !chainActive.Contains(pindexTrie)))
+            return error("%s: the claim trie is at block %s, which is neither on the chain nor after its tip", __func__, hashTrieBlock.ToString());
+    }
+
+    if (!CClaimTrieCache(pclaimTrie).ReadFromDisk(pindexTrie, pfCheckDeferred))
+        return false;
+    if (pindexTrie == pindexTip)
+        return true;
+    if (pindexTrie->nHeight < pindexTip->nHeight) {
+        LogPrintf("Connecting the claim trie from %s (%i) to the chain tip\n", pindexTrie->GetBlockHash().ToString(), pindexTrie->nHeight);
+        return ConnectClaimTrieBlocks(params, pindexTrie, _("Connecting the claim trie...")) && pclaimTrie->WritePending(pindexTip->GetBlockHash(), true);
+    }
+
+    uiInterface.ShowProgress(_("Rolling back the claim trie..."), 0, false);
+    // only the claims are of interest, the coins are dropped
+    CCoinsViewCache coins(pcoinsTip.get());
+    for (auto pindex = pindexTrie; pindex != pindexTip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, params.GetConsensus()))
+            return error("%s: ReadBlockFromDisk() failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+        LogPrintf("Rolling back the claim trie from %s (%i)\n", pindex->GetBlockHash().ToString(), pindex->nHeight);
+        CClaimTrieCache trieCache(pclaimTrie);
+        coins.SetBestBlock(pindex->GetBlockHash());
+        if (DisconnectBlock(block, pindex, coins, trieCache) == DISCONNECT_FAILED || !trieCache.flush())
+            return error("%s: DisconnectBlock failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+    }
+    uiInterface.ShowProgress("", 100, false);
+    return pclaimTrie->WritePending(pindexTip->GetBlockHash(), true);
+}
+
+bool LoadClaimTrie(const CChainParams& params, bool* pfCheckDeferred) {
+    return g_chainstate.LoadClaimTrie(params, pfCheckDeferred);
+}
+
+/** The transactions of a block that have claims or supports among their inputs or outputs, with their undo data. */
+struct CClaimTrieRebuildBlock
+{
+    const CBlockIndex* pindex = nullptr;
+    CDiskBlockPos pos; // taken under cs_main, which the threads reading the block don't hold
+    std::vector<CTransactionRef> vtx;
+    std::vector<CTxUndo> vtxundo;
+};
+
+static bool HasClaimScriptPrefix(const CScript& script)
+{
+    return !script.empty() && (script[0] == OP_CLAIM_NAME || script[0] == OP_SUPPORT_CLAIM || script[0] == OP_UPDATE_CLAIM);
+}
+
+static bool ReadClaimTrieRebuildBlock(CClaimTrieRebuildBlock& rebuild, const Consensus::Params& params)
+{
+    CBlock block;
+    CBlockUndo blockUndo;
+    if (!ReadBlockFromDisk(block, rebuild.pos, params) || block.GetHash() != rebuild.pindex->GetBlockHash())
+        return false;
+    if (!UndoReadFromDisk(blockUndo, rebuild.pindex) || blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return false;
+    // the coinbase is left out, as in ConnectBlock
+    for (std::size_t i = 1; i < block.vtx.size(); ++i) {
+        auto& txundo = blockUndo.vtxundo[i - 1];
+        bool fClaims = std::any_of(block.vtx[i]->vout.begin(), block.vtx[i]->vout.end(), [](const CTxOut& txout) {
+            return HasClaimScriptPrefix(txout.scriptPubKey);
+        }) || std::any_of(txundo.vprevout.begin(), txundo.vprevout.end(), [](const CTxInUndo& undo) {
+            return HasClaimScriptPrefix(undo.txout.scriptPubKey);
+        });
+        if (fClaims) {
+            rebuild.vtx.push_back(block.vtx[i]);
+            rebuild.vtxundo.push_back(std::move(txundo));
+        }
+    }
+    return true;
+}
+
+bool CChainState::RebuildClaimTrie(const CChainParams& params)
+{
+    LOCK(cs_main);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    LogPrintf("Rebuilding the claim trie from the blocks...\n");
+    if (!pclaimTrie->Wipe() || !CClaimTrieCache(pclaimTrie).ReadFromDisk(chainActive.Genesis(), nullptr))
+        return error("%s: error starting the claim trie over", __func__);
+    if (!pindexTip)
+        return true;
+
+    if (!ConnectClaimTrieBlocks(params, chainActive.Genesis(), _("Rebuilding the claim trie...")))
+        return false;
+    pclaimTrie->SetVerified();
+    return pclaimTrie->WritePending(pindexTip->GetBlockHash(), true);
+}
+
+bool CChainState::ConnectClaimTrieBlocks(const CChainParams& params, const CBlockIndex* pindexTrie, const std::string& strProgress)
+{
+    AssertLockHeld(cs_main);
+
+    // The blocks are read and sifted by -par threads ahead of their claims being applied.
+    // The spent outputs come from the undo data, so neither the coins nor the scripts are
+    // looked at again; each block's hash of the trie checks the result along the way.
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const int nThreads = std::max(nScriptCheckThreads, 1);
+    const int nWindow = 64 * nThreads;
+    const int nBlocks = pindexTip->nHeight - pindexTrie->nHeight;
+    CCoinsView viewDummy;
+    uiInterface.ShowProgress(strProgress, 0, false);
+    for (int nHeight = pindexTrie->nHeight + 1; nHeight <= pindexTip->nHeight; nHeight += nWindow) {
+        if (ShutdownRequested())
+            return false;
+
+        std::vector<CClaimTrieRebuildBlock> blocks(std::min(nWindow, pindexTip->nHeight + 1 - nHeight));
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            blocks[i].pindex = chainActive[nHeight + i];
+            blocks[i].pos = blocks[i].pindex->GetBlockPos();
+        }
+        std::atomic<bool> fRead{true};
+        auto readBlocks = [&](std::size_t nFirst) {
+            for (auto i = nFirst; i < blocks.size() && fRead; i += nThreads)
+                if (!ReadClaimTrieRebuildBlock(blocks[i], params.GetConsensus()))
+                    fRead = false;
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < nThreads; ++i)
+            threads.emplace_back(readBlocks, i);
+        readBlocks(0);
+        for (auto& thread : threads)
+            thread.join();
+        if (!fRead)
+            return error("%s: can't read the blocks and undo data from height %d on", __func__, nHeight);
+
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            const CBlockIndex* pindex = blocks[i].pindex;
+            CClaimTrieCache trieCache(pclaimTrie);
+            trieCache.initializeIncrement();
+            CCoinsViewCache view(&viewDummy);
+            for (std::size_t j = 0; j < blocks[i].vtx.size(); ++j) {
+                const CTransaction& tx = *blocks[i].vtx[j];
+                auto& vprevout = blocks[i].vtxundo[j].vprevout;
+                for (std::size_t k = 0; k < tx.vin.size() && k < vprevout.size(); ++k)
+                    view.AddCoin(tx.vin[k].prevout, Coin(vprevout[k].txout, vprevout[k].nHeight, vprevout[k].fCoinBase), true);
+                UpdateCache(tx, trieCache, view, pindex->nHeight);
+            }
+            CBlockUndo undoDummy;
+            if (!trieCache.incrementBlock(undoDummy.insertUndo, undoDummy.expireUndo, undoDummy.insertSupportUndo, undoDummy.expireSupportUndo, undoDummy.takeoverHeightUndo))
+                return error("%s: error rebuilding the claim trie at %d", __func__, pindex->nHeight);
+            if (trieCache.getMerkleHash() != pindex->hashClaimTrie)
+                return error("%s: the rebuilt claim trie doesn't match block %s at %d", __func__, pindex->GetBlockHash().ToString(), pindex->nHeight);
+            if (!trieCache.flush())
+                return error("%s: error flushing the claim trie at %d", __func__, pindex->nHeight);
+        }
+
+        // the coins cache is all but empty this early, so the trie gets its room
+        if (pclaimTrie->PendingMemoryUsage() > nCoinCacheUsage && !pclaimTrie->WritePending(uint256()))
+            return error("%s: error writing the claim trie", __func__);
+        const int nDone = nHeight + blocks.size() - 1;
+        LogPrintf("Connected the claim trie up to height %d\n", nDone);
+        uiInterface.ShowProgress(strProgress, int64_t(nDone - pindexTrie->nHeight) * 100 / nBlocks, false);
+    }
+    uiInterface.ShowProgress("", 100, false);
+    return true;
+}
+
+bool RebuildClaimTrie(const CChainParams& params) {
+    return g_chainstate.RebuildClaimTrie(params);
+}
+
+bool LoadClaimTrieSnapshot(const fs::path& path)
+{
+    LOCK(cs_main);
+    if (!chainActive.Tip())
+        return error("%s: there are no blocks to load the claim trie of", __func__);
+
+    uint256 hashSnapshot, hashTrie;
+    int nHeight;
+    if (!CClaimTrie::ReadSnapshotBlock(path, hashSnapshot, nHeight))
+        return false;
+    const CBlockIndex* pindexSnapshot = LookupBlockIndex(hashSnapshot);
+    if (!pindexSnapshot || !chainActive.Contains(pindexSnapshot))
+        return error("%s: the claim trie snapshot %s is of block %s at height %d, which isn't on the chain up to its tip at height %d",
+            __func__, path.string(), hashSnapshot.ToString(), nHeight, chainActive.Height());
+    // -loadclaimtrie stays set across restarts, a trie at the block of the snapshot or past it has it already
+    const CBlockIndex* pindexTrie = pclaimTrie->GetBestBlock(hashTrie) ? LookupBlockIndex(hashTrie) : nullptr;
+    if (pindexTrie && pindexTrie->GetAncestor(pindexSnapshot->nHeight) == pindexSnapshot) {
+        LogPrintf("The claim trie is already at or past the block of %s\n", path.string());
+        return true;
+    }
+    return pclaimTrie->LoadSnapshot(path, hashSnapshot);
+}
+
+bool DumpClaimTrieSnapshot(const fs::path& path, uint256& hashBlock, int& nHeight, uint64_t& nRows)
+{
+    std::shared_ptr<const CClaimTrieReadView> view;
+    {
+        LOCK(cs_main);
+        if (!chainActive.Tip())
+            return error("%s: there are no blocks to dump the claim trie of", __func__);
+        hashBlock = chainActive.Tip()->GetBlockHash();
+        nHeight = chainActive.Height();
+        view = pclaimTrie->getReadView();
+    }
+    // the view stays as it is, so the blocks connected meanwhile don't show in the file
+    return view->writeSnapshot(path, hashBlock, nRows);
+}
+
 bool CChainState::RewindBlockIndex(const CChainParams& params)
 {
     LOCK(cs_main);
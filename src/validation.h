@@ -467,8 +467,9 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to mapBlockIndex.
+     * fCheckPOW is false only when the caller has already checked the header's proof of work.
      */
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
@@ -485,6 +486,8 @@ public:
     void ResetBlockFailureFlags(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
+    bool LoadClaimTrie(const CChainParams& params, bool* pfCheckDeferred);
+    bool RebuildClaimTrie(const CChainParams& params);
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
 
@@ -512,6 +515,8 @@ private:
 
 
     bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /** Apply the claims of the blocks after pindexTrie, the block the claim trie is at, up to the tip. */
+    bool ConnectClaimTrieBlocks(const CChainParams& params, const CBlockIndex* pindexTrie, const std::string& strProgress) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /************************************************************
@@ -598,6 +603,24 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
+/** Load the claim trie, disconnecting the blocks it was written with beyond the coins tip, or connecting
+ *  those after it when it's behind. */
+bool LoadClaimTrie(const CChainParams& params, bool* pfCheckDeferred);
+
+/** Rebuild the claim trie from the claim scripts of the blocks up to the tip, without validating them again. */
+bool RebuildClaimTrie(const CChainParams& params);
+
+/** Replace the claim trie on disk with a snapshot of it as of a block of the active chain; LoadClaimTrie
+ *  checks it and connects it up to the tip. A trie at or past the block of the snapshot is left alone,
+ *  a snapshot of a block off the active chain (or ahead of its tip) is an error. */
+bool LoadClaimTrieSnapshot(const fs::path& path);
+
+/** Write a snapshot of the claim trie as of the chain tip to path. */
+bool DumpClaimTrieSnapshot(const fs::path& path, uint256& hashBlock, int& nHeight, uint64_t& nRows);
+
+/** The claim trie work of the blocks connected and disconnected since startup, by stage. */
+CClaimTrieTimings GetClaimTrieTimings();
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);